@@ -0,0 +1,152 @@
+#include "bench.hpp"
+#include "deejai/arena.hpp"
+#include "deejai/scanner.hpp"
+
+#include <atomic>
+#include <cerrno>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <span>
+#include <string>
+#include <vector>
+
+// Heap allocations are counted by replacing malloc in front of glibc, which works for
+// every allocation of the bench, C++ or Eigen alike. Elsewhere only the times are reported.
+#if defined(__GLIBC__) && !defined(__SANITIZE_ADDRESS__)
+#define DEEJAI_COUNT_ALLOCATIONS 1
+
+static std::atomic<uint64_t> heap_allocations = 0;
+static std::atomic<uint64_t> heap_bytes = 0;
+
+extern "C" {
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t count, size_t size);
+void *__libc_realloc(void *ptr, size_t size);
+void *__libc_memalign(size_t alignment, size_t size);
+
+static void count_allocation(size_t size) {
+    heap_allocations.fetch_add(1, std::memory_order_relaxed);
+    heap_bytes.fetch_add(size, std::memory_order_relaxed);
+}
+
+void *malloc(size_t size) noexcept {
+    count_allocation(size);
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t count, size_t size) noexcept {
+    count_allocation(count * size);
+    return __libc_calloc(count, size);
+}
+
+void *realloc(void *ptr, size_t size) noexcept {
+    count_allocation(size);
+    return __libc_realloc(ptr, size);
+}
+
+void *aligned_alloc(size_t alignment, size_t size) noexcept {
+    count_allocation(size);
+    return __libc_memalign(alignment, size);
+}
+
+int posix_memalign(void **ptr, size_t alignment, size_t size) noexcept {
+    count_allocation(size);
+    *ptr = __libc_memalign(alignment, size);
+    return *ptr == nullptr ? ENOMEM : 0;
+}
+}
+#endif
+
+namespace deejai::bench {
+
+static constexpr int SAMPLING_RATE = 22050;
+// input of the deej-ai model
+static constexpr int N_MELS = 96;
+static constexpr int SLICE_SIZE = 216;
+static constexpr int FILES = 8;
+static constexpr float TWO_PI = 6.28318531f;
+
+struct allocation_count {
+    uint64_t allocations = 0;
+    uint64_t bytes = 0;
+};
+
+static allocation_count allocations() {
+#ifdef DEEJAI_COUNT_ALLOCATIONS
+    return {heap_allocations.load(), heap_bytes.load()};
+#else
+    return {};
+#endif
+}
+
+// Tracks of different lengths around the given one, as a worker gets them.
+static std::vector<vectorf> tracks(int seconds) {
+    std::mt19937 rng(seconds);
+    std::normal_distribution<float> normal(0.f, 0.05f);
+    std::uniform_real_distribution<float> length(0.75f, 1.25f);
+    std::vector<vectorf> result;
+    for (int f = 0; f < FILES; f++) {
+        vectorf samples(static_cast<int>(seconds * SAMPLING_RATE * length(rng)));
+        for (int i = 0; i < samples.size(); i++) {
+            const float t = static_cast<float>(i) / SAMPLING_RATE;
+            samples[i] = 0.3f * std::sin(TWO_PI * 220.f * (f + 1) * t) + normal(rng);
+        }
+        result.push_back(std::move(samples));
+    }
+    return result;
+}
+
+// The buffers of a worker scanning the tracks after a first one: on their own every file
+// takes them from the heap again, in the arena of the worker they reuse its memory.
+static void scan_allocations() {
+    for (int seconds : {30, 180}) {
+        const std::vector<vectorf> audio = tracks(seconds);
+        for (bool use_arena : {false, true}) {
+            arena scratch;
+            allocation_count before;
+            size_t values = 0;
+            const double ms = time_ms([&] {
+                for (int f = 0; f < FILES; f++) {
+                    if (f == 1) {
+                        before = allocations();
+                    }
+                    if (use_arena) {
+                        // the samples as load_audio leaves them in the arena
+                        float *samples = scratch.allocate<float>(audio[f].size());
+                        std::memcpy(samples, audio[f].data(), audio[f].size() * sizeof(float));
+                        auto tensor = tensor_from_samples(std::span<const float>(samples, audio[f].size()), N_MELS,
+                                                          SLICE_SIZE, scratch);
+                        values += tensor.has_value() ? tensor->values.size() : 0;
+                        scratch.reset();
+                    } else {
+                        vectorf samples = audio[f];
+                        auto tensor = tensor_from_samples(samples, N_MELS, SLICE_SIZE);
+                        values += tensor.has_value() ? tensor->values.size() : 0;
+                    }
+                }
+            });
+            const allocation_count after = allocations();
+            const double files = FILES - 1;
+#ifdef DEEJAI_COUNT_ALLOCATIONS
+            const std::string mallocs = format((after.allocations - before.allocations) / files, 1);
+            const std::string megabytes = format((after.bytes - before.bytes) / files / (1 << 20), 2);
+#else
+            const std::string mallocs = "n/a";
+            const std::string megabytes = "n/a";
+#endif
+            report("scan_allocations", {{"seconds", std::to_string(seconds)},
+                                        {"buffers", use_arena ? "worker_arena" : "per_file"},
+                                        {"mallocs_per_file", mallocs},
+                                        {"heap_mb_per_file", megabytes},
+                                        {"arena_mb", format(scratch.capacity() / double(1 << 20), 2)},
+                                        {"ms_per_file", format(ms / FILES)},
+                                        {"slices", std::to_string(values / (N_MELS * SLICE_SIZE))}});
+        }
+    }
+}
+
+static registration allocation_registration("scan_allocations", scan_allocations);
+
+} // namespace deejai::bench
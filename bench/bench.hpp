@@ -0,0 +1,52 @@
+#pragma once
+
+#include "deejai/common.hpp"
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace deejai::bench {
+
+typedef std::vector<std::pair<std::string, std::string>> fields;
+
+struct benchmark {
+    std::string name;
+    std::function<void()> run;
+};
+
+std::vector<benchmark> &registry();
+
+// Adds a benchmark to the registry from a static object of its source file.
+struct registration {
+    registration(const std::string &name, std::function<void()> run);
+};
+
+// Prints one line of results for the running benchmark.
+void report(const std::string &benchmark, const fields &values);
+
+std::string format(double value, int precision = 3);
+
+// Random vectors drawn around a few centres, like the tracks of a few genres.
+matrixf clustered_vectors(int n, int dim, uint32_t seed);
+
+// Milliseconds taken by the fastest of the repetitions.
+template <typename F>
+double time_ms(F &&function, int repetitions = 1) {
+    double best = 0.0;
+    for (int i = 0; i < repetitions; i++) {
+        const auto start = std::chrono::steady_clock::now();
+        function();
+        const double elapsed =
+            std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        if (i == 0 || elapsed < best) {
+            best = elapsed;
+        }
+    }
+    return best;
+}
+
+} // namespace deejai::bench
@@ -0,0 +1,44 @@
+#include "bench.hpp"
+#include "deejai/distance.hpp"
+
+#include <numeric>
+
+namespace deejai::bench {
+
+// The distance of every pair from the dot product and both norms, as reorder used to.
+static float pairwise_distances(const embeddings &vectors, const std::vector<track_id> &ids) {
+    float checksum = 0.f;
+    for (size_t i = 0; i < ids.size(); i++) {
+        for (size_t j = i + 1; j < ids.size(); j++) {
+            const float denom = vectors.norm(ids[i]) * vectors.norm(ids[j]);
+            checksum += denom < 0.001f ? 1.f : 1.f - vectors.dot(ids[i], ids[j]) / denom;
+        }
+    }
+    return checksum;
+}
+
+static void distance_builder() {
+    for (int n : {100, 1000, 10000}) {
+        const embeddings vectors(clustered_vectors(n, 100, n), storage_format::f32);
+        std::vector<track_id> ids(n);
+        std::iota(ids.begin(), ids.end(), 0);
+
+        float checksum = 0.f;
+        const int repetitions = n <= 1000 ? 5 : 1;
+        const double pairwise_ms = time_ms([&] { checksum += pairwise_distances(vectors, ids); }, repetitions);
+        distance_matrix dist;
+        const double blocked_ms = time_ms([&] { dist = distance_matrix(vectors, ids); }, repetitions);
+
+        report("distance", {{"n", std::to_string(n)},
+                            {"layout", dist.triangular() ? "triangular" : "dense"},
+                            {"memory_mb", format(dist.memory_bytes() / 1048576.0, 1)},
+                            {"pairwise_ms", format(pairwise_ms)},
+                            {"blocked_ms", format(blocked_ms)},
+                            {"speedup", format(pairwise_ms / blocked_ms, 1)},
+                            {"checksum", format(checksum, 0)}});
+    }
+}
+
+static registration distance_registration("distance", distance_builder);
+
+} // namespace deejai::bench
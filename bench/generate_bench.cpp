@@ -0,0 +1,60 @@
+#include "bench.hpp"
+#include "deejai/generator.hpp"
+
+#include <cstdio>
+#include <filesystem>
+
+namespace deejai::bench {
+
+static std::string track_name(int i) {
+    char name[32];
+    std::snprintf(name, sizeof(name), "/bench/t%07d.mp3", i);
+    return name;
+}
+
+// Mean cosine similarity of consecutive songs.
+static float smoothness(const matrixf &vectors, const std::vector<std::string> &playlist) {
+    float sum = 0.f;
+    for (size_t i = 1; i < playlist.size(); i++) {
+        const int a = std::stoi(playlist[i - 1].substr(8));
+        const int b = std::stoi(playlist[i].substr(8));
+        sum += vectors.row(a).normalized().dot(vectors.row(b).normalized());
+    }
+    return playlist.size() > 1 ? sum / (playlist.size() - 1) : 0.f;
+}
+
+static void generate_methods() {
+    const int n = 100000;
+    const matrixf vectors = clustered_vectors(n, 100, 7);
+    std::vector<std::string> tracks;
+    for (int i = 0; i < n; i++) {
+        tracks.push_back(track_name(i));
+    }
+
+    const std::filesystem::path dir = std::filesystem::temp_directory_path() / "deej-ai-bench";
+    std::filesystem::create_directories(dir / BUNDLED_VECS_DIRNAME);
+    save_bundle(tracks, embeddings(vectors, storage_format::f32), dir / BUNDLED_VECS_DIRNAME / BUNDLED_VECS_FILENAME);
+    const generator gen(dir.string());
+    std::filesystem::remove_all(dir);
+
+    const std::vector<std::string> seeds = {track_name(1), track_name(2)};
+    const int nsongs = 30;
+    auto run = [&](const std::string &method, int beam_width) {
+        std::vector<std::string> playlist;
+        const double ms = time_ms([&] { playlist = gen.generate_playlist(method, seeds, nsongs, 3, 0.f, beam_width); }, 3);
+        report("generate", {{"n", std::to_string(n)},
+                            {"method", method},
+                            {"beam_width", method == "beam" ? std::to_string(beam_width) : "-"},
+                            {"songs", std::to_string(playlist.size())},
+                            {"smoothness", format(smoothness(vectors, playlist), 4)},
+                            {"ms", format(ms)}});
+    };
+    run("append", 1);
+    for (int width : {1, 4, 8, 16}) {
+        run("beam", width);
+    }
+}
+
+static registration generate_registration("generate", generate_methods);
+
+} // namespace deejai::bench
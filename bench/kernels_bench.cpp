@@ -0,0 +1,60 @@
+#include "bench.hpp"
+#include "deejai/kernels.hpp"
+
+#include <cmath>
+#include <random>
+
+namespace deejai::bench {
+
+// Every kernel with each implementation the CPU supports, the last one is the active one.
+static void kernel_levels() {
+    const int rows = 100000;
+    const int dim = 100;
+    const matrixf vectors = clustered_vectors(rows, dim, rows);
+    const vectorf query = vectors.row(0);
+    // a block of 256 rows by 256 columns, like one step of the distance builder
+    const matrixf tile_a = vectors.topRows(256);
+    const matrixf tile_bt = vectors.middleRows(256, 256).transpose();
+    matrixf tile_out(256, 256);
+
+    // a minute of audio, and the power of its mel spectrogram
+    const size_t samples = 60 * 22050;
+    std::mt19937 rng(1);
+    std::vector<int16_t> pcm(samples);
+    for (auto &sample : pcm) {
+        sample = static_cast<int16_t>(rng());
+    }
+    std::vector<float> converted(samples);
+    std::uniform_real_distribution<float> exponent(-12.f, 4.f);
+    std::vector<float> power(96 * 2600);
+    for (auto &value : power) {
+        value = std::pow(10.f, exponent(rng));
+    }
+    std::vector<float> db(power.size());
+
+    for (const kernels::kernel_table &table : kernels::supported()) {
+        float checksum = 0.f;
+        const double dot_ms = time_ms([&] {
+            for (int r = 0; r < rows; r++) {
+                checksum += table.dot_f32(query.data(), vectors.row(r).data(), dim);
+            }
+        }, 5);
+        const double tile_ms = time_ms([&] {
+            table.dot_tile_f32(tile_a.data(), dim, 256, tile_bt.data(), 256, 256, dim, tile_out.data(), 256);
+        }, 5);
+        const double pcm_ms =
+            time_ms([&] { table.int16_to_float(pcm.data(), pcm.size(), 1.f / 32768.f, converted.data()); }, 5);
+        float top = 0.f;
+        const double db_ms = time_ms([&] { top = table.power_to_db(power.data(), power.size(), db.data()); }, 5);
+        report("kernels", {{"level", table.name},
+                           {"dot_f32_ms", format(dot_ms)},
+                           {"dot_tile_f32_ms", format(tile_ms)},
+                           {"int16_to_float_ms", format(pcm_ms)},
+                           {"power_to_db_ms", format(db_ms)},
+                           {"checksum", format(checksum + tile_out.sum() + converted[1] + top, 2)}});
+    }
+}
+
+static registration kernels_registration("kernels", kernel_levels);
+
+} // namespace deejai::bench
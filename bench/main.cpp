@@ -0,0 +1,142 @@
+#include "bench.hpp"
+#include "cxxopts.hpp"
+
+#include <cctype>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <sstream>
+
+namespace deejai::bench {
+
+std::vector<benchmark> &registry() {
+    static std::vector<benchmark> benchmarks;
+    return benchmarks;
+}
+
+registration::registration(const std::string &name, std::function<void()> run) {
+    registry().push_back({name, std::move(run)});
+}
+
+// with --json the results are kept and printed together at the end
+static bool json_output = false;
+static std::vector<std::pair<std::string, fields>> results;
+
+void report(const std::string &benchmark, const fields &values) {
+    if (json_output) {
+        results.emplace_back(benchmark, values);
+        return;
+    }
+    std::cout << benchmark;
+    for (const auto &[key, value] : values) {
+        std::cout << "  " << key << "=" << value;
+    }
+    std::cout << std::endl;
+}
+
+static std::string json_string(const std::string &text) {
+    std::ostringstream out;
+    out << '"';
+    for (char c : text) {
+        if (c == '"' || c == '\\') {
+            out << '\\' << c;
+        } else if (static_cast<unsigned char>(c) < 0x20) {
+            out << "\\u" << std::hex << std::setw(4) << std::setfill('0') << static_cast<int>(c) << std::dec;
+        } else {
+            out << c;
+        }
+    }
+    out << '"';
+    return out.str();
+}
+
+// Numbers are written as JSON numbers so the results can be plotted as they are.
+static std::string json_value(const std::string &value) {
+    const bool numeric = !value.empty() && (std::isdigit(static_cast<unsigned char>(value[0])) ||
+                                            (value[0] == '-' && value.size() > 1 &&
+                                             std::isdigit(static_cast<unsigned char>(value[1]))));
+    char *end = nullptr;
+    if (numeric) {
+        std::strtod(value.c_str(), &end);
+    }
+    return numeric && *end == '\0' ? value : json_string(value);
+}
+
+static void print_json() {
+    std::cout << "{\"benchmarks\": [";
+    for (size_t i = 0; i < results.size(); i++) {
+        std::cout << (i == 0 ? "\n" : ",\n") << "  {\"name\": " << json_string(results[i].first);
+        for (const auto &[key, value] : results[i].second) {
+            std::cout << ", " << json_string(key) << ": " << json_value(value);
+        }
+        std::cout << "}";
+    }
+    std::cout << "\n]}" << std::endl;
+}
+
+std::string format(double value, int precision) {
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(precision) << value;
+    return out.str();
+}
+
+matrixf clustered_vectors(int n, int dim, uint32_t seed) {
+    std::mt19937 rng(seed);
+    std::normal_distribution<float> normal;
+    const int clusters = std::max(1, n / 50);
+    matrixf centres(clusters, dim);
+    for (int i = 0; i < centres.size(); i++) {
+        centres.data()[i] = normal(rng);
+    }
+
+    matrixf vectors(n, dim);
+    std::uniform_int_distribution<int> cluster(0, clusters - 1);
+    for (int i = 0; i < n; i++) {
+        vectors.row(i) = centres.row(cluster(rng));
+        for (int d = 0; d < dim; d++) {
+            vectors(i, d) += 0.5f * normal(rng);
+        }
+    }
+    return vectors;
+}
+
+} // namespace deejai::bench
+
+int main(int argc, char *argv[]) {
+    try {
+        cxxopts::Options options("deej-ai-bench", "Benchmarks of the deej-ai components.\n"
+                                                  "  deej-ai-bench [--filter <name>] [--json]\n");
+        options.add_options()("h,help", "Print help.");
+        options.add_options()("l,list", "List the benchmarks.");
+        options.add_options()("f,filter", "Only run the benchmarks whose name contains the given text.",
+                              cxxopts::value<std::string>()->default_value(""));
+        options.add_options()("json", "Print the results as one JSON document, to track them over time.");
+
+        auto result = options.parse(argc, argv);
+        if (result.count("help")) {
+            std::cout << options.help() << std::endl;
+            return 0;
+        }
+
+        const std::string filter = result["filter"].as<std::string>();
+        deejai::bench::json_output = result.count("json") && !result.count("list");
+        for (const auto &benchmark : deejai::bench::registry()) {
+            if (benchmark.name.find(filter) == std::string::npos) {
+                continue;
+            }
+            if (result.count("list")) {
+                std::cout << benchmark.name << std::endl;
+            } else {
+                benchmark.run();
+            }
+        }
+        if (deejai::bench::json_output) {
+            deejai::bench::print_json();
+        }
+    } catch (const std::exception &e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
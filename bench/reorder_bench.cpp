@@ -0,0 +1,40 @@
+#include "bench.hpp"
+#include "deejai/reorder.hpp"
+
+namespace deejai::bench {
+
+static std::string size_class(int n) {
+    if (n <= EXACT_REORDER_MAX_TRACKS) {
+        return "small";
+    }
+    if (n < LOCAL_SEARCH_REORDER_MIN_TRACKS) {
+        return "medium";
+    }
+    return "large";
+}
+
+static void reorder_solvers() {
+    for (int n : {8, 12, 16, 20, 50, 100, 500, 1000, 5000}) {
+        const distance_matrix dist(clustered_vectors(n, 100, n));
+        const reorder_solver automatic = select_reorder_solver(n);
+        for (reorder_solver solver : {reorder_solver::exact, reorder_solver::annealing, reorder_solver::local_search}) {
+            if (select_reorder_solver(n, solver) != solver) {
+                continue;
+            }
+            reorder_options options;
+            options.seed = 1;
+            options.solver = solver;
+            std::vector<int> path;
+            const double ms = time_ms([&] { path = solve_path(dist, 0, options); });
+            report("reorder", {{"n", std::to_string(n)},
+                               {"class", size_class(n)},
+                               {"solver", reorder_solver_name(solver) + (solver == automatic ? "*" : "")},
+                               {"cost", format(path_length(dist, path), 4)},
+                               {"ms", format(ms)}});
+        }
+    }
+}
+
+static registration reorder_registration("reorder", reorder_solvers);
+
+} // namespace deejai::bench
@@ -0,0 +1,94 @@
+#include "bench.hpp"
+#include "deejai/frontend.hpp"
+#include "deejai/scanner.hpp"
+
+#include <librosa.h>
+
+#include <cmath>
+#include <random>
+
+namespace deejai::bench {
+
+static constexpr int SAMPLING_RATE = 22050;
+// input of the deej-ai model
+static constexpr int N_MELS = 96;
+static constexpr int SLICE_SIZE = 216;
+static constexpr float TWO_PI = 6.28318531f;
+
+// A few seconds of a chord with some noise, at the sampling rate of the scan.
+static vectorf synthetic_audio(int seconds, uint32_t seed) {
+    std::mt19937 rng(seed);
+    std::normal_distribution<float> normal(0.f, 0.05f);
+    vectorf samples(seconds * SAMPLING_RATE);
+    for (int i = 0; i < samples.size(); i++) {
+        const float t = static_cast<float>(i) / SAMPLING_RATE;
+        samples[i] = 0.3f * std::sin(TWO_PI * 220.f * t) + 0.2f * std::sin(TWO_PI * 277.2f * t) +
+                     0.2f * std::sin(TWO_PI * 329.6f * t) + normal(rng);
+    }
+    return samples;
+}
+
+static void mel_frontend() {
+    for (int seconds : {10, 30, 180}) {
+        vectorf samples = synthetic_audio(seconds, seconds);
+        matrixf reference;
+        const double reference_ms = time_ms([&] {
+            reference = librosa::internal::melspectrogram(samples, SAMPLING_RATE, 2048, 512, "hann", true,
+                                                          "constant", 2, N_MELS, 0, SAMPLING_RATE / 2);
+        }, 3);
+        matrixf mel;
+        const double mel_ms =
+            time_ms([&] { mel = mel_spectrogram(samples, SAMPLING_RATE, 2048, 512, N_MELS); }, 3);
+        const double reference_db_ms = time_ms([&] { librosa::internal::power2db(reference); }, 3);
+        matrixf db;
+        const double db_ms = time_ms([&] { db = power_to_db(mel); }, 3);
+        report("melspectrogram", {{"seconds", std::to_string(seconds)},
+                                  {"frames", std::to_string(mel.cols())},
+                                  {"librosa_ms", format(reference_ms)},
+                                  {"melspectrogram_ms", format(mel_ms)},
+                                  {"librosa_power2db_ms", format(reference_db_ms)},
+                                  {"power2db_ms", format(db_ms)},
+                                  {"checksum", format(db.sum(), 0)}});
+    }
+}
+
+static void audio_tensor() {
+    for (int seconds : {10, 30, 180}) {
+        vectorf samples = synthetic_audio(seconds, seconds);
+        size_t values = 0;
+        const double ms = time_ms([&] {
+            auto tensor = tensor_from_samples(samples, N_MELS, SLICE_SIZE);
+            values = tensor.has_value() ? tensor->buffer.size() : 0;
+        }, 3);
+        report("tensor_from_audio", {{"seconds", std::to_string(seconds)},
+                                     {"slices", std::to_string(values / (N_MELS * SLICE_SIZE))},
+                                     {"ms", format(ms)}});
+    }
+}
+
+static void tfidf_bundling() {
+    // a track of a few minutes gives about ten slice vectors
+    const int slices = 10;
+    for (int batch_size : {10, 50, 100, 200}) {
+        const matrixf vectors = clustered_vectors(batch_size * slices, 100, batch_size);
+        std::vector<matrixf> tracks;
+        std::vector<const matrixf *> matrices;
+        for (int t = 0; t < batch_size; t++) {
+            tracks.push_back(vectors.middleRows(t * slices, slices));
+        }
+        for (const auto &track : tracks) {
+            matrices.push_back(&track);
+        }
+        std::vector<vectorf> bundled;
+        const double ms = time_ms([&] { bundled = tfidf_vectors(matrices, 0.001); }, batch_size <= 50 ? 5 : 1);
+        report("tfidf", {{"batch_size", std::to_string(batch_size)},
+                         {"vectors", std::to_string(batch_size * slices)},
+                         {"ms", format(ms)}});
+    }
+}
+
+static registration mel_registration("melspectrogram", mel_frontend);
+static registration tensor_registration("tensor_from_audio", audio_tensor);
+static registration tfidf_registration("tfidf", tfidf_bundling);
+
+} // namespace deejai::bench
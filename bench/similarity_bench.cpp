@@ -0,0 +1,40 @@
+#include "bench.hpp"
+#include "deejai/generator.hpp"
+
+#include <cstdio>
+#include <filesystem>
+#include <unordered_set>
+
+namespace deejai::bench {
+
+static void most_similar_sizes() {
+    const std::filesystem::path dir = std::filesystem::temp_directory_path() / "deej-ai-bench-similarity";
+    for (int n : {10000, 100000, 1000000}) {
+        const matrixf vectors = clustered_vectors(n, 100, n);
+        std::vector<std::string> tracks;
+        tracks.reserve(n);
+        for (int i = 0; i < n; i++) {
+            char name[32];
+            std::snprintf(name, sizeof(name), "/bench/t%07d.mp3", i);
+            tracks.emplace_back(name);
+        }
+        std::filesystem::create_directories(dir / BUNDLED_VECS_DIRNAME);
+        save_bundle(tracks, embeddings(vectors, storage_format::f32), dir / BUNDLED_VECS_DIRNAME / BUNDLED_VECS_FILENAME);
+        const generator gen(dir.string());
+        std::filesystem::remove_all(dir);
+
+        const std::unordered_set<std::string> excluded = {tracks[0]};
+        const vectorf query = vectors.row(0);
+        std::vector<std::pair<std::string, float>> similar;
+        const double ms = time_ms([&] { similar = gen.most_similar(excluded, query, 10); }, 5);
+        report("most_similar", {{"n", std::to_string(n)},
+                                {"topn", "10"},
+                                {"ms", format(ms)},
+                                {"tracks_per_us", format(n / (ms * 1000.0), 1)},
+                                {"best", similar.empty() ? "-" : format(similar.front().second, 4)}});
+    }
+}
+
+static registration most_similar_registration("most_similar", most_similar_sizes);
+
+} // namespace deejai::bench
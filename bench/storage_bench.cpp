@@ -0,0 +1,40 @@
+#include "bench.hpp"
+#include "deejai/utils.hpp"
+
+#include <cstdio>
+#include <filesystem>
+#include <unordered_map>
+
+namespace deejai::bench {
+
+static void matrix_map_io() {
+    const std::filesystem::path dir = std::filesystem::temp_directory_path() / "deej-ai-bench-storage";
+    std::filesystem::create_directories(dir);
+    const std::filesystem::path path = dir / "vecs.bin";
+    for (int n : {1000, 10000, 100000}) {
+        const matrixf vectors = clustered_vectors(n, 100, n);
+        std::unordered_map<std::string, matrixf> map;
+        for (int i = 0; i < n; i++) {
+            char name[32];
+            std::snprintf(name, sizeof(name), "/bench/t%07d.mp3", i);
+            map.emplace(name, vectors.row(i));
+        }
+
+        const int repetitions = n <= 10000 ? 3 : 1;
+        const double save_ms = time_ms([&] { utils::save_matrix_map(map, path); }, repetitions);
+        std::unordered_map<std::string, matrixf> loaded;
+        const double load_ms = time_ms([&] { loaded = utils::load_matrix_map(path); }, repetitions);
+        const double mb = std::filesystem::file_size(path) / 1048576.0;
+        report("matrix_map", {{"n", std::to_string(n)},
+                              {"file_mb", format(mb, 1)},
+                              {"save_ms", format(save_ms)},
+                              {"load_ms", format(load_ms)},
+                              {"load_mb_s", format(mb / (load_ms / 1000.0), 1)},
+                              {"loaded", std::to_string(loaded.size())}});
+    }
+    std::filesystem::remove_all(dir);
+}
+
+static registration matrix_map_registration("matrix_map", matrix_map_io);
+
+} // namespace deejai::bench
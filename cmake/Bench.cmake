@@ -0,0 +1,23 @@
+add_executable(deej-ai-bench
+  bench/main.cpp
+  bench/allocation_bench.cpp
+  bench/distance_bench.cpp
+  bench/generate_bench.cpp
+  bench/kernels_bench.cpp
+  bench/reorder_bench.cpp
+  bench/scan_bench.cpp
+  bench/similarity_bench.cpp
+  bench/storage_bench.cpp
+)
+
+# kept out of the bin directory so it is not packaged
+set_target_properties(deej-ai-bench PROPERTIES
+    RUNTIME_OUTPUT_DIRECTORY ${CMAKE_BINARY_DIR}/bench
+    BUILD_WITH_INSTALL_RPATH TRUE
+    INSTALL_RPATH ${BIN_ORIGIN}/../lib/onnxruntime/lib
+    SKIP_BUILD_RPATH FALSE
+)
+
+target_link_libraries(deej-ai-bench PRIVATE
+    deejai_static
+)
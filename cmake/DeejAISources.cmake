@@ -1,7 +1,26 @@
 set(DEEJAI_SOURCES
     ${CMAKE_SOURCE_DIR}/src/deejai/utils.cpp
+    ${CMAKE_SOURCE_DIR}/src/deejai/stats.cpp
+    ${CMAKE_SOURCE_DIR}/src/deejai/arena.cpp
+    ${CMAKE_SOURCE_DIR}/src/deejai/memory_budget.cpp
+    ${CMAKE_SOURCE_DIR}/src/deejai/kernels.cpp
+    ${CMAKE_SOURCE_DIR}/src/deejai/frontend.cpp
+    ${CMAKE_SOURCE_DIR}/src/deejai/embeddings.cpp
+    ${CMAKE_SOURCE_DIR}/src/deejai/string_table.cpp
+    ${CMAKE_SOURCE_DIR}/src/deejai/distance.cpp
+    ${CMAKE_SOURCE_DIR}/src/deejai/knn_graph.cpp
+    ${CMAKE_SOURCE_DIR}/src/deejai/library.cpp
+    ${CMAKE_SOURCE_DIR}/src/deejai/trace.cpp
     ${CMAKE_SOURCE_DIR}/src/deejai/scanner.cpp
     ${CMAKE_SOURCE_DIR}/src/deejai/generator.cpp
+    ${CMAKE_SOURCE_DIR}/src/deejai/bundle_watcher.cpp
+    ${CMAKE_SOURCE_DIR}/src/deejai/playlist_session.cpp
+    ${CMAKE_SOURCE_DIR}/src/deejai/reorder.cpp
+)
+
+# the C interface, built into the deejai libraries but not the executables
+set(DEEJAI_C_API_SOURCES
+    ${CMAKE_SOURCE_DIR}/src/deejai/deejai.cpp
 )
 
 set(DEEJAI_INCLUDES
@@ -11,21 +11,18 @@ execute_process(
 
 include(cmake/FetchONNX.cmake)
 
-add_executable(deej-ai 
-  src/main.cpp
-  ${DEEJAI_SOURCES}
-)
-
-target_include_directories(deej-ai PRIVATE
-  ${DEEJAI_INCLUDES}
-)
-
 if(APPLE)
     set(BIN_ORIGIN "@loader_path")
 else()
     set(BIN_ORIGIN "$ORIGIN")
 endif()
 
+include(cmake/Library.cmake)
+
+add_executable(deej-ai 
+  src/main.cpp
+)
+
 set_target_properties(deej-ai PROPERTIES
     RUNTIME_OUTPUT_DIRECTORY ${BIN_DIR}
     BUILD_WITH_INSTALL_RPATH TRUE
@@ -34,6 +31,5 @@ set_target_properties(deej-ai PROPERTIES
 )
 
 target_link_libraries(deej-ai PRIVATE
-    Eigen3::Eigen
-    onnxruntime
+    deejai_static
 )
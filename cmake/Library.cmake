@@ -0,0 +1,70 @@
+# The sources are compiled once and shared by the deejai libraries and the executables.
+add_library(deejai_objects OBJECT
+  ${DEEJAI_SOURCES}
+)
+
+target_include_directories(deejai_objects PUBLIC
+  ${DEEJAI_INCLUDES}
+)
+
+target_link_libraries(deejai_objects PUBLIC
+    Eigen3::Eigen
+    onnxruntime
+)
+
+# the tables of mel_frontend.hpp are computed by the compiler
+if(CMAKE_CXX_COMPILER_ID MATCHES "Clang")
+    target_compile_options(deejai_objects PRIVATE -fconstexpr-steps=10000000)
+endif()
+
+# only the C interface of deejai.h is exported from the shared library
+set_target_properties(deejai_objects PROPERTIES
+    POSITION_INDEPENDENT_CODE ON
+    CXX_VISIBILITY_PRESET hidden
+    VISIBILITY_INLINES_HIDDEN ON
+)
+
+add_library(deejai SHARED
+  ${DEEJAI_C_API_SOURCES}
+)
+
+target_compile_definitions(deejai
+    PRIVATE DEEJAI_BUILD_SHARED
+    INTERFACE DEEJAI_SHARED
+)
+
+target_link_libraries(deejai PRIVATE
+    deejai_objects
+)
+
+target_include_directories(deejai INTERFACE
+  ${CMAKE_SOURCE_DIR}/src
+)
+
+set_target_properties(deejai PROPERTIES
+    CXX_VISIBILITY_PRESET hidden
+    VISIBILITY_INLINES_HIDDEN ON
+    LIBRARY_OUTPUT_DIRECTORY ${LIB_DIR}
+    RUNTIME_OUTPUT_DIRECTORY ${BIN_DIR}
+    ARCHIVE_OUTPUT_DIRECTORY ${LIB_DIR}
+    BUILD_WITH_INSTALL_RPATH TRUE
+    INSTALL_RPATH ${BIN_ORIGIN}/onnxruntime/lib
+    SKIP_BUILD_RPATH FALSE
+)
+
+add_library(deejai_static STATIC
+  ${DEEJAI_C_API_SOURCES}
+)
+
+target_link_libraries(deejai_static PUBLIC
+    deejai_objects
+)
+
+# libdeejai.a next to libdeejai.so, the names would clash with the import library on Windows
+if(NOT WIN32)
+    set_target_properties(deejai_static PROPERTIES OUTPUT_NAME deejai)
+endif()
+
+set_target_properties(deejai_static PROPERTIES
+    ARCHIVE_OUTPUT_DIRECTORY ${LIB_DIR}
+)
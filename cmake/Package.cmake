@@ -35,6 +35,12 @@ add_custom_target(package
     DEPENDS deej-ai
 )
 
+if(TARGET deejai)
+    add_dependencies(package deejai deejai_static)
+else()
+    add_dependencies(package deejai_static)
+endif()
+
 add_custom_target(package_zip
     COMMENT "Packaging deej-ai into ZIP"
     DEPENDS deej-ai package
@@ -51,6 +57,8 @@ add_custom_command(
     COMMAND ${CMAKE_COMMAND} -E copy_directory ${BIN_DIR} "${PACKAGE_DIR}/bin"
     COMMAND ${CMAKE_COMMAND} -E copy_directory "${CMAKE_SOURCE_DIR}/LICENSES" "${PACKAGE_DIR}/share/LICENSES"
     COMMAND ${CMAKE_COMMAND} -E copy "${CMAKE_SOURCE_DIR}/LICENSE" "${PACKAGE_DIR}/share/LICENSE"
+    COMMAND ${CMAKE_COMMAND} -E make_directory "${PACKAGE_DIR}/include"
+    COMMAND ${CMAKE_COMMAND} -E copy "${CMAKE_SOURCE_DIR}/src/deejai/deejai.h" "${PACKAGE_DIR}/include/deejai.h"
 )
 
 # onnxruntime library
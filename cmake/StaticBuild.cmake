@@ -1,21 +1,38 @@
 set(CMAKE_MSVC_RUNTIME_LIBRARY "MultiThreaded$<$<CONFIG:Debug>:Debug>")
 
 set(ONNX_STATIC_DIR ${CMAKE_SOURCE_DIR}/onnxruntime-build/onnxruntime)
-add_executable(deej-ai 
-    src/main.cpp
+# the static build has no shared deejai library
+add_library(deejai_static STATIC
     ${DEEJAI_SOURCES}
+    ${DEEJAI_C_API_SOURCES}
 )
 
-target_include_directories(deej-ai PRIVATE
+target_include_directories(deejai_static PUBLIC
     ${DEEJAI_INCLUDES}
     ${CMAKE_SOURCE_DIR}/onnxruntime-build/output/static_lib/Release/include
 )
 
-target_link_libraries(deej-ai PRIVATE
+target_link_libraries(deejai_static PUBLIC
     Eigen3::Eigen
     ${CMAKE_SOURCE_DIR}/onnxruntime-build/output/static_lib/Release/lib/onnxruntime.lib
 )
 
+# the tables of mel_frontend.hpp are computed by the compiler
+target_compile_options(deejai_static PRIVATE /constexpr:steps10000000)
+
+set_target_properties(deejai_static PROPERTIES
+    OUTPUT_NAME deejai
+    ARCHIVE_OUTPUT_DIRECTORY ${LIB_DIR}
+)
+
+add_executable(deej-ai 
+    src/main.cpp
+)
+
+target_link_libraries(deej-ai PRIVATE
+    deejai_static
+)
+
 set_target_properties(deej-ai PROPERTIES
     RUNTIME_OUTPUT_DIRECTORY_DEBUG   ${BIN_DIR}
     RUNTIME_OUTPUT_DIRECTORY_RELEASE ${BIN_DIR}
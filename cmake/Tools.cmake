@@ -0,0 +1,30 @@
+add_executable(deej-ai-synth
+  tools/synth_library.cpp
+)
+
+# kept out of the bin directory so it is not packaged
+set_target_properties(deej-ai-synth PROPERTIES
+    RUNTIME_OUTPUT_DIRECTORY ${CMAKE_BINARY_DIR}/tools
+    BUILD_WITH_INSTALL_RPATH TRUE
+    INSTALL_RPATH ${BIN_ORIGIN}/../lib/onnxruntime/lib
+    SKIP_BUILD_RPATH FALSE
+)
+
+target_link_libraries(deej-ai-synth PRIVATE
+    deejai_static
+)
+
+add_executable(deej-ai-check
+  tools/check_embeddings.cpp
+)
+
+set_target_properties(deej-ai-check PROPERTIES
+    RUNTIME_OUTPUT_DIRECTORY ${CMAKE_BINARY_DIR}/tools
+    BUILD_WITH_INSTALL_RPATH TRUE
+    INSTALL_RPATH ${BIN_ORIGIN}/../lib/onnxruntime/lib
+    SKIP_BUILD_RPATH FALSE
+)
+
+target_link_libraries(deej-ai-check PRIVATE
+    deejai_static
+)
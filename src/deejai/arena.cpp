@@ -0,0 +1,99 @@
+#include "deejai/arena.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <new>
+
+namespace deejai {
+
+static size_t aligned_size(size_t bytes) {
+    return (bytes + arena::ALIGNMENT - 1) & ~(arena::ALIGNMENT - 1);
+}
+
+arena::arena(size_t block_size) : m_block_size(aligned_size(std::max<size_t>(block_size, ALIGNMENT))) {}
+
+arena::~arena() {
+    free_blocks();
+}
+
+void *arena::allocate(size_t bytes) {
+    bytes = aligned_size(bytes);
+    if (m_blocks.empty() || m_offset + bytes > m_blocks.back().size) {
+        add_block(bytes);
+    }
+    void *ptr = m_blocks.back().data + m_offset;
+    m_offset += bytes;
+    m_used += bytes;
+    m_last = ptr;
+    return ptr;
+}
+
+void *arena::grow(void *ptr, size_t bytes, size_t new_bytes) {
+    if (ptr != nullptr && ptr == m_last) {
+        const block &last = m_blocks.back();
+        const size_t begin = static_cast<std::byte *>(ptr) - last.data;
+        const size_t end = begin + aligned_size(new_bytes);
+        if (end <= last.size) {
+            m_used = m_used - (m_offset - begin) + (end - begin);
+            m_offset = end;
+            return ptr;
+        }
+    }
+    void *moved = allocate(new_bytes);
+    if (ptr != nullptr) {
+        std::memcpy(moved, ptr, std::min(bytes, new_bytes));
+    }
+    return moved;
+}
+
+void arena::reset() {
+    if (m_blocks.size() > 1) {
+        const size_t total = capacity();
+        free_blocks();
+        add_block(total);
+    }
+    m_offset = 0;
+    m_used = 0;
+    m_last = nullptr;
+}
+
+void arena::release() {
+    free_blocks();
+    m_offset = 0;
+    m_used = 0;
+    m_last = nullptr;
+}
+
+size_t arena::used() const {
+    return m_used;
+}
+
+size_t arena::capacity() const {
+    size_t total = 0;
+    for (const block &b : m_blocks) {
+        total += b.size;
+    }
+    return total;
+}
+
+size_t arena::heap_allocations() const {
+    return m_heap_allocations;
+}
+
+// at least as large as all the blocks before, so a growing file needs few of them
+void arena::add_block(size_t min_size) {
+    const size_t size = std::max({m_block_size, min_size, capacity()});
+    std::byte *data = static_cast<std::byte *>(::operator new(size, std::align_val_t(ALIGNMENT)));
+    m_blocks.push_back({data, size});
+    m_offset = 0;
+    m_heap_allocations++;
+}
+
+void arena::free_blocks() {
+    for (const block &b : m_blocks) {
+        ::operator delete(b.data, std::align_val_t(ALIGNMENT));
+    }
+    m_blocks.clear();
+}
+
+} // namespace deejai
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+namespace deejai {
+
+// Monotonic memory for the transient buffers of one scan worker. Allocations are only
+// freed all together by reset(), which keeps the memory for the next file, so once a
+// worker has scanned its longest file the buffers of a scan no longer touch the heap.
+// Not thread safe, every worker has its own.
+class arena {
+  public:
+    // alignment of every allocation, a cache line and the widest vector register
+    static constexpr size_t ALIGNMENT = 64;
+
+    explicit arena(size_t block_size = 1 << 20);
+    ~arena();
+    arena(const arena &) = delete;
+    arena &operator=(const arena &) = delete;
+
+    void *allocate(size_t bytes);
+    // Grows the last allocation from bytes to new_bytes, in place when its block has room,
+    // otherwise into a new allocation the contents are copied to.
+    void *grow(void *ptr, size_t bytes, size_t new_bytes);
+    // Frees every allocation. Several blocks are merged into one of their total size, so a
+    // file as large as the previous ones fits in a single block.
+    void reset();
+    // Frees every allocation and returns the memory to the heap.
+    void release();
+
+    template <typename T> T *allocate(size_t count) {
+        return static_cast<T *>(allocate(count * sizeof(T)));
+    }
+
+    template <typename T> T *grow(T *ptr, size_t count, size_t new_count) {
+        return static_cast<T *>(grow(static_cast<void *>(ptr), count * sizeof(T), new_count * sizeof(T)));
+    }
+
+    // bytes allocated since the last reset
+    size_t used() const;
+    size_t capacity() const;
+    // blocks taken from the heap since the arena was created
+    size_t heap_allocations() const;
+
+  private:
+    struct block {
+        std::byte *data;
+        size_t size;
+    };
+
+    void add_block(size_t min_size);
+    void free_blocks();
+
+    size_t m_block_size;
+    std::vector<block> m_blocks;
+    // start of the free space of the last block
+    size_t m_offset = 0;
+    size_t m_used = 0;
+    void *m_last = nullptr;
+    size_t m_heap_allocations = 0;
+};
+
+} // namespace deejai
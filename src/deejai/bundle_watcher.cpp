@@ -0,0 +1,62 @@
+#include "deejai/bundle_watcher.hpp"
+#include "deejai/common.hpp"
+#include "deejai/knn_graph.hpp"
+#include "deejai/utils.hpp"
+
+#include <iostream>
+
+namespace deejai {
+
+bundle_watcher::bundle_watcher(generator &gen, std::chrono::milliseconds interval)
+    : m_generator(gen), m_interval(interval),
+      m_bundle_path(std::filesystem::path(gen.vecs_dir()) / BUNDLED_VECS_DIRNAME / BUNDLED_VECS_FILENAME),
+      m_graph_path(std::filesystem::path(gen.vecs_dir()) / BUNDLED_VECS_DIRNAME / KNN_GRAPH_FILENAME) {
+    m_thread = std::thread(&bundle_watcher::run, this);
+}
+
+bundle_watcher::~bundle_watcher() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_stop_requested.notify_all();
+    m_thread.join();
+}
+
+size_t bundle_watcher::reloads() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_reloads;
+}
+
+bundle_watcher::bundle_stamp bundle_watcher::stamp() const {
+    return {utils::stored_checksum(m_bundle_path), knn_graph::stored_bundle_checksum(m_graph_path)};
+}
+
+void bundle_watcher::run() {
+    bundle_stamp loaded = stamp();
+    bundle_stamp previous = loaded;
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (!m_stop_requested.wait_for(lock, m_interval, [this] { return m_stop; })) {
+        lock.unlock();
+        const bundle_stamp current = stamp();
+        // Reload once the files are the same on two polls in a row and differ from the loaded
+        // ones. The graph is never waited for: while the scan builds it, or when it failed to,
+        // the library is served without the graph of the previous bundle, and loaded again
+        // once a graph of this bundle is saved.
+        if (current == previous && current != loaded && current.bundle.has_value()) {
+            if (auto report = m_generator.reload()) {
+                std::cout << "Reloaded " << report->tracks << " songs from " << m_generator.vecs_dir() << " in "
+                          << report->milliseconds << " ms, " << (report->bytes + report->previous_bytes) / (1024 * 1024)
+                          << " MiB held while queries finish on the previous library." << std::endl;
+                loaded = current;
+                lock.lock();
+                m_reloads++;
+                lock.unlock();
+            }
+        }
+        previous = current;
+        lock.lock();
+    }
+}
+
+} // namespace deejai
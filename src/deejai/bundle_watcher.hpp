@@ -0,0 +1,55 @@
+#pragma once
+
+#include "deejai/generator.hpp"
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <filesystem>
+#include <mutex>
+#include <optional>
+#include <thread>
+
+namespace deejai {
+
+// Reloads a generator when a scan changes its bundle or graph. The checksums the files
+// store are polled on a background thread, which works the same on every platform and on
+// network drives, so a bundle rewritten with the same content is not loaded again. A
+// change is only picked up once the files stopped changing for a whole interval.
+class bundle_watcher {
+  public:
+    // The generator must outlive the watcher.
+    explicit bundle_watcher(generator &gen, std::chrono::milliseconds interval = std::chrono::seconds(2));
+    ~bundle_watcher();
+    bundle_watcher(const bundle_watcher &) = delete;
+    bundle_watcher &operator=(const bundle_watcher &) = delete;
+
+    // number of reloads done so far
+    size_t reloads() const;
+
+  private:
+    // the stored checksums of the bundle and of the bundle the graph was built from,
+    // nullopt for a missing file
+    struct bundle_stamp {
+        std::optional<uint64_t> bundle;
+        std::optional<uint64_t> graph;
+
+        bool operator==(const bundle_stamp &) const = default;
+    };
+
+    bundle_stamp stamp() const;
+    void run();
+
+    generator &m_generator;
+    std::chrono::milliseconds m_interval;
+    std::filesystem::path m_bundle_path;
+    std::filesystem::path m_graph_path;
+
+    mutable std::mutex m_mutex;
+    std::condition_variable m_stop_requested;
+    bool m_stop = false;
+    size_t m_reloads = 0;
+    std::thread m_thread;
+};
+
+} // namespace deejai
@@ -10,5 +10,7 @@ typedef Eigen::Matrix<float, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor> ma
 
 constexpr std::string_view BUNDLED_VECS_DIRNAME = "bundled";
 constexpr std::string_view BUNDLED_VECS_FILENAME = "audio_vecs.bin";
+constexpr std::string_view KNN_GRAPH_FILENAME = "knn.graph";
+constexpr std::string_view SCAN_JOURNAL_FILENAME = "scan.journal";
 
 } // namespace deejai
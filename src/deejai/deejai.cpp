@@ -0,0 +1,214 @@
+#include "deejai/deejai.h"
+#include "deejai/generator.hpp"
+#include "deejai/scanner.hpp"
+
+#include <exception>
+#include <memory>
+#include <optional>
+#include <string>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+struct deejai_index {
+    explicit deejai_index(const std::string &vecs_dir) : gen(vecs_dir) {}
+
+    deejai::generator gen;
+};
+
+struct deejai_result {
+    std::vector<std::string> tracks;
+    std::vector<float> scores;
+};
+
+static thread_local std::string last_error;
+
+static void set_error(std::string message) {
+    last_error = std::move(message);
+}
+
+static std::vector<std::string> strings(const char *const *values, size_t count) {
+    std::vector<std::string> result;
+    result.reserve(count);
+    for (size_t i = 0; i < count; i++) {
+        if (values[i] != nullptr) {
+            result.emplace_back(values[i]);
+        }
+    }
+    return result;
+}
+
+// Runs a query of the C interface, no exception may cross it.
+template <typename F> static deejai_result *query(const deejai_index *index, F &&run) {
+    if (index == nullptr) {
+        set_error("The index is NULL");
+        return nullptr;
+    }
+    try {
+        last_error.clear();
+        return new deejai_result(run(index->gen));
+    } catch (const std::exception &e) {
+        set_error(e.what());
+    } catch (...) {
+        set_error("Unknown error");
+    }
+    return nullptr;
+}
+
+extern "C" {
+
+int deejai_api_version(void) {
+    return DEEJAI_API_VERSION;
+}
+
+const char *deejai_last_error(void) {
+    return last_error.c_str();
+}
+
+deejai_index *deejai_open(const char *vecs_dir) {
+    if (vecs_dir == nullptr) {
+        set_error("The vector directory is NULL");
+        return nullptr;
+    }
+    try {
+        auto index = std::make_unique<deejai_index>(vecs_dir);
+        if (index->gen.snapshot()->tracks().empty()) {
+            set_error(std::string("No tracks could be loaded from ") + vecs_dir);
+            return nullptr;
+        }
+        last_error.clear();
+        return index.release();
+    } catch (const std::exception &e) {
+        set_error(e.what());
+    } catch (...) {
+        set_error("Unknown error");
+    }
+    return nullptr;
+}
+
+void deejai_close(deejai_index *index) {
+    delete index;
+}
+
+int deejai_reload(deejai_index *index) {
+    if (index == nullptr) {
+        set_error("The index is NULL");
+        return -1;
+    }
+    try {
+        if (!index->gen.reload().has_value()) {
+            set_error("No tracks could be loaded from " + index->gen.vecs_dir());
+            return -1;
+        }
+        last_error.clear();
+        return 0;
+    } catch (const std::exception &e) {
+        set_error(e.what());
+    } catch (...) {
+        set_error("Unknown error");
+    }
+    return -1;
+}
+
+size_t deejai_track_count(const deejai_index *index) {
+    return index == nullptr ? 0 : index->gen.snapshot()->tracks().size();
+}
+
+void deejai_set_use_graph(deejai_index *index, int use_graph) {
+    if (index != nullptr) {
+        index->gen.set_use_graph(use_graph != 0);
+    }
+}
+
+deejai_result *deejai_most_similar(const deejai_index *index, const char *const *tracks, size_t count, int topn) {
+    return query(index, [&](const deejai::generator &gen) {
+        const std::vector<std::string> names = strings(tracks, count);
+        const std::shared_ptr<const deejai::library> lib = gen.snapshot();
+        deejai::vectorf vec_sum = deejai::vectorf::Zero(lib->vectors().dim());
+        for (const auto &name : names) {
+            if (auto id = lib->tracks().find(name)) {
+                vec_sum += lib->vectors().row(*id);
+            }
+        }
+
+        deejai_result result;
+        const std::unordered_set<std::string> excluded(names.begin(), names.end());
+        for (auto &[track, score] : gen.most_similar(excluded, vec_sum, topn)) {
+            result.tracks.push_back(std::move(track));
+            result.scores.push_back(score);
+        }
+        return result;
+    });
+}
+
+deejai_result *deejai_generate(const deejai_index *index, const char *method, const char *const *seeds, size_t count,
+                               int nsongs, int lookback, float noise, int64_t seed) {
+    const std::string name = method == nullptr ? "append" : method;
+    if (name != "append" && name != "connect" && name != "cluster" && name != "beam") {
+        set_error("The method must be one of: append, connect, cluster, beam");
+        return nullptr;
+    }
+    return query(index, [&](const deejai::generator &gen) {
+        const std::optional<uint64_t> rng_seed =
+            seed < 0 ? std::nullopt : std::optional<uint64_t>(static_cast<uint64_t>(seed));
+        deejai_result result;
+        result.tracks = gen.generate_playlist(name, strings(seeds, count), nsongs, lookback, noise, 8, rng_seed);
+        result.scores.assign(result.tracks.size(), 0.0f);
+        return result;
+    });
+}
+
+deejai_result *deejai_reorder(const deejai_index *index, const char *const *tracks, size_t count,
+                              const char *first_song) {
+    return query(index, [&](const deejai::generator &gen) {
+        deejai_result result;
+        result.tracks = gen.reorder(strings(tracks, count), first_song == nullptr ? "" : first_song);
+        result.scores.assign(result.tracks.size(), 0.0f);
+        return result;
+    });
+}
+
+size_t deejai_result_size(const deejai_result *result) {
+    return result == nullptr ? 0 : result->tracks.size();
+}
+
+const char *deejai_result_track(const deejai_result *result, size_t i) {
+    return result == nullptr || i >= result->tracks.size() ? nullptr : result->tracks[i].c_str();
+}
+
+float deejai_result_score(const deejai_result *result, size_t i) {
+    return result == nullptr || i >= result->scores.size() ? 0.0f : result->scores[i];
+}
+
+void deejai_result_free(deejai_result *result) {
+    delete result;
+}
+
+int deejai_scan(const char *model_path, const char *vecs_dir, const char *const *paths, size_t count, int jobs,
+                deejai_progress_fn progress, void *user_data) {
+    if (model_path == nullptr || vecs_dir == nullptr) {
+        set_error("The model path and the vector directory are required");
+        return -1;
+    }
+    try {
+        deejai::scanner scan(model_path, vecs_dir);
+        if (progress != nullptr) {
+            scan.set_progress_callback([progress, user_data](int scanned, int total) {
+                progress(scanned, total, user_data);
+            });
+        }
+        if (!scan.scan(strings(paths, count), jobs > 0 ? jobs : -1)) {
+            set_error("The scan failed, see the standard error output");
+            return -1;
+        }
+        last_error.clear();
+        return 0;
+    } catch (const std::exception &e) {
+        set_error(e.what());
+    } catch (...) {
+        set_error("Unknown error");
+    }
+    return -1;
+}
+
+} // extern "C"
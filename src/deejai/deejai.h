@@ -0,0 +1,81 @@
+#ifndef DEEJAI_H
+#define DEEJAI_H
+
+// C interface of the deejai library. An index keeps a vector directory loaded, so a server
+// can answer many queries without loading the bundle for each one. Every function that
+// returns a handle or a status also records an error message for the calling thread on
+// failure, see deejai_last_error().
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(_WIN32)
+#if defined(DEEJAI_BUILD_SHARED)
+#define DEEJAI_API __declspec(dllexport)
+#elif defined(DEEJAI_SHARED)
+#define DEEJAI_API __declspec(dllimport)
+#else
+#define DEEJAI_API
+#endif
+#else
+#define DEEJAI_API __attribute__((visibility("default")))
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// incremented when a function changes in a way that breaks existing callers
+#define DEEJAI_API_VERSION 1
+
+typedef struct deejai_index deejai_index;
+typedef struct deejai_result deejai_result;
+
+// Called from the scan threads after every file, one call at a time.
+typedef void (*deejai_progress_fn)(int scanned, int total, void *user_data);
+
+DEEJAI_API int deejai_api_version(void);
+// The message of the last failed call of this thread, empty when there was none. Valid
+// until the next call of this thread.
+DEEJAI_API const char *deejai_last_error(void);
+
+// Loads the vector directory written by a scan, NULL when it holds no tracks. An index
+// can be queried by many threads at once.
+DEEJAI_API deejai_index *deejai_open(const char *vecs_dir);
+DEEJAI_API void deejai_close(deejai_index *index);
+// Loads the vector directory again after a rescan. The queries running meanwhile finish
+// on the previous library. Returns 0, or -1 when the index keeps its current library.
+DEEJAI_API int deejai_reload(deejai_index *index);
+DEEJAI_API size_t deejai_track_count(const deejai_index *index);
+// Whether 'append' and 'connect' search the neighbour graph, when there is one.
+DEEJAI_API void deejai_set_use_graph(deejai_index *index, int use_graph);
+
+// The topn tracks closest to the sum of the vectors of the given tracks, which are left
+// out of the results. Unknown tracks are ignored.
+DEEJAI_API deejai_result *deejai_most_similar(const deejai_index *index, const char *const *tracks, size_t count,
+                                              int topn);
+// A playlist of nsongs tracks from the seed tracks. method is 'append', 'connect', 'cluster'
+// or 'beam', NULL is 'append'. A negative seed draws a random one.
+DEEJAI_API deejai_result *deejai_generate(const deejai_index *index, const char *method, const char *const *seeds,
+                                          size_t count, int nsongs, int lookback, float noise, int64_t seed);
+// The tracks in the order of the shortest path through them, starting from first_song
+// unless it is NULL or empty.
+DEEJAI_API deejai_result *deejai_reorder(const deejai_index *index, const char *const *tracks, size_t count,
+                                         const char *first_song);
+
+// The tracks of a result, with their similarity for deejai_most_similar and 0 otherwise.
+DEEJAI_API size_t deejai_result_size(const deejai_result *result);
+DEEJAI_API const char *deejai_result_track(const deejai_result *result, size_t i);
+DEEJAI_API float deejai_result_score(const deejai_result *result, size_t i);
+DEEJAI_API void deejai_result_free(deejai_result *result);
+
+// Scans the audio files under the paths into vecs_dir with the model, like the scan of
+// the command line. jobs <= 0 uses every core, progress may be NULL. Returns 0 or -1.
+DEEJAI_API int deejai_scan(const char *model_path, const char *vecs_dir, const char *const *paths, size_t count,
+                           int jobs, deejai_progress_fn progress, void *user_data);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // DEEJAI_H
@@ -0,0 +1,88 @@
+#include "deejai/distance.hpp"
+#include "deejai/kernels.hpp"
+
+#include <algorithm>
+
+namespace deejai {
+
+distance_matrix::distance_matrix(const matrixf &vectors) {
+    build(vectors);
+}
+
+distance_matrix::distance_matrix(const embeddings &vectors, std::span<const track_id> ids) {
+    matrixf rows(ids.size(), vectors.dim());
+    for (size_t i = 0; i < ids.size(); i++) {
+        rows.row(i) = vectors.row(ids[i]);
+    }
+    build(std::move(rows));
+}
+
+void distance_matrix::build(matrixf normalized) {
+    // rows of each product, a pair of blocks stays in the L2 cache
+    const int block_rows = 256;
+
+    // zero vectors stay zero and end up at distance 1 from everything
+    for (Eigen::Index i = 0; i < normalized.rows(); i++) {
+        const float norm = normalized.row(i).norm();
+        if (norm > 0.f) {
+            normalized.row(i) /= norm;
+        }
+    }
+
+    m_size = normalized.rows();
+    m_triangular = m_size >= TRIANGULAR_MIN_SIZE;
+    m_max = 0.f;
+    const size_t n = m_size;
+    m_data.assign(m_triangular ? n * (n - 1) / 2 : n * n, 0.f);
+    m_row_offsets.clear();
+
+    if (m_triangular) {
+        m_row_offsets.resize(n);
+        for (size_t i = 0; i < n; i++) {
+            // row i holds the columns i + 1 .. n - 1
+            m_row_offsets[i] = i * (2 * n - i - 1) / 2 - (i + 1);
+        }
+    }
+
+    // locals, so the stores into the matrix cannot alias them
+    float *data = m_data.data();
+    float max_distance = 0.f;
+    const size_t dim = normalized.cols();
+    matrixf transposed;
+    std::vector<float> products(block_rows * block_rows);
+    for (int jb = 0; jb < m_size; jb += block_rows) {
+        const int je = std::min(jb + block_rows, m_size);
+        const size_t cols = je - jb;
+        transposed = normalized.middleRows(jb, cols).transpose();
+        for (int ib = 0; ib <= jb; ib += block_rows) {
+            const int ie = std::min(ib + block_rows, m_size);
+            kernels::dot_tile_f32(normalized.row(ib).data(), dim, ie - ib, transposed.data(), cols, cols, dim,
+                                  products.data(), cols);
+
+            for (int i = ib; i < ie; i++) {
+                // only the pairs above the diagonal, the rest is mirrored or implied
+                const int j_begin = std::max(jb, i + 1);
+                const float *similarity = products.data() + (i - ib) * cols + (j_begin - jb);
+                const int count = je - j_begin;
+                if (m_triangular) {
+                    float *row = data + (m_row_offsets[i] + j_begin);
+                    for (int k = 0; k < count; k++) {
+                        row[k] = 1.f - similarity[k];
+                        max_distance = std::max(max_distance, row[k]);
+                    }
+                } else {
+                    float *row = data + static_cast<size_t>(i) * n + j_begin;
+                    float *column = data + static_cast<size_t>(j_begin) * n + i;
+                    for (int k = 0; k < count; k++) {
+                        row[k] = 1.f - similarity[k];
+                        column[k * n] = row[k];
+                        max_distance = std::max(max_distance, row[k]);
+                    }
+                }
+            }
+        }
+    }
+    m_max = max_distance;
+}
+
+} // namespace deejai
@@ -0,0 +1,67 @@
+#pragma once
+
+#include "deejai/common.hpp"
+#include "deejai/embeddings.hpp"
+#include "deejai/string_table.hpp"
+
+#include <span>
+#include <utility>
+#include <vector>
+
+namespace deejai {
+
+// Symmetric matrix of the cosine distances between a set of tracks. The vectors are
+// normalized once and multiplied in tiles with the SIMD kernels of the running CPU.
+// Large sets keep only the upper triangle, which halves the memory.
+class distance_matrix {
+  public:
+    distance_matrix() = default;
+    // distances between the rows of the matrix
+    explicit distance_matrix(const matrixf &vectors);
+    // distances between the given tracks, indexed by their position in ids
+    distance_matrix(const embeddings &vectors, std::span<const track_id> ids);
+
+    int size() const {
+        return m_size;
+    }
+
+    bool triangular() const {
+        return m_triangular;
+    }
+
+    float max() const {
+        return m_max;
+    }
+
+    size_t memory_bytes() const {
+        return m_data.size() * sizeof(float) + m_row_offsets.size() * sizeof(size_t);
+    }
+
+    float operator()(int a, int b) const {
+        if (!m_triangular) {
+            return m_data[static_cast<size_t>(a) * m_size + b];
+        }
+        if (a == b) {
+            return 0.f;
+        }
+        if (a > b) {
+            std::swap(a, b);
+        }
+        return m_data[m_row_offsets[a] + b];
+    }
+
+    // the smallest set stored as a triangle
+    static constexpr int TRIANGULAR_MIN_SIZE = 2048;
+
+  private:
+    void build(matrixf normalized);
+
+    std::vector<float> m_data;
+    // start of every row of the triangle, minus the columns it skips
+    std::vector<size_t> m_row_offsets;
+    int m_size = 0;
+    bool m_triangular = false;
+    float m_max = 0.f;
+};
+
+} // namespace deejai
@@ -0,0 +1,455 @@
+#include "deejai/embeddings.hpp"
+#include "deejai/kernels.hpp"
+#include "deejai/utils.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <numeric>
+#include <string>
+#include <vector>
+
+namespace deejai {
+
+static constexpr char BUNDLE_MAGIC[8] = {'D', 'J', 'A', 'I', 'E', 'M', 'B', '1'};
+
+std::optional<storage_format> storage_format_from_string(const std::string &name) {
+    if (name == "f32") {
+        return storage_format::f32;
+    }
+    if (name == "f16") {
+        return storage_format::f16;
+    }
+    if (name == "int8") {
+        return storage_format::i8;
+    }
+    return std::nullopt;
+}
+
+std::string storage_format_name(storage_format format) {
+    switch (format) {
+    case storage_format::f16:
+        return "f16";
+    case storage_format::i8:
+        return "int8";
+    default:
+        return "f32";
+    }
+}
+
+embeddings::embeddings(const matrixf &vectors, storage_format format) :
+    m_format(format), m_rows(vectors.rows()), m_dim(vectors.cols()) {
+    const size_t count = m_rows * m_dim;
+    switch (m_format) {
+    case storage_format::f32:
+        m_f32.assign(vectors.data(), vectors.data() + count);
+        break;
+    case storage_format::f16:
+        m_f16.resize(count);
+        for (size_t i = 0; i < count; i++) {
+            m_f16[i] = kernels::float_to_half(vectors.data()[i]);
+        }
+        break;
+    case storage_format::i8:
+        m_i8.resize(count);
+        m_scales.resize(m_rows);
+        for (size_t r = 0; r < m_rows; r++) {
+            const float max_abs = vectors.row(r).cwiseAbs().maxCoeff();
+            const float scale = max_abs > 0.f ? max_abs / 127.f : 1.f;
+            m_scales[r] = scale;
+            for (int c = 0; c < m_dim; c++) {
+                const float q = std::round(vectors(r, c) / scale);
+                m_i8[r * m_dim + c] = static_cast<int8_t>(std::clamp(q, -127.f, 127.f));
+            }
+        }
+        break;
+    }
+    compute_norms();
+}
+
+void embeddings::compute_norms() {
+    m_norms.resize(m_rows);
+    for (size_t r = 0; r < m_rows; r++) {
+        m_norms[r] = row(r).norm();
+    }
+}
+
+storage_format embeddings::format() const {
+    return m_format;
+}
+
+size_t embeddings::size() const {
+    return m_rows;
+}
+
+int embeddings::dim() const {
+    return m_dim;
+}
+
+size_t embeddings::memory_bytes() const {
+    return m_f32.size() * sizeof(float) + m_f16.size() * sizeof(uint16_t) + m_i8.size() +
+           (m_scales.size() + m_norms.size()) * sizeof(float);
+}
+
+vectorf embeddings::row(size_t index) const {
+    vectorf vec(m_dim);
+    const size_t offset = index * m_dim;
+    switch (m_format) {
+    case storage_format::f32:
+        std::copy(m_f32.begin() + offset, m_f32.begin() + offset + m_dim, vec.data());
+        break;
+    case storage_format::f16:
+        for (int c = 0; c < m_dim; c++) {
+            vec[c] = kernels::half_to_float(m_f16[offset + c]);
+        }
+        break;
+    case storage_format::i8:
+        for (int c = 0; c < m_dim; c++) {
+            vec[c] = m_i8[offset + c] * m_scales[index];
+        }
+        break;
+    }
+    return vec;
+}
+
+float embeddings::norm(size_t index) const {
+    return m_norms[index];
+}
+
+static float quantize_query(const vectorf &query, std::vector<int8_t> &out) {
+    const float max_abs = query.cwiseAbs().maxCoeff();
+    const float scale = max_abs > 0.f ? max_abs / 127.f : 1.f;
+    out.resize(query.size());
+    for (int i = 0; i < query.size(); i++) {
+        out[i] = static_cast<int8_t>(std::clamp(std::round(query[i] / scale), -127.f, 127.f));
+    }
+    return scale;
+}
+
+void embeddings::dot_all(const vectorf &query, float *out) const {
+    dot_range(query, 0, m_rows, out);
+}
+
+void embeddings::dot_range(const vectorf &query, size_t begin, size_t end, float *out) const {
+    switch (m_format) {
+    case storage_format::f32:
+        for (size_t r = begin; r < end; r++) {
+            out[r - begin] = kernels::dot_f32(query.data(), m_f32.data() + r * m_dim, m_dim);
+        }
+        break;
+    case storage_format::f16:
+        for (size_t r = begin; r < end; r++) {
+            out[r - begin] = kernels::dot_f16(query.data(), m_f16.data() + r * m_dim, m_dim);
+        }
+        break;
+    case storage_format::i8: {
+        std::vector<int8_t> query_i8;
+        const float query_scale = quantize_query(query, query_i8);
+        for (size_t r = begin; r < end; r++) {
+            const int32_t dot = kernels::dot_i8(query_i8.data(), m_i8.data() + r * m_dim, m_dim);
+            out[r - begin] = static_cast<float>(dot) * query_scale * m_scales[r];
+        }
+        break;
+    }
+    }
+}
+
+float embeddings::dot(size_t index, const vectorf &query) const {
+    const size_t offset = index * m_dim;
+    switch (m_format) {
+    case storage_format::f16:
+        return kernels::dot_f16(query.data(), m_f16.data() + offset, m_dim);
+    case storage_format::i8: {
+        std::vector<int8_t> query_i8;
+        const float query_scale = quantize_query(query, query_i8);
+        return kernels::dot_i8(query_i8.data(), m_i8.data() + offset, m_dim) * query_scale * m_scales[index];
+    }
+    default:
+        return kernels::dot_f32(query.data(), m_f32.data() + offset, m_dim);
+    }
+}
+
+float embeddings::dot(size_t a, size_t b) const {
+    switch (m_format) {
+    case storage_format::f16:
+        return kernels::dot_f16(row(a).data(), m_f16.data() + b * m_dim, m_dim);
+    case storage_format::i8:
+        return kernels::dot_i8(m_i8.data() + a * m_dim, m_i8.data() + b * m_dim, m_dim) * m_scales[a] * m_scales[b];
+    default:
+        return kernels::dot_f32(m_f32.data() + a * m_dim, m_f32.data() + b * m_dim, m_dim);
+    }
+}
+
+embeddings::prepared_query embeddings::prepare(const vectorf &query) const {
+    prepared_query prepared;
+    if (m_format == storage_format::i8) {
+        prepared.m_scale = quantize_query(query, prepared.m_i8);
+    } else {
+        prepared.m_f32.assign(query.data(), query.data() + query.size());
+    }
+    return prepared;
+}
+
+embeddings::prepared_query embeddings::prepare(size_t index) const {
+    prepared_query prepared;
+    if (m_format == storage_format::i8) {
+        prepared.m_i8.assign(m_i8.begin() + index * m_dim, m_i8.begin() + (index + 1) * m_dim);
+        prepared.m_scale = m_scales[index];
+    } else {
+        prepared.m_f32.resize(m_dim);
+        decode_row(index, prepared.m_f32.data(), 1);
+    }
+    return prepared;
+}
+
+float embeddings::dot(size_t index, const prepared_query &query) const {
+    const size_t offset = index * m_dim;
+    switch (m_format) {
+    case storage_format::f16:
+        return kernels::dot_f16(query.m_f32.data(), m_f16.data() + offset, m_dim);
+    case storage_format::i8:
+        return kernels::dot_i8(query.m_i8.data(), m_i8.data() + offset, m_dim) * query.m_scale * m_scales[index];
+    default:
+        return kernels::dot_f32(query.m_f32.data(), m_f32.data() + offset, m_dim);
+    }
+}
+
+void embeddings::dot_block(const matrixf &queries, size_t begin, size_t end, matrixf &out) const {
+    const size_t rows = end - begin;
+    if (queries.rows() == 1) {
+        // a single query is scored straight from the stored rows
+        out.resize(1, rows);
+        dot_range(queries.row(0), begin, end, out.data());
+        return;
+    }
+
+    out.resize(queries.rows(), rows);
+    if (queries.rows() < TILE_MIN_QUERIES) {
+        if (m_format == storage_format::f32) {
+            kernels::dot_rows_f32(queries.data(), queries.rows(), m_f32.data() + begin * m_dim, rows, m_dim,
+                                  out.data(), rows);
+            return;
+        }
+
+        // decode the block once and share it between all the queries
+        thread_local std::vector<float> block;
+        block.resize(rows * m_dim);
+        for (size_t r = 0; r < rows; r++) {
+            decode_row(begin + r, block.data() + r * m_dim, 1);
+        }
+        kernels::dot_rows_f32(queries.data(), queries.rows(), block.data(), rows, m_dim, out.data(), rows);
+        return;
+    }
+
+    // many queries pay for transposing the block, which the tile kernel needs to multiply
+    // a query by several rows at once
+    thread_local std::vector<float> transposed;
+    transposed.resize(rows * m_dim);
+    for (size_t r = 0; r < rows; r++) {
+        decode_row(begin + r, transposed.data() + r, rows);
+    }
+    kernels::dot_tile_f32(queries.data(), m_dim, queries.rows(), transposed.data(), rows, rows, m_dim, out.data(),
+                          rows);
+}
+
+// Writes the row as floats to out, out[c * stride] holding column c.
+void embeddings::decode_row(size_t index, float *out, size_t stride) const {
+    const size_t offset = index * m_dim;
+    if (m_format == storage_format::f32) {
+        for (int c = 0; c < m_dim; c++) {
+            out[c * stride] = m_f32[offset + c];
+        }
+    } else if (m_format == storage_format::f16) {
+        for (int c = 0; c < m_dim; c++) {
+            out[c * stride] = kernels::half_to_float(m_f16[offset + c]);
+        }
+    } else {
+        const float scale = m_scales[index];
+        for (int c = 0; c < m_dim; c++) {
+            out[c * stride] = m_i8[offset + c] * scale;
+        }
+    }
+}
+
+void embeddings::write(std::string &out) const {
+    const uint8_t format = static_cast<uint8_t>(m_format);
+    const uint64_t rows = m_rows;
+    const int32_t dim = m_dim;
+    out.append(reinterpret_cast<const char *>(&format), sizeof(format));
+    out.append(reinterpret_cast<const char *>(&rows), sizeof(rows));
+    out.append(reinterpret_cast<const char *>(&dim), sizeof(dim));
+    out.append(reinterpret_cast<const char *>(m_f32.data()), m_f32.size() * sizeof(float));
+    out.append(reinterpret_cast<const char *>(m_f16.data()), m_f16.size() * sizeof(uint16_t));
+    out.append(reinterpret_cast<const char *>(m_i8.data()), m_i8.size());
+    out.append(reinterpret_cast<const char *>(m_scales.data()), m_scales.size() * sizeof(float));
+}
+
+std::optional<embeddings> embeddings::read(utils::byte_reader &reader) {
+    uint8_t format = 0;
+    uint64_t rows = 0;
+    int32_t dim = 0;
+    if (!reader.read(&format, sizeof(format)) || !reader.read(&rows, sizeof(rows)) || !reader.read(&dim, sizeof(dim)) ||
+        format > static_cast<uint8_t>(storage_format::i8) || dim < 0) {
+        return std::nullopt;
+    }
+
+    embeddings result;
+    result.m_format = static_cast<storage_format>(format);
+    result.m_rows = rows;
+    result.m_dim = dim;
+    const uint64_t count = rows * static_cast<uint64_t>(dim);
+    bool ok = true;
+    switch (result.m_format) {
+    case storage_format::f32:
+        ok = count * sizeof(float) <= reader.remaining();
+        if (ok) {
+            result.m_f32.resize(count);
+            reader.read(result.m_f32.data(), count * sizeof(float));
+        }
+        break;
+    case storage_format::f16:
+        ok = count * sizeof(uint16_t) <= reader.remaining();
+        if (ok) {
+            result.m_f16.resize(count);
+            reader.read(result.m_f16.data(), count * sizeof(uint16_t));
+        }
+        break;
+    case storage_format::i8:
+        ok = count + rows * sizeof(float) <= reader.remaining();
+        if (ok) {
+            result.m_i8.resize(count);
+            result.m_scales.resize(rows);
+            reader.read(result.m_i8.data(), count);
+            reader.read(result.m_scales.data(), rows * sizeof(float));
+        }
+        break;
+    }
+    if (!ok) {
+        return std::nullopt;
+    }
+    result.compute_norms();
+    return result;
+}
+
+bundle make_bundle(const std::unordered_map<std::string, matrixf> &matrix_map, storage_format format) {
+    bundle b;
+    int dim = -1;
+    for (const auto &[track, mat] : matrix_map) {
+        if (dim == -1) {
+            dim = mat.size();
+        }
+        if (mat.size() != dim) {
+            std::cerr << "Skipping " << track << ": vector size " << mat.size() << " does not match " << dim << std::endl;
+            continue;
+        }
+        b.tracks.push_back(track);
+    }
+    std::sort(b.tracks.begin(), b.tracks.end());
+
+    matrixf vectors(b.tracks.size(), std::max(dim, 0));
+    for (size_t i = 0; i < b.tracks.size(); i++) {
+        const matrixf &mat = matrix_map.at(b.tracks[i]);
+        vectors.row(i) = Eigen::Map<const vectorf>(mat.data(), mat.size());
+    }
+    b.vectors = embeddings(vectors, format);
+    return b;
+}
+
+bool save_bundle(const std::vector<std::string> &tracks, const embeddings &vectors, const std::filesystem::path &path) {
+    std::string data(BUNDLE_MAGIC, sizeof(BUNDLE_MAGIC));
+    vectors.write(data);
+    for (const auto &track : tracks) {
+        const uint32_t len = static_cast<uint32_t>(track.size());
+        data.append(reinterpret_cast<const char *>(&len), sizeof(len));
+        data.append(track);
+    }
+    return utils::save_checksummed_file(path, data);
+}
+
+std::optional<bundle> load_bundle(const std::filesystem::path &path) {
+    const auto data = utils::load_checksummed_file(path);
+    if (!data.has_value()) {
+        return std::nullopt;
+    }
+
+    if (data->size() < sizeof(BUNDLE_MAGIC) || std::memcmp(data->data(), BUNDLE_MAGIC, sizeof(BUNDLE_MAGIC)) != 0) {
+        // float32 bundle written as a plain matrix map
+        auto matrix_map = utils::parse_matrix_map(*data);
+        if (!matrix_map.has_value()) {
+            std::cerr << "Truncated bundle " << path << std::endl;
+            return std::nullopt;
+        }
+        return make_bundle(*matrix_map, storage_format::f32);
+    }
+
+    utils::byte_reader reader(data->data() + sizeof(BUNDLE_MAGIC), data->size() - sizeof(BUNDLE_MAGIC));
+    auto vectors = embeddings::read(reader);
+    if (!vectors.has_value()) {
+        std::cerr << "Truncated bundle " << path << std::endl;
+        return std::nullopt;
+    }
+
+    bundle b;
+    b.tracks.reserve(vectors->size());
+    for (size_t i = 0; i < vectors->size(); i++) {
+        uint32_t len = 0;
+        if (!reader.read(&len, sizeof(len)) || len > reader.remaining()) {
+            std::cerr << "Truncated bundle " << path << std::endl;
+            return std::nullopt;
+        }
+        std::string track(len, '\0');
+        reader.read(track.data(), len);
+        b.tracks.push_back(std::move(track));
+    }
+    b.vectors = std::move(*vectors);
+    return b;
+}
+
+std::unordered_map<std::string, matrixf> bundle_to_matrix_map(const bundle &b) {
+    std::unordered_map<std::string, matrixf> matrix_map;
+    for (size_t i = 0; i < b.tracks.size(); i++) {
+        matrix_map.emplace(b.tracks[i], b.vectors.row(i));
+    }
+    return matrix_map;
+}
+
+static std::vector<size_t> top_k_cosine(const embeddings &vectors, const vectorf &query, size_t exclude, int k) {
+    std::vector<float> scores(vectors.size());
+    vectors.dot_all(query, scores.data());
+    for (size_t i = 0; i < scores.size(); i++) {
+        scores[i] /= std::max(vectors.norm(i), 1e-12f);
+    }
+    scores[exclude] = -INFINITY;
+
+    std::vector<size_t> indices(vectors.size());
+    std::iota(indices.begin(), indices.end(), 0);
+    const size_t n = std::min<size_t>(k, indices.size());
+    std::partial_sort(indices.begin(), indices.begin() + n, indices.end(),
+                      [&](size_t a, size_t b) { return scores[a] > scores[b]; });
+    indices.resize(n);
+    return indices;
+}
+
+float quantization_recall(const embeddings &reference, const embeddings &quantized, int k, int queries) {
+    if (reference.size() < 2 || queries <= 0) {
+        return 1.f;
+    }
+    const size_t num_queries = std::min<size_t>(queries, reference.size());
+    const size_t step = reference.size() / num_queries;
+    size_t found = 0;
+    size_t total = 0;
+    for (size_t q = 0; q < num_queries; q++) {
+        const size_t index = q * step;
+        const vectorf query = reference.row(index);
+        const auto expected = top_k_cosine(reference, query, index, k);
+        const auto actual = top_k_cosine(quantized, query, index, k);
+        for (size_t idx : expected) {
+            found += std::find(actual.begin(), actual.end(), idx) != actual.end();
+        }
+        total += expected.size();
+    }
+    return total == 0 ? 1.f : static_cast<float>(found) / static_cast<float>(total);
+}
+
+} // namespace deejai
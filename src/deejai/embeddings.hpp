@@ -0,0 +1,96 @@
+#pragma once
+
+#include "deejai/common.hpp"
+#include "deejai/utils.hpp"
+
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace deejai {
+
+enum class storage_format : uint8_t {
+    f32 = 0,
+    f16 = 1,
+    i8 = 2,
+};
+
+std::optional<storage_format> storage_format_from_string(const std::string &name);
+std::string storage_format_name(storage_format format);
+
+// Contiguous row storage of the track vectors. Rows are kept in float32, float16 or
+// int8 with a per-row scale, and scored with the SIMD kernels of the running CPU.
+class embeddings {
+  public:
+    // A query in the form the rows are scored with, quantized to int8 or decoded from a
+    // row once for all the rows of a search. Only valid for the embeddings it comes from.
+    class prepared_query {
+      private:
+        friend class embeddings;
+
+        std::vector<float> m_f32;
+        std::vector<int8_t> m_i8;
+        float m_scale = 1.f;
+    };
+
+    embeddings() = default;
+    embeddings(const matrixf &vectors, storage_format format);
+
+    storage_format format() const;
+    size_t size() const;
+    int dim() const;
+    size_t memory_bytes() const;
+
+    vectorf row(size_t index) const;
+    float norm(size_t index) const;
+
+    // dot products of the query with every row
+    void dot_all(const vectorf &query, float *out) const;
+    void dot_range(const vectorf &query, size_t begin, size_t end, float *out) const;
+    float dot(size_t index, const vectorf &query) const;
+    float dot(size_t a, size_t b) const;
+    prepared_query prepare(const vectorf &query) const;
+    // the row itself as a query, scored against other rows
+    prepared_query prepare(size_t index) const;
+    float dot(size_t index, const prepared_query &query) const;
+    // dot products of every query row with the rows [begin, end), as a queries x rows matrix
+    void dot_block(const matrixf &queries, size_t begin, size_t end, matrixf &out) const;
+
+    void write(std::string &out) const;
+    static std::optional<embeddings> read(utils::byte_reader &reader);
+
+  private:
+    // queries from which dot_block uses the tile kernel
+    static constexpr Eigen::Index TILE_MIN_QUERIES = 16;
+
+    void compute_norms();
+    void decode_row(size_t index, float *out, size_t stride) const;
+
+    storage_format m_format = storage_format::f32;
+    size_t m_rows = 0;
+    int m_dim = 0;
+    std::vector<float> m_f32;
+    std::vector<uint16_t> m_f16;
+    std::vector<int8_t> m_i8;
+    std::vector<float> m_scales;
+    std::vector<float> m_norms;
+};
+
+struct bundle {
+    std::vector<std::string> tracks;
+    embeddings vectors;
+};
+
+bundle make_bundle(const std::unordered_map<std::string, matrixf> &matrix_map, storage_format format);
+bool save_bundle(const std::vector<std::string> &tracks, const embeddings &vectors, const std::filesystem::path &path);
+std::optional<bundle> load_bundle(const std::filesystem::path &path);
+std::unordered_map<std::string, matrixf> bundle_to_matrix_map(const bundle &b);
+
+// Fraction of the float32 top-k neighbours that the quantized vectors also return,
+// averaged over a sample of the rows used as queries.
+float quantization_recall(const embeddings &reference, const embeddings &quantized, int k, int queries);
+
+} // namespace deejai
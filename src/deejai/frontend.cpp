@@ -0,0 +1,81 @@
+#include "deejai/frontend.hpp"
+#include "deejai/kernels.hpp"
+#include "deejai/mel_frontend.hpp"
+#include "librosa.h"
+
+#include <algorithm>
+
+namespace deejai {
+
+// mel bands projected together, the rows of one dot_tile_f32 step
+static constexpr Eigen::Index MEL_BLOCK = 4;
+
+// the STFT shape of the deej-ai model
+typedef mel_frontend<22050, 2048, 512, 96> model_frontend;
+
+static matrixf mel_spectrogram_generic(vectorf &samples, int sampling_rate, int n_fft, int hop_length, int n_mels) {
+    const librosa::Matrixcf X = librosa::internal::stft(samples, n_fft, hop_length, "hann", true, "constant");
+    const matrixf basis = librosa::internal::melfilter(sampling_rate, n_fft, n_mels, 0, sampling_rate / 2);
+    // frequency bins by frames, so the frames of a bin are contiguous
+    const matrixf power = X.cwiseAbs2().transpose();
+
+    // Every mel filter is zero outside a narrow band of bins, so each block of bands is
+    // only projected from the bins of its bands instead of the whole spectrum.
+    const Eigen::Index frames = power.cols();
+    matrixf mel = matrixf::Zero(n_mels, frames);
+    for (Eigen::Index begin = 0; begin < n_mels; begin += MEL_BLOCK) {
+        const Eigen::Index rows = std::min(MEL_BLOCK, n_mels - begin);
+        Eigen::Index low = basis.cols();
+        Eigen::Index high = 0;
+        for (Eigen::Index r = begin; r < begin + rows; r++) {
+            for (Eigen::Index c = 0; c < basis.cols(); c++) {
+                if (basis(r, c) != 0.f) {
+                    low = std::min(low, c);
+                    high = std::max(high, c + 1);
+                }
+            }
+        }
+        if (low >= high) {
+            continue;
+        }
+        kernels::dot_tile_f32(basis.row(begin).data() + low, basis.cols(), rows, power.row(low).data(), frames, frames,
+                              high - low, mel.row(begin).data(), frames);
+    }
+    return mel;
+}
+
+matrixf mel_spectrogram(vectorf &samples, int sampling_rate, int n_fft, int hop_length, int n_mels) {
+    if (sampling_rate == 22050 && n_fft == 2048 && hop_length == 512 && n_mels == 96) {
+        return model_frontend::mel_spectrogram(samples.data(), samples.size());
+    }
+    return mel_spectrogram_generic(samples, sampling_rate, n_fft, hop_length, n_mels);
+}
+
+Eigen::Map<matrixf> mel_spectrogram(std::span<const float> samples, int sampling_rate, int n_fft, int hop_length,
+                                    int n_mels, arena &scratch) {
+    if (sampling_rate == 22050 && n_fft == 2048 && hop_length == 512 && n_mels == 96) {
+        const Eigen::Index frames = model_frontend::frames(samples.size());
+        Eigen::Map<matrixf> mel(scratch.allocate<float>(n_mels * frames), n_mels, frames);
+        model_frontend::mel_spectrogram(samples.data(), samples.size(), mel.data());
+        return mel;
+    }
+    vectorf copy = Eigen::Map<const vectorf>(samples.data(), samples.size());
+    const matrixf generic = mel_spectrogram_generic(copy, sampling_rate, n_fft, hop_length, n_mels);
+    Eigen::Map<matrixf> mel(scratch.allocate<float>(generic.size()), generic.rows(), generic.cols());
+    mel = generic;
+    return mel;
+}
+
+matrixf power_to_db(const matrixf &power) {
+    matrixf db(power.rows(), power.cols());
+    power_to_db(power.data(), power.size(), db.data());
+    return db;
+}
+
+void power_to_db(const float *power, size_t size, float *db) {
+    const float top = kernels::power_to_db(power, size, db);
+    Eigen::Map<Eigen::ArrayXf> values(db, size);
+    values = values.max(top - 80.f);
+}
+
+} // namespace deejai
@@ -0,0 +1,22 @@
+#pragma once
+
+#include "deejai/arena.hpp"
+#include "deejai/common.hpp"
+
+#include <span>
+
+namespace deejai {
+
+// The mel power spectrogram of librosa.feature.melspectrogram with a Hann window, centred
+// frames padded with zeros and fmax at the Nyquist frequency: n_mels rows by frames. The
+// shape of the deej-ai model runs on tables built at compile time, see mel_frontend.
+matrixf mel_spectrogram(vectorf &samples, int sampling_rate, int n_fft, int hop_length, int n_mels);
+// The same in memory of the arena, valid until it is reset.
+Eigen::Map<matrixf> mel_spectrogram(std::span<const float> samples, int sampling_rate, int n_fft, int hop_length,
+                                    int n_mels, arena &scratch);
+
+// librosa.power_to_db with ref 1 and top_db 80.
+matrixf power_to_db(const matrixf &power);
+void power_to_db(const float *power, size_t size, float *db);
+
+} // namespace deejai
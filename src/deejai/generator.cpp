@@ -1,5 +1,8 @@
 #include "deejai/generator.hpp"
 #include "deejai/common.hpp"
+#include "deejai/playlist_session.hpp"
+#include "deejai/reorder.hpp"
+#include "deejai/top_k.hpp"
 #include "deejai/utils.hpp"
 
 #include <algorithm>
@@ -10,68 +13,395 @@
 #include <unordered_set>
 
 #include <algorithm>
+#include <chrono>
 #include <cmath>
 #include <ctime>
+#include <iomanip>
 #include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <numeric>
 #include <random>
+#include <sstream>
+#include <stdexcept>
+#include <utility>
 #include <vector>
 
 namespace deejai {
 
-generator::generator(const std::string &vecs_dir) {
-    const std::filesystem::path path = std::filesystem::path(vecs_dir) / BUNDLED_VECS_DIRNAME / BUNDLED_VECS_FILENAME;
-    auto temp_map = utils::load_matrix_map(path.string());
-    m_audio_vec = utils::matrix_to_vector(temp_map);
+// tracks the graph search between two seeds may reach before 'connect' scores the whole
+// library instead, which is cheaper than a search spreading over a large library
+static constexpr size_t CONNECT_GRAPH_SEARCH_LIMIT = 4096;
+// closest tracks kept while searching the graph for the next song
+static constexpr size_t GRAPH_SEARCH_WIDTH = 32;
+
+// Offers the scores of the library rows [begin, begin + count) to the heap.
+static void push_scores(top_k<track_id> &heap, const float *scores, size_t begin, size_t count,
+                        const std::vector<bool> &excluded) {
+    float threshold = heap.threshold();
+    for (size_t r = 0; r < count; r++) {
+        if (scores[r] > threshold && !excluded[begin + r]) {
+            heap.push(static_cast<track_id>(begin + r), scores[r]);
+            threshold = heap.threshold();
+        }
+    }
+}
+
+// the methods whose queries are timed, the map of their histograms is never modified
+// after construction so the queries read it without a lock
+static const char *const QUERY_METHODS[] = {"append",       "connect",            "cluster", "beam",
+                                            "most_similar", "most_similar_batch", "reorder", "session"};
+
+struct generator::counters {
+    counters() {
+        for (const char *method : QUERY_METHODS) {
+            latency_us.try_emplace(method);
+        }
+    }
+
+    std::map<std::string, histogram> latency_us;
+    histogram candidates;
+    histogram excluded;
+    // guarded by the mutex of the generator
+    double load_milliseconds = 0.0;
+    size_t reloads = 0;
+};
+
+// the public queries running on this thread, and the tracks scored by the outermost one
+static thread_local int query_depth = 0;
+static thread_local uint64_t query_scored = 0;
+
+generator::query_scope::query_scope(const generator &gen, const std::string &method)
+    : m_counters(*gen.m_counters), m_start(std::chrono::steady_clock::now()), m_outer(query_depth++ == 0) {
+    const auto it = m_counters.latency_us.find(method);
+    m_latency = it != m_counters.latency_us.end() ? &it->second : nullptr;
+    if (m_outer) {
+        query_scored = 0;
+    }
+}
+
+generator::query_scope::~query_scope() {
+    query_depth--;
+    if (!m_outer) {
+        return;
+    }
+    if (m_latency != nullptr) {
+        const std::chrono::duration<double, std::micro> elapsed = std::chrono::steady_clock::now() - m_start;
+        m_latency->record(static_cast<uint64_t>(elapsed.count()));
+    }
+    // reorder scores no candidates
+    if (query_scored > 0) {
+        m_counters.candidates.record(query_scored);
+        m_counters.excluded.record(m_excluded);
+    }
+}
+
+void generator::query_scope::set_excluded(size_t excluded) {
+    m_excluded = excluded;
+}
+
+size_t generator::query_scope::excluded() const {
+    return m_excluded;
+}
+
+generator::generator(const std::string &vecs_dir) : m_vecs_dir(vecs_dir), m_counters(std::make_unique<counters>()) {
+    const auto start = std::chrono::steady_clock::now();
+    auto loaded = library::load(vecs_dir);
+    m_library = std::make_shared<const library>(loaded.has_value() ? std::move(*loaded) : library());
+    const std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+    m_counters->load_milliseconds = elapsed.count();
+}
+
+generator::generator(const generator &other)
+    : m_vecs_dir(other.m_vecs_dir), m_use_graph(other.m_use_graph.load(std::memory_order_relaxed)),
+      m_counters(std::make_unique<counters>()) {
+    // the copy starts its own query statistics
+    std::lock_guard<std::mutex> lock(other.m_mutex);
+    m_library = other.m_library;
+    if (other.m_counters) {
+        m_counters->load_milliseconds = other.m_counters->load_milliseconds;
+        m_counters->reloads = other.m_counters->reloads;
+    }
+}
+
+generator::~generator() = default;
+
+generator &generator::operator=(const generator &other) {
+    if (this != &other) {
+        m_vecs_dir = other.m_vecs_dir;
+        m_use_graph.store(other.m_use_graph.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        std::shared_ptr<const library> lib;
+        double load_milliseconds = 0.0;
+        size_t reloads = 0;
+        {
+            std::lock_guard<std::mutex> lock(other.m_mutex);
+            lib = other.m_library;
+            if (other.m_counters) {
+                load_milliseconds = other.m_counters->load_milliseconds;
+                reloads = other.m_counters->reloads;
+            }
+        }
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_library = std::move(lib);
+        // like a copy, a generator that was moved from starts its own query statistics
+        if (!m_counters) {
+            m_counters = std::make_unique<counters>();
+        }
+        m_counters->load_milliseconds = load_milliseconds;
+        m_counters->reloads = reloads;
+    }
+    return *this;
+}
+
+// the library and the query statistics move with the generator
+generator::generator(generator &&other) noexcept : m_use_graph(other.m_use_graph.load(std::memory_order_relaxed)) {
+    std::lock_guard<std::mutex> lock(other.m_mutex);
+    m_vecs_dir = std::move(other.m_vecs_dir);
+    m_library = std::move(other.m_library);
+    m_counters = std::move(other.m_counters);
+}
+
+generator &generator::operator=(generator &&other) noexcept {
+    if (this != &other) {
+        std::scoped_lock lock(m_mutex, other.m_mutex);
+        m_vecs_dir = std::move(other.m_vecs_dir);
+        m_use_graph.store(other.m_use_graph.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        m_library = std::move(other.m_library);
+        m_counters = std::move(other.m_counters);
+    }
+    return *this;
+}
+
+std::shared_ptr<const library> generator::snapshot() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_library;
+}
+
+std::optional<reload_report> generator::reload() {
+    // the new library is built without the lock, queries keep running on the current one
+    const auto start = std::chrono::steady_clock::now();
+    auto loaded = library::load(m_vecs_dir);
+    if (!loaded.has_value()) {
+        return std::nullopt;
+    }
+    auto next = std::make_shared<const library>(std::move(*loaded));
+
+    reload_report report;
+    report.tracks = next->tracks().size();
+    report.bytes = next->memory_bytes();
+    std::shared_ptr<const library> previous;
+    const std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+    report.milliseconds = elapsed.count();
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        previous = std::exchange(m_library, std::move(next));
+        m_counters->load_milliseconds = report.milliseconds;
+        m_counters->reloads++;
+    }
+    report.previous_bytes = previous->memory_bytes();
+    // previous is released here unless queries still hold it
+    return report;
+}
+
+const std::string &generator::vecs_dir() const {
+    return m_vecs_dir;
+}
+
+generator_stats generator::stats() const {
+    generator_stats result;
+    std::shared_ptr<const library> lib;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        lib = m_library;
+        result.load_milliseconds = m_counters->load_milliseconds;
+        result.reloads = m_counters->reloads;
+    }
+    result.tracks = lib->tracks().size();
+    result.index_bytes = lib->memory_bytes();
+    result.mapped_bytes = lib->graph().memory_bytes();
+    for (const auto &[method, latency] : m_counters->latency_us) {
+        const histogram_summary summary = latency.summary();
+        if (summary.count > 0) {
+            result.latency_us.emplace(method, summary);
+        }
+    }
+    result.candidates = m_counters->candidates.summary();
+    result.excluded = m_counters->excluded.summary();
+    return result;
+}
+
+void print_stats(std::ostream &out, const generator_stats &stats) {
+    const std::ios_base::fmtflags flags = out.flags();
+    out << std::fixed << std::setprecision(2);
+    out << "Loaded " << stats.tracks << " songs in " << stats.load_milliseconds << " ms";
+    if (stats.reloads > 0) {
+        out << " (reload " << stats.reloads << ")";
+    }
+    out << ", index " << stats.index_bytes / 1048576.0 << " MiB of which " << stats.mapped_bytes / 1048576.0
+        << " MiB mapped\n";
+    out << std::left << std::setw(20) << "query" << std::right << std::setw(9) << "count" << std::setw(11) << "mean"
+        << std::setw(11) << "p50" << std::setw(11) << "p95" << std::setw(11) << "p99" << std::setw(11) << "max"
+        << "\n";
+    auto row = [&](const std::string &name, const histogram_summary &h, double scale) {
+        out << std::left << std::setw(20) << name << std::right << std::setw(9) << h.count << std::setw(11)
+            << (h.count > 0 ? h.sum / scale / h.count : 0.0) << std::setw(11) << h.p50 / scale << std::setw(11)
+            << h.p95 / scale << std::setw(11) << h.p99 / scale << std::setw(11) << h.max / scale << "\n";
+    };
+    for (const auto &[method, latency] : stats.latency_us) {
+        row(method + " ms", latency, 1000.0);
+    }
+    row("scored songs", stats.candidates, 1.0);
+    row("excluded songs", stats.excluded, 1.0);
+    out.flush();
+    out.flags(flags);
+}
+
+std::string prometheus_text(const generator_stats &stats) {
+    std::ostringstream out;
+    // enough digits for the byte counts to stay exact
+    out << std::setprecision(15);
+    auto gauge = [&](const std::string &name, const std::string &help, double value) {
+        out << "# HELP deejai_" << name << " " << help << "\n";
+        out << "# TYPE deejai_" << name << " gauge\n";
+        out << "deejai_" << name << " " << value << "\n";
+    };
+    auto summary = [&](const std::string &name, const std::string &labels, const histogram_summary &h, double scale) {
+        const std::string separator = labels.empty() ? "" : ",";
+        for (const auto &[quantile, value] : {std::pair{"0.5", h.p50}, {"0.95", h.p95}, {"0.99", h.p99}}) {
+            out << "deejai_" << name << "{" << labels << separator << "quantile=\"" << quantile << "\"} "
+                << value / scale << "\n";
+        }
+        const std::string braces = labels.empty() ? "" : "{" + labels + "}";
+        out << "deejai_" << name << "_sum" << braces << " " << h.sum / scale << "\n";
+        out << "deejai_" << name << "_count" << braces << " " << h.count << "\n";
+    };
+
+    gauge("generator_load_seconds", "Time spent loading the current library.", stats.load_milliseconds / 1000.0);
+    gauge("generator_reloads", "Number of times the library was reloaded.", static_cast<double>(stats.reloads));
+    gauge("generator_tracks", "Songs in the current library.", static_cast<double>(stats.tracks));
+    gauge("generator_index_bytes", "Memory of the current library.", static_cast<double>(stats.index_bytes));
+    gauge("generator_mapped_bytes", "Part of the library memory mapped from files.",
+          static_cast<double>(stats.mapped_bytes));
+
+    out << "# HELP deejai_generator_query_seconds Latency of the queries by method.\n";
+    out << "# TYPE deejai_generator_query_seconds summary\n";
+    for (const auto &[method, latency] : stats.latency_us) {
+        summary("generator_query_seconds", "method=\"" + method + "\"", latency, 1e6);
+    }
+    out << "# HELP deejai_generator_scored_songs Songs scored per query.\n";
+    out << "# TYPE deejai_generator_scored_songs summary\n";
+    summary("generator_scored_songs", "", stats.candidates, 1.0);
+    out << "# HELP deejai_generator_excluded_songs Songs excluded from the results per query.\n";
+    out << "# TYPE deejai_generator_excluded_songs summary\n";
+    summary("generator_excluded_songs", "", stats.excluded, 1.0);
+    return out.str();
+}
+
+void generator::set_use_graph(bool use_graph) {
+    m_use_graph.store(use_graph, std::memory_order_relaxed);
+}
+
+bool generator::uses_graph() const {
+    return uses_graph(*snapshot());
+}
+
+bool generator::uses_graph(const library &lib) const {
+    return m_use_graph.load(std::memory_order_relaxed) && !lib.graph().empty();
+}
+
+std::vector<track_id> generator::track_ids(const library &lib, const std::vector<std::string> &tracks) const {
+    std::vector<track_id> ids;
+    ids.reserve(tracks.size());
+    for (const auto &track : tracks) {
+        if (auto id = lib.tracks().find(track)) {
+            ids.push_back(*id);
+        }
+    }
+    return ids;
+}
+
+std::vector<std::string> generator::track_paths(const library &lib, const std::vector<track_id> &ids) const {
+    std::vector<std::string> paths;
+    paths.reserve(ids.size());
+    for (track_id id : ids) {
+        paths.push_back(lib.tracks().at(id));
+    }
+    return paths;
 }
 
 std::vector<std::string> generator::generate_playlist(const std::string &method,
                                                       std::vector<std::string> seed_tracks,
-                                                      int nsongs, int lookback, float noise) const {
-    remove_invalid_tracks(seed_tracks);
+                                                      int nsongs, int lookback, float noise,
+                                                      int beam_width, std::optional<uint64_t> seed) const {
+    query_scope scope(*this, method);
+    const std::shared_ptr<const library> current = snapshot();
+    std::vector<std::string> playlist =
+        generate_playlist(current, method, std::move(seed_tracks), nsongs, lookback, noise, beam_width, seed);
+    // every song of the playlist is excluded from the searches that extend it
+    scope.set_excluded(playlist.size());
+    return playlist;
+}
+
+std::vector<std::string> generator::generate_playlist(const std::shared_ptr<const library> &current,
+                                                      const std::string &method,
+                                                      std::vector<std::string> seed_tracks,
+                                                      int nsongs, int lookback, float noise,
+                                                      int beam_width, std::optional<uint64_t> seed) const {
+    const library &lib = *current;
+    remove_invalid_tracks(lib, seed_tracks);
     if (seed_tracks.empty()) {
         return {};
     }
+    std::mt19937 rng = utils::make_rng(seed);
 
     if (method == "connect") {
         if (seed_tracks.size() < 2) {
-            return generate_playlist("append", seed_tracks, nsongs, lookback, noise);
+            return generate_playlist(current, "append", seed_tracks, nsongs, lookback, noise, beam_width, seed);
         }
 
-        return generate_playlist_connect(seed_tracks, nsongs, noise);
+        return track_paths(lib, generate_playlist_connect(lib, track_ids(lib, seed_tracks), nsongs, noise, rng));
+    }
+
+    if (method == "beam") {
+        return track_paths(lib, generate_playlist_beam(lib, track_ids(lib, seed_tracks), nsongs, lookback, noise,
+                                                       beam_width, rng));
+    }
+
+    if (method == "append") {
+        playlist_session session(*this, current, seed_tracks, lookback, noise, seed);
+        const std::vector<std::string> next = session.next(nsongs - static_cast<int>(seed_tracks.size()));
+        seed_tracks.insert(seed_tracks.end(), next.begin(), next.end());
+        return seed_tracks;
     }
 
+    std::vector<track_id> playlist = track_ids(lib, seed_tracks);
     vectorf vec_sum;
     if (method == "cluster") {
-        vec_sum = calculate_vector(seed_tracks, noise);
+        vec_sum = calculate_vector(lib, playlist, noise, rng);
     }
 
-    std::vector<std::string> playlist = seed_tracks;
-    std::unordered_set<std::string> seen(seed_tracks.begin(), seed_tracks.end());
+    std::vector<bool> seen(lib.tracks().size(), false);
+    for (track_id id : playlist) {
+        seen[id] = true;
+    }
     while (playlist.size() < static_cast<size_t>(nsongs)) {
-        if (method == "append") {
-            const int start_idx =
-                std::max(0, static_cast<int>(playlist.size()) - lookback);
-            const std::vector<std::string> context(playlist.begin() + start_idx,
-                                                   playlist.end());
-            vec_sum = calculate_vector(context, noise);
-        }
-
-        auto similar = most_similar(seen, vec_sum, 1);
+        auto similar = most_similar(lib, seen, vec_sum, 1);
         if (similar.empty()) {
             break;
         }
-        const std::string next_song = similar.front().first;
+        const track_id next_song = similar.front().first;
         playlist.push_back(next_song);
-        seen.insert(next_song);
+        seen[next_song] = true;
     }
 
-    return playlist;
+    return track_paths(lib, playlist);
 }
 
-bool generator::remove_invalid_tracks(std::vector<std::string> &tracks) const {
-    const int original_size = tracks.size();
+bool generator::remove_invalid_tracks(const library &lib, std::vector<std::string> &tracks) const {
+    const size_t original_size = tracks.size();
     for (auto it = tracks.begin(); it != tracks.end();) {
-        if (!m_audio_vec.contains(*it)) {
+        if (!lib.tracks().contains(*it)) {
             std::cerr << *it << ": is not in the scanned vector directory. Removing it from input." << std::endl;
             it = tracks.erase(it);
         } else {
@@ -81,167 +411,600 @@ bool generator::remove_invalid_tracks(std::vector<std::string> &tracks) const {
     return original_size == tracks.size();
 }
 
-std::vector<std::string> generator::generate_playlist_connect(
-    const std::vector<std::string> &seed_tracks, int nsongs,
-    float noise) const {
-    const int max_tries = 100;
+// Assigns every row a distinct column minimising the summed cost, with the Hungarian
+// algorithm in O(rows^2 * cols). Needs rows <= cols, returns the column of every row.
+static std::vector<size_t> min_cost_assignment(const std::vector<std::vector<float>> &cost) {
+    const size_t rows = cost.size();
+    const size_t cols = rows == 0 ? 0 : cost.front().size();
+    // 1-based potentials and matching, column 0 is the row being inserted
+    std::vector<double> u(rows + 1, 0.0);
+    std::vector<double> v(cols + 1, 0.0);
+    std::vector<size_t> match(cols + 1, 0);
+    std::vector<size_t> way(cols + 1, 0);
+    for (size_t row = 1; row <= rows; row++) {
+        match[0] = row;
+        size_t col0 = 0;
+        std::vector<double> min_slack(cols + 1, INFINITY);
+        std::vector<bool> used(cols + 1, false);
+        do {
+            used[col0] = true;
+            const size_t row0 = match[col0];
+            double delta = INFINITY;
+            size_t col1 = 0;
+            for (size_t col = 1; col <= cols; col++) {
+                if (used[col]) {
+                    continue;
+                }
+                const double slack = cost[row0 - 1][col - 1] - u[row0] - v[col];
+                if (slack < min_slack[col]) {
+                    min_slack[col] = slack;
+                    way[col] = col0;
+                }
+                if (min_slack[col] < delta) {
+                    delta = min_slack[col];
+                    col1 = col;
+                }
+            }
+            for (size_t col = 0; col <= cols; col++) {
+                if (used[col]) {
+                    u[match[col]] += delta;
+                    v[col] -= delta;
+                } else {
+                    min_slack[col] -= delta;
+                }
+            }
+            col0 = col1;
+        } while (match[col0] != 0);
+        do {
+            const size_t col1 = way[col0];
+            match[col0] = match[col1];
+            col0 = col1;
+        } while (col0 != 0);
+    }
 
-    std::vector<std::string> playlist;
-    std::unordered_set<std::string> seen;
-    seen.insert(seed_tracks.begin(), seed_tracks.end());
+    std::vector<size_t> assignment(rows);
+    for (size_t col = 1; col <= cols; col++) {
+        if (match[col] != 0) {
+            assignment[match[col] - 1] = col - 1;
+        }
+    }
+    return assignment;
+}
+
+std::vector<track_id> generator::generate_playlist_connect(
+    const library &lib, const std::vector<track_id> &seed_tracks, int nsongs,
+    float noise, std::mt19937 &rng) const {
+    std::vector<track_id> playlist;
+    std::vector<bool> seen(lib.tracks().size(), false);
+    for (track_id id : seed_tracks) {
+        seen[id] = true;
+    }
     playlist.push_back(seed_tracks[0]);
 
-    for (size_t t = 1; t < seed_tracks.size(); t++) {
-        const std::string &start = seed_tracks[t - 1];
-        const std::string &end = seed_tracks[t];
+    nsongs = std::max(nsongs, 0);
+    const size_t num_pairs = seed_tracks.size() - 1;
+    const size_t total_slots = num_pairs * nsongs;
 
+    // the blends between every pair of seeds, slot i of pair t is row t * nsongs + i
+    matrixf endpoints(seed_tracks.size(), lib.vectors().dim());
+    for (size_t t = 0; t < seed_tracks.size(); t++) {
+        endpoints.row(t) = lib.vectors().row(seed_tracks[t]);
+    }
+    std::vector<blend> blends;
+    blends.reserve(total_slots);
+    for (size_t t = 0; t < num_pairs; t++) {
         for (int i = 0; i < nsongs; i++) {
             float alpha =
                 static_cast<float>(nsongs - i + 1) / static_cast<float>(nsongs + 1);
-            float beta = 1.0f - alpha;
-
-            const vectorf start_vec = m_audio_vec.at(start);
-            const vectorf end_vec = m_audio_vec.at(end);
-            vectorf blended = alpha * start_vec + beta * end_vec;
-            utils::add_noise(blended, noise);
-
-            auto similar = most_similar(seen, blended, max_tries);
-            std::string next_song;
-            for (const auto &[candidate, _] : similar) {
-                if (candidate != end) {
-                    next_song = candidate;
-                    break;
-                }
+            blends.push_back({t, t + 1, alpha});
+        }
+    }
+    matrixf queries(total_slots, lib.vectors().dim());
+    for (size_t slot = 0; slot < total_slots; slot++) {
+        const blend &b = blends[slot];
+        vectorf blended = b.alpha * endpoints.row(b.from) + (1.0f - b.alpha) * endpoints.row(b.to);
+        utils::add_noise(blended, noise, rng);
+        queries.row(slot) = blended;
+    }
+
+    // Scores the slots of the pairs, keeping topn candidates for each slot.
+    std::vector<std::vector<std::pair<track_id, float>>> candidates(total_slots);
+    auto score_pairs = [&](const std::vector<size_t> &pairs, int topn) {
+        std::vector<size_t> unscored;
+        for (size_t t : pairs) {
+            // the blends lie between the seeds, so the neighbours of the graph path joining
+            // them are usually enough candidates
+            std::vector<track_id> pool;
+            if (uses_graph(lib)) {
+                const std::vector<track_id> path =
+                    lib.graph().shortest_path(seed_tracks[t], seed_tracks[t + 1], seen, CONNECT_GRAPH_SEARCH_LIMIT);
+                pool = graph_candidates(lib, path, seen);
+            }
+            if (pool.size() < static_cast<size_t>(topn)) {
+                unscored.push_back(t);
+                continue;
             }
+            auto scored = most_similar_among(lib, pool, queries.middleRows(t * nsongs, nsongs), topn);
+            std::move(scored.begin(), scored.end(), candidates.begin() + t * nsongs);
+        }
+        if (unscored.empty()) {
+            return;
+        }
 
-            if (next_song.empty()) {
-                break;
+        // the pairs the graph cannot serve share one pass over the library
+        std::vector<std::vector<std::pair<track_id, float>>> scored;
+        if (noise > 0.0f) {
+            matrixf unscored_queries(unscored.size() * nsongs, lib.vectors().dim());
+            for (size_t u = 0; u < unscored.size(); u++) {
+                unscored_queries.middleRows(u * nsongs, nsongs) = queries.middleRows(unscored[u] * nsongs, nsongs);
+            }
+            scored = most_similar_batch(lib, {&seen}, unscored_queries, topn);
+        } else {
+            // without noise the blends are scored from the scores of the seeds alone
+            std::vector<blend> unscored_blends;
+            for (size_t t : unscored) {
+                unscored_blends.insert(unscored_blends.end(), blends.begin() + t * nsongs,
+                                       blends.begin() + (t + 1) * nsongs);
             }
-            playlist.push_back(next_song);
-            seen.insert(next_song);
+            scored = most_similar_blends(lib, seen, endpoints, unscored_blends, topn);
         }
-        playlist.push_back(end);
+        for (size_t u = 0; u < unscored.size(); u++) {
+            std::move(scored.begin() + u * nsongs, scored.begin() + (u + 1) * nsongs,
+                      candidates.begin() + unscored[u] * nsongs);
+        }
+    };
+
+    // The matching of a pair only needs the best nsongs unseen candidates of each slot.
+    // Twice that usually survives the picks of the earlier pairs, a pair left short is
+    // scored again.
+    const int topn = 2 * nsongs;
+    std::vector<size_t> all_pairs(num_pairs);
+    std::iota(all_pairs.begin(), all_pairs.end(), 0);
+    score_pairs(all_pairs, topn);
+
+    for (size_t t = 0; t < num_pairs; t++) {
+        auto collect = [&](std::vector<std::vector<std::pair<track_id, float>>> &slots,
+                           std::vector<track_id> &columns) {
+            bool short_slot = false;
+            for (int i = 0; i < nsongs; i++) {
+                const auto &slot_candidates = candidates[t * nsongs + i];
+                for (const auto &candidate : slot_candidates) {
+                    if (slots[i].size() == static_cast<size_t>(nsongs)) {
+                        break;
+                    }
+                    if (!seen[candidate.first]) {
+                        slots[i].push_back(candidate);
+                        columns.push_back(candidate.first);
+                    }
+                }
+                short_slot = short_slot || (slots[i].size() < static_cast<size_t>(nsongs) &&
+                                            slot_candidates.size() == static_cast<size_t>(topn));
+            }
+            return short_slot;
+        };
+
+        // the best nsongs unseen candidates of every slot, as columns of the matching
+        std::vector<track_id> columns;
+        std::vector<std::vector<std::pair<track_id, float>>> slots(nsongs);
+        if (collect(slots, columns)) {
+            score_pairs({t}, nsongs);
+            columns.clear();
+            slots.assign(nsongs, {});
+            collect(slots, columns);
+        }
+        std::sort(columns.begin(), columns.end());
+        columns.erase(std::unique(columns.begin(), columns.end()), columns.end());
+
+        // Slots take distinct songs with the highest summed similarity. Songs missing from
+        // the candidates of a slot cost more than any real pair, so they are only
+        // assigned when the library runs out of songs, and then dropped.
+        const float missing = 3.0f;
+        std::vector<size_t> rows;
+        std::vector<std::vector<float>> cost;
+        for (int i = 0; i < nsongs; i++) {
+            if (slots[i].empty()) {
+                continue;
+            }
+            std::vector<float> &row = cost.emplace_back(columns.size(), missing);
+            for (const auto &[id, sim] : slots[i]) {
+                row[std::lower_bound(columns.begin(), columns.end(), id) - columns.begin()] = 1.0f - sim;
+            }
+            rows.push_back(i);
+        }
+        if (rows.size() > columns.size()) {
+            rows.resize(columns.size());
+            cost.resize(columns.size());
+        }
+        const std::vector<size_t> assignment = min_cost_assignment(cost);
+        for (size_t r = 0; r < rows.size(); r++) {
+            if (cost[r][assignment[r]] >= missing) {
+                continue;
+            }
+            const track_id id = columns[assignment[r]];
+            playlist.push_back(id);
+            seen[id] = true;
+        }
+        playlist.push_back(seed_tracks[t + 1]);
     }
     return playlist;
 }
 
+std::vector<track_id> generator::generate_playlist_beam(const library &lib, const std::vector<track_id> &seed_tracks,
+                                                       int nsongs, int lookback, float noise, int beam_width,
+                                                       std::mt19937 &rng) const {
+    struct beam {
+        std::vector<track_id> tracks;
+        // sum of the cosine similarities between consecutive picks
+        float smoothness;
+    };
+    struct expansion {
+        float smoothness;
+        size_t beam;
+        track_id track;
+    };
+
+    beam_width = std::max(beam_width, 1);
+    lookback = std::max(lookback, 1);
+    const size_t num_seeds = seed_tracks.size();
+    std::vector<bool> seen(lib.tracks().size(), false);
+    for (track_id id : seed_tracks) {
+        seen[id] = true;
+    }
+
+    auto similarity = [&](track_id a, const embeddings::prepared_query &prepared_a, track_id b) {
+        const float denom = lib.vectors().norm(a) * lib.vectors().norm(b);
+        return denom > 0.f ? lib.vectors().dot(b, prepared_a) / denom : 0.f;
+    };
+
+    std::vector<beam> beams = {{seed_tracks, 0.f}};
+    for (size_t step = 0; num_seeds + step < static_cast<size_t>(nsongs); step++) {
+        // the next song of every beam follows its last songs, all beams share one pass over the library
+        matrixf queries(beams.size(), lib.vectors().dim());
+        for (size_t b = 0; b < beams.size(); b++) {
+            const auto &tracks = beams[b].tracks;
+            const size_t start = tracks.size() - std::min(tracks.size(), static_cast<size_t>(lookback));
+            queries.row(b) = calculate_vector(lib, std::span<const track_id>(tracks).subspan(start), noise, rng);
+        }
+        // the picks of a beam are not in the shared mask, so ask for enough candidates to skip them
+        const auto candidates = most_similar_batch(lib, {&seen}, queries, beam_width + static_cast<int>(step));
+
+        std::vector<expansion> expansions;
+        for (size_t b = 0; b < beams.size(); b++) {
+            const auto &tracks = beams[b].tracks;
+            const embeddings::prepared_query last = lib.vectors().prepare(tracks.back());
+            int taken = 0;
+            for (const auto &[id, sim] : candidates[b]) {
+                if (taken == beam_width) {
+                    break;
+                }
+                if (std::find(tracks.begin() + num_seeds, tracks.end(), id) != tracks.end()) {
+                    continue;
+                }
+                expansions.push_back({beams[b].smoothness + similarity(tracks.back(), last, id), b, id});
+                taken++;
+            }
+        }
+        if (expansions.empty()) {
+            break;
+        }
+
+        // keep the smoothest expansions
+        const size_t kept = std::min(expansions.size(), static_cast<size_t>(beam_width));
+        std::partial_sort(expansions.begin(), expansions.begin() + kept, expansions.end(),
+                          [](const expansion &a, const expansion &b) { return a.smoothness > b.smoothness; });
+        std::vector<beam> next_beams;
+        next_beams.reserve(kept);
+        for (size_t e = 0; e < kept; e++) {
+            beam &extended = next_beams.emplace_back(beams[expansions[e].beam]);
+            extended.tracks.push_back(expansions[e].track);
+            extended.smoothness = expansions[e].smoothness;
+        }
+        beams = std::move(next_beams);
+    }
+
+    // the beams are sorted, the first is the smoothest
+    return beams.front().tracks;
+}
+
 std::vector<std::pair<std::string, float>> generator::most_similar(const std::unordered_set<std::string> &excluded,
                                                                    const vectorf &vec_sum, int topn) const {
-    float vec_sum_norm = vec_sum.norm();
-    std::vector<std::pair<std::string, float>> similar;
-    for (const auto &[track, vec] : m_audio_vec) {
-        if (excluded.contains(track)) {
-            continue;
+    query_scope scope(*this, "most_similar");
+    scope.set_excluded(excluded.size());
+    const std::shared_ptr<const library> current = snapshot();
+    const library &lib = *current;
+    std::vector<bool> excluded_ids(lib.tracks().size(), false);
+    for (const auto &track : excluded) {
+        if (auto id = lib.tracks().find(track)) {
+            excluded_ids[*id] = true;
         }
+    }
 
-        float sim = vec_sum.dot(vec) / (vec_sum_norm * vec.norm());
-        similar.emplace_back(track, sim);
+    std::vector<std::pair<std::string, float>> result;
+    for (const auto &[id, sim] : most_similar(lib, excluded_ids, vec_sum, topn)) {
+        result.emplace_back(lib.tracks().at(id), sim);
     }
+    return result;
+}
 
-    sort(similar.begin(), similar.end(),
-         [](const auto &a, const auto &b) { return a.second > b.second; });
+std::vector<std::pair<track_id, float>> generator::most_similar(const library &lib, const std::vector<bool> &excluded,
+                                                                const vectorf &vec_sum, int topn) const {
+    return most_similar_batch(lib, {&excluded}, vec_sum, topn).front();
+}
 
-    if (similar.size() > static_cast<size_t>(topn)) {
-        similar.resize(topn);
+std::vector<std::vector<std::pair<std::string, float>>> generator::most_similar_batch(
+    const std::vector<std::unordered_set<std::string>> &excluded, const matrixf &queries, int topn) const {
+    if (excluded.size() != 1 && excluded.size() != static_cast<size_t>(queries.rows())) {
+        throw std::invalid_argument("most_similar_batch needs one exclusion set, or one per query");
+    }
+    query_scope scope(*this, "most_similar_batch");
+    for (const auto &tracks : excluded) {
+        scope.set_excluded(std::max(scope.excluded(), tracks.size()));
+    }
+    const std::shared_ptr<const library> current = snapshot();
+    const library &lib = *current;
+    std::vector<std::vector<bool>> excluded_ids(excluded.size(), std::vector<bool>(lib.tracks().size(), false));
+    std::vector<const std::vector<bool> *> masks;
+    for (size_t q = 0; q < excluded.size(); q++) {
+        for (const auto &track : excluded[q]) {
+            if (auto id = lib.tracks().find(track)) {
+                excluded_ids[q][*id] = true;
+            }
+        }
+        masks.push_back(&excluded_ids[q]);
     }
 
-    return similar;
+    std::vector<std::vector<std::pair<std::string, float>>> result;
+    for (const auto &similar : most_similar_batch(lib, masks, queries, topn)) {
+        auto &paths = result.emplace_back();
+        for (const auto &[id, sim] : similar) {
+            paths.emplace_back(lib.tracks().at(id), sim);
+        }
+    }
+    return result;
 }
 
-vectorf generator::calculate_vector(const std::vector<std::string> &tracks, float noise) const {
-    vectorf vec_sum = vectorf::Zero(m_audio_vec.begin()->second.size());
-    for (const std::string &name : tracks) {
-        if (m_audio_vec.contains(name)) {
-            vec_sum += m_audio_vec.at(name);
+std::vector<std::vector<std::pair<track_id, float>>> generator::most_similar_batch(
+    const library &lib, const std::vector<const std::vector<bool> *> &excluded, const matrixf &queries,
+    int topn) const {
+    // rows of the library scored per block, small enough to stay in the L2 cache
+    const size_t block_rows = 256;
+    const size_t num_queries = queries.rows();
+    query_scored += lib.vectors().size() * num_queries;
+
+    matrixf normalized = queries;
+    for (size_t q = 0; q < num_queries; q++) {
+        const float norm = normalized.row(q).norm();
+        if (norm > 0.f) {
+            normalized.row(q) /= norm;
         }
     }
-    utils::add_noise(vec_sum, noise);
-    return vec_sum;
-}
 
-static float cos_distance(const vectorf &a, const vectorf &b) {
-    float denom = (a.norm() * b.norm());
-    if (denom < 0.001) {
-        return 1.f;
+    std::vector<top_k<track_id>> heaps(num_queries, top_k<track_id>(std::max(topn, 0)));
+    std::vector<float> inv_norms(block_rows);
+    matrixf scores;
+    for (size_t begin = 0; begin < lib.vectors().size(); begin += block_rows) {
+        const size_t end = std::min(begin + block_rows, lib.vectors().size());
+        lib.vectors().dot_block(normalized, begin, end, scores);
+        for (size_t r = begin; r < end; r++) {
+            const float norm = lib.vectors().norm(r);
+            inv_norms[r - begin] = norm > 0.f ? 1.f / norm : 0.f;
+        }
+
+        for (size_t q = 0; q < num_queries; q++) {
+            const std::vector<bool> &mask = excluded.size() == 1 ? *excluded.front() : *excluded[q];
+            float *row_scores = scores.row(q).data();
+            for (size_t r = 0; r < end - begin; r++) {
+                row_scores[r] *= inv_norms[r];
+            }
+
+            push_scores(heaps[q], row_scores, begin, end - begin, mask);
+        }
     }
 
-    float sim = 1.f - a.dot(b) / denom;
-    return sim;
+    std::vector<std::vector<std::pair<track_id, float>>> result;
+    result.reserve(num_queries);
+    for (const auto &heap : heaps) {
+        result.push_back(heap.sorted());
+    }
+    return result;
 }
 
-static float total_distance(const std::unordered_map<std::string, vectorf> &vecs, const std::vector<std::string> &tour) {
-    float dist = 0.0;
-    for (size_t i = 0; i < tour.size(); ++i) {
-        dist += cos_distance(vecs.at(tour.at(i)), vecs.at(tour.at((i + 1) % tour.size())));
+std::vector<std::vector<std::pair<track_id, float>>> generator::most_similar_blends(
+    const library &lib, const std::vector<bool> &excluded, const matrixf &endpoints,
+    const std::vector<blend> &blends, int topn) const {
+    // rows of the library scored per block, as in most_similar_batch
+    const size_t block_rows = 256;
+    query_scored += lib.vectors().size() * blends.size();
+
+    std::vector<float> inv_blend_norms;
+    inv_blend_norms.reserve(blends.size());
+    for (const blend &b : blends) {
+        const float norm = (b.alpha * endpoints.row(b.from) + (1.0f - b.alpha) * endpoints.row(b.to)).norm();
+        inv_blend_norms.push_back(norm > 0.f ? 1.f / norm : 0.f);
     }
-    return dist;
+
+    std::vector<top_k<track_id>> heaps(blends.size(), top_k<track_id>(std::max(topn, 0)));
+    std::vector<float> inv_norms(block_rows);
+    std::vector<float> blend_scores(block_rows);
+    matrixf scores;
+    for (size_t begin = 0; begin < lib.vectors().size(); begin += block_rows) {
+        const size_t end = std::min(begin + block_rows, lib.vectors().size());
+        lib.vectors().dot_block(endpoints, begin, end, scores);
+        for (size_t r = begin; r < end; r++) {
+            const float norm = lib.vectors().norm(r);
+            inv_norms[r - begin] = norm > 0.f ? 1.f / norm : 0.f;
+        }
+
+        for (size_t i = 0; i < blends.size(); i++) {
+            const blend &b = blends[i];
+            const float from_weight = b.alpha * inv_blend_norms[i];
+            const float to_weight = (1.0f - b.alpha) * inv_blend_norms[i];
+            const float *from_scores = scores.row(b.from).data();
+            const float *to_scores = scores.row(b.to).data();
+            for (size_t r = 0; r < end - begin; r++) {
+                blend_scores[r] = (from_weight * from_scores[r] + to_weight * to_scores[r]) * inv_norms[r];
+            }
+            push_scores(heaps[i], blend_scores.data(), begin, end - begin, excluded);
+        }
+    }
+
+    std::vector<std::vector<std::pair<track_id, float>>> result;
+    result.reserve(blends.size());
+    for (const auto &heap : heaps) {
+        result.push_back(heap.sorted());
+    }
+    return result;
 }
 
-static void simulated_annealing(const std::unordered_map<std::string, vectorf> &vecs, std::vector<std::string> &bestTour) {
-    double T = 10;
-    double coolingRate = 0.9995;
-    double absoluteTemperature = 1e-4;
+std::vector<std::pair<track_id, float>> generator::most_similar_near(const library &lib, std::span<const track_id> near,
+                                                                     const std::vector<bool> &excluded,
+                                                                     const vectorf &vec_sum, int topn) const {
+    if (!uses_graph(lib) || near.empty()) {
+        return most_similar(lib, excluded, vec_sum, topn);
+    }
 
-    std::mt19937 rng(std::random_device{}());
-    std::uniform_real_distribution<double> dist01(0.0, 1.0);
+    vectorf query = vec_sum;
+    const float query_norm = query.norm();
+    if (query_norm > 0.f) {
+        query /= query_norm;
+    }
+    const embeddings::prepared_query prepared = lib.vectors().prepare(query);
+    auto similarity = [&](track_id id) {
+        const float norm = lib.vectors().norm(id);
+        return norm > 0.f ? lib.vectors().dot(id, prepared) / norm : 0.f;
+    };
+
+    // Best-first search from the near tracks: the closest tracks found so far are expanded
+    // until the GRAPH_SEARCH_WIDTH best have all been expanded. Excluded tracks are crossed
+    // but not returned, the songs already played usually surround the next one.
+    struct entry {
+        float similarity;
+        track_id id;
+        bool expanded;
+    };
+    const size_t width = std::max(GRAPH_SEARCH_WIDTH, static_cast<size_t>(std::max(topn, 0)));
+    std::vector<entry> closest;
+    std::unordered_set<track_id> visited;
+    top_k<track_id> heap(std::max(topn, 0));
+    auto visit = [&](track_id id) {
+        if (!visited.insert(id).second) {
+            return;
+        }
+        const float sim = similarity(id);
+        if (!excluded[id]) {
+            heap.push(id, sim);
+        }
+        if (closest.size() == width && sim <= closest.back().similarity) {
+            return;
+        }
+        if (closest.size() == width) {
+            closest.pop_back();
+        }
+        auto it = std::find_if(closest.begin(), closest.end(), [&](const entry &e) { return e.similarity < sim; });
+        closest.insert(it, {sim, id, false});
+    };
 
-    std::vector<std::string> currentTour = bestTour;
-    double currentDist = total_distance(vecs, currentTour);
-    double bestDist = currentDist;
+    for (track_id id : near) {
+        visit(id);
+    }
+    while (true) {
+        auto next = std::find_if(closest.begin(), closest.end(), [](const entry &e) { return !e.expanded; });
+        if (next == closest.end()) {
+            break;
+        }
+        next->expanded = true;
+        for (track_id neighbour : lib.graph().neighbours(next->id)) {
+            visit(neighbour);
+        }
+    }
 
-    while (T > absoluteTemperature) {
-        std::vector<std::string> newTour = currentTour;
-        int i = std::rand() % newTour.size();
-        int j = std::rand() % newTour.size();
-        std::swap(newTour[i], newTour[j]);
+    query_scored += visited.size();
+    auto result = heap.sorted();
+    if (result.size() < static_cast<size_t>(topn)) {
+        return most_similar(lib, excluded, vec_sum, topn);
+    }
+    return result;
+}
 
-        double newDist = total_distance(vecs, newTour);
-        double delta = newDist - currentDist;
+std::vector<std::vector<std::pair<track_id, float>>> generator::most_similar_among(
+    const library &lib, const std::vector<track_id> &candidates, const matrixf &queries, int topn) const {
+    std::vector<std::vector<std::pair<track_id, float>>> result;
+    result.reserve(queries.rows());
+    for (Eigen::Index q = 0; q < queries.rows(); q++) {
+        vectorf query = queries.row(q);
+        const float query_norm = query.norm();
+        if (query_norm > 0.f) {
+            query /= query_norm;
+        }
+        const embeddings::prepared_query prepared = lib.vectors().prepare(query);
+        top_k<track_id> heap(std::max(topn, 0));
+        query_scored += candidates.size();
+        for (track_id id : candidates) {
+            const float norm = lib.vectors().norm(id);
+            heap.push(id, norm > 0.f ? lib.vectors().dot(id, prepared) / norm : 0.f);
+        }
+        result.push_back(heap.sorted());
+    }
+    return result;
+}
 
-        if (delta < 0 || dist01(rng) < std::exp(-delta / T)) {
-            currentTour = newTour;
-            currentDist = newDist;
-            if (currentDist < bestDist) {
-                bestTour = currentTour;
-                bestDist = currentDist;
+std::vector<track_id> generator::graph_candidates(const library &lib, std::span<const track_id> tracks,
+                                                  const std::vector<bool> &excluded) const {
+    std::vector<track_id> candidates;
+    for (track_id id : tracks) {
+        for (track_id neighbour : lib.graph().neighbours(id)) {
+            if (!excluded[neighbour]) {
+                candidates.push_back(neighbour);
             }
         }
+    }
+    std::sort(candidates.begin(), candidates.end());
+    candidates.erase(std::unique(candidates.begin(), candidates.end()), candidates.end());
+    return candidates;
+}
 
-        T *= coolingRate;
+vectorf generator::calculate_vector(const library &lib, std::span<const track_id> tracks, float noise,
+                                   std::mt19937 &rng) const {
+    vectorf vec_sum = vectorf::Zero(lib.vectors().dim());
+    for (track_id id : tracks) {
+        vec_sum += lib.vectors().row(id);
     }
+    utils::add_noise(vec_sum, noise, rng);
+    return vec_sum;
 }
 
-std::vector<std::string> generator::reorder(const std::vector<std::string> &seed_tracks, const std::string &first_song) {
-    std::vector<std::string> result = seed_tracks;
-    if (!first_song.empty() && std::find(result.begin(), result.end(), first_song) == result.end()) {
-        result.push_back(first_song);
+std::vector<std::string> generator::reorder(const std::vector<std::string> &seed_tracks, const std::string &first_song,
+                                            const reorder_options &options) const {
+    const query_scope scope(*this, "reorder");
+    const std::shared_ptr<const library> current = snapshot();
+    const library &lib = *current;
+    std::vector<std::string> tracks = seed_tracks;
+    if (!first_song.empty() && std::find(tracks.begin(), tracks.end(), first_song) == tracks.end()) {
+        tracks.push_back(first_song);
     }
 
-    remove_invalid_tracks(result);
-    if (result.empty()) {
+    remove_invalid_tracks(lib, tracks);
+    if (tracks.empty()) {
         return {};
     }
-    simulated_annealing(m_audio_vec, result);
+    const std::vector<track_id> ids = track_ids(lib, tracks);
+
+    // distances between the tracks, the path refers to positions in ids
+    const int n = ids.size();
+    const distance_matrix dist(lib.vectors(), ids);
 
-    // Rotate to bring the first song at the front of the vector
-    auto it = std::find(result.begin(), result.end(), first_song);
-    if (it != result.end()) {
-        std::rotate(result.begin(), it, result.end());
+    std::optional<int> first;
+    if (const auto first_id = lib.tracks().find(first_song); first_id.has_value()) {
+        first = std::find(ids.begin(), ids.end(), *first_id) - ids.begin();
     }
 
-    // Reverse if needed to reduce the cost from the first song
-    if (result.size() >= 3) {
-        const auto &current_vec = m_audio_vec[*result.begin()];
-        const auto &prev = *(result.end() - 1);
-        const auto &prev_vec = m_audio_vec[prev];
-        const auto &next = *(result.begin() + 1);
-        const auto &next_vec = m_audio_vec[next];
-        if (cos_distance(prev_vec, current_vec) < cos_distance(current_vec, next_vec)) {
-            std::reverse(result.begin() + 1, result.end());
-        }
+    std::vector<track_id> result;
+    result.reserve(n);
+    for (int i : solve_path(dist, first, options)) {
+        result.push_back(ids[i]);
     }
 
-    return result;
+    return track_paths(lib, result);
 }
 
 } // namespace deejai
@@ -1,45 +1,214 @@
 #pragma once
 
 #include "deejai/common.hpp"
+#include "deejai/library.hpp"
+#include "deejai/reorder.hpp"
+#include "deejai/stats.hpp"
+#include "deejai/string_table.hpp"
 
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <ostream>
+#include <random>
+#include <span>
 #include <string>
 #include <unordered_set>
 #include <vector>
 
 namespace deejai {
 
+struct reload_report {
+    double milliseconds = 0.0;
+    size_t tracks = 0;
+    // memory of the new and the previous library, both are held until the queries still
+    // running on the previous one finish
+    size_t bytes = 0;
+    size_t previous_bytes = 0;
+};
+
+struct generator_stats {
+    // time taken by the last load or reload
+    double load_milliseconds = 0.0;
+    size_t reloads = 0;
+    size_t tracks = 0;
+    // memory of the current library, and the part of it mapped from the graph file
+    size_t index_bytes = 0;
+    size_t mapped_bytes = 0;
+    // latency of the queries in microseconds, by method
+    std::map<std::string, histogram_summary> latency_us;
+    // songs scored and songs excluded from the results per query
+    histogram_summary candidates;
+    histogram_summary excluded;
+};
+
+void print_stats(std::ostream &out, const generator_stats &stats);
+// The statistics in the Prometheus text format, e.g. for the textfile collector of the
+// node exporter.
+std::string prometheus_text(const generator_stats &stats);
+
+// Generates playlists from the library of a vector directory. Every query is const, keeps
+// its random state per call and runs on the library current when it started, so one
+// generator can serve many threads while reload() swaps in a rescanned library.
 class generator {
   public:
     explicit generator(const std::string &vecs_dir);
-    ~generator() = default;
-    generator(const generator &other) = default;
-    generator &operator=(const generator &) = default;
-    generator(generator &&) = default;
-    generator &operator=(generator &&) = default;
+    ~generator();
+    generator(const generator &other);
+    generator &operator=(const generator &other);
+    // A moved-from generator may only be destroyed or assigned to.
+    generator(generator &&other) noexcept;
+    generator &operator=(generator &&other) noexcept;
 
     std::vector<std::string> generate_playlist(
         const std::string &method,
         std::vector<std::string> seed_tracks,
         int nsongs = 10,
         int lookback = 3,
-        float noise = 0.0f) const;
+        float noise = 0.0f,
+        int beam_width = 8,
+        std::optional<uint64_t> seed = std::nullopt) const;
 
     std::vector<std::pair<std::string, float>> most_similar(
         const std::unordered_set<std::string> &excluded,
         const vectorf &vec_sum,
         int topn = 5) const;
 
-    std::vector<std::string> reorder(const std::vector<std::string> &seed_tracks, const std::string &first_song = "");
+    // Scores every row of the queries matrix in one pass over the library. excluded holds
+    // one exclusion set per query, or a single set shared by all the queries; any other
+    // size throws std::invalid_argument.
+    std::vector<std::vector<std::pair<std::string, float>>> most_similar_batch(
+        const std::vector<std::unordered_set<std::string>> &excluded,
+        const matrixf &queries,
+        int topn = 5) const;
+
+    // With the graph, 'append' and 'connect' only score the neighbours of the songs they
+    // extend instead of the whole library.
+    void set_use_graph(bool use_graph);
+    bool uses_graph() const;
+
+    std::vector<std::string> reorder(const std::vector<std::string> &seed_tracks, const std::string &first_song = "",
+                                     const reorder_options &options = {}) const;
+
+    // Loads the vector directory again into a new library and swaps it in. nullopt when
+    // the bundle cannot be loaded, the current library is kept then.
+    std::optional<reload_report> reload();
+    // the library the next query runs on
+    std::shared_ptr<const library> snapshot() const;
+    const std::string &vecs_dir() const;
+
+    // load time, memory and the statistics of the queries run so far
+    generator_stats stats() const;
 
   private:
-    bool remove_invalid_tracks(std::vector<std::string> &tracks) const;
-    std::vector<std::string> generate_playlist_connect(
-        const std::vector<std::string> &seed_tracks,
-        int nsongs = 10,
-        float noise = 0.0f) const;
-    vectorf calculate_vector(const std::vector<std::string> &tracks, float noise) const;
+    friend class playlist_session;
+
+    struct counters;
+
+    // Times one public query and records the songs it scored and excluded. A query run
+    // by another one, like the session of 'append', counts as part of the outer query.
+    class query_scope {
+      public:
+        query_scope(const generator &gen, const std::string &method);
+        ~query_scope();
+        query_scope(const query_scope &) = delete;
+        query_scope &operator=(const query_scope &) = delete;
+
+        void set_excluded(size_t excluded);
+        size_t excluded() const;
+
+      private:
+        counters &m_counters;
+        histogram *m_latency;
+        std::chrono::steady_clock::time_point m_start;
+        size_t m_excluded = 0;
+        bool m_outer;
+    };
+
+    // current is the library the query pinned, an 'append' session keeps it
+    std::vector<std::string> generate_playlist(
+        const std::shared_ptr<const library> &current,
+        const std::string &method,
+        std::vector<std::string> seed_tracks,
+        int nsongs,
+        int lookback,
+        float noise,
+        int beam_width,
+        std::optional<uint64_t> seed) const;
+
+    bool uses_graph(const library &lib) const;
+    bool remove_invalid_tracks(const library &lib, std::vector<std::string> &tracks) const;
+    std::vector<track_id> track_ids(const library &lib, const std::vector<std::string> &tracks) const;
+    std::vector<std::string> track_paths(const library &lib, const std::vector<track_id> &ids) const;
+    std::vector<track_id> generate_playlist_connect(
+        const library &lib,
+        const std::vector<track_id> &seed_tracks,
+        int nsongs,
+        float noise,
+        std::mt19937 &rng) const;
+    // Keeps the beam_width smoothest partial playlists and extends each with the songs that
+    // follow its last lookback songs, like 'append'.
+    std::vector<track_id> generate_playlist_beam(
+        const library &lib,
+        const std::vector<track_id> &seed_tracks,
+        int nsongs,
+        int lookback,
+        float noise,
+        int beam_width,
+        std::mt19937 &rng) const;
+    std::vector<std::pair<track_id, float>> most_similar(
+        const library &lib,
+        const std::vector<bool> &excluded,
+        const vectorf &vec_sum,
+        int topn) const;
+    std::vector<std::vector<std::pair<track_id, float>>> most_similar_batch(
+        const library &lib,
+        const std::vector<const std::vector<bool> *> &excluded,
+        const matrixf &queries,
+        int topn) const;
+    // Like most_similar, but searches the graph outwards from the near tracks instead of
+    // scoring the whole library.
+    std::vector<std::pair<track_id, float>> most_similar_near(
+        const library &lib,
+        std::span<const track_id> near,
+        const std::vector<bool> &excluded,
+        const vectorf &vec_sum,
+        int topn) const;
+    // The blend alpha * endpoints[from] + (1 - alpha) * endpoints[to] of two rows.
+    struct blend {
+        size_t from;
+        size_t to;
+        float alpha;
+    };
+    // Like most_similar_batch for blends of a few endpoints, which are scored from the
+    // scores of the endpoints instead of one pass per blend.
+    std::vector<std::vector<std::pair<track_id, float>>> most_similar_blends(
+        const library &lib,
+        const std::vector<bool> &excluded,
+        const matrixf &endpoints,
+        const std::vector<blend> &blends,
+        int topn) const;
+    std::vector<std::vector<std::pair<track_id, float>>> most_similar_among(
+        const library &lib,
+        const std::vector<track_id> &candidates,
+        const matrixf &queries,
+        int topn) const;
+    // the graph neighbours of the tracks that are not excluded, without duplicates
+    std::vector<track_id> graph_candidates(const library &lib, std::span<const track_id> tracks,
+                                           const std::vector<bool> &excluded) const;
+    vectorf calculate_vector(const library &lib, std::span<const track_id> tracks, float noise,
+                             std::mt19937 &rng) const;
 
-    std::unordered_map<std::string, vectorf> m_audio_vec;
+    std::string m_vecs_dir;
+    mutable std::mutex m_mutex;
+    std::shared_ptr<const library> m_library;
+    // read by every query, set from any thread
+    std::atomic<bool> m_use_graph = true;
+    std::unique_ptr<counters> m_counters;
 };
 
 } // namespace deejai
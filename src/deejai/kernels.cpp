@@ -0,0 +1,892 @@
+#include "deejai/kernels.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define DEEJAI_X86_DISPATCH
+#include <immintrin.h>
+#endif
+
+#if defined(__aarch64__)
+#define DEEJAI_NEON
+#include <arm_neon.h>
+#endif
+
+namespace deejai::kernels {
+
+// power_to_db clamps the power to this floor, like librosa
+static constexpr float DB_FLOOR = 1e-10f;
+// 10 / ln(10), from the natural logarithm to decibels
+static constexpr float DB_PER_LN = 4.34294481903251828f;
+static constexpr float SQRT_HALF = 0.707106781186547524f;
+// ln(1 + m) = m - m^2 / 2 + m^3 P(m) for m in [sqrt(0.5) - 1, sqrt(2) - 1), from Cephes logf
+static constexpr float LOG_POLY[9] = {7.0376836292e-2f, -1.1514610310e-1f, 1.1676998740e-1f,
+                                      -1.2420140846e-1f, 1.4249322787e-1f, -1.6668057665e-1f,
+                                      2.0000714765e-1f, -2.4999993993e-1f, 3.3333331174e-1f};
+// ln(2) split in two, so e ln(2) adds without rounding
+static constexpr float LN2_HIGH = 0.693359375f;
+static constexpr float LN2_LOW = -2.12194440e-4f;
+
+uint16_t float_to_half(float value) {
+    uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    const uint32_t sign = (bits >> 16) & 0x8000u;
+    const uint32_t abs = bits & 0x7fffffffu;
+
+    if (abs >= 0x7f800000u) {
+        // inf or nan
+        return static_cast<uint16_t>(sign | 0x7c00u | (abs > 0x7f800000u ? 0x200u : 0u));
+    }
+    if (abs >= 0x477ff000u) {
+        // overflows after rounding
+        return static_cast<uint16_t>(sign | 0x7c00u);
+    }
+    if (abs < 0x38800000u) {
+        // subnormal half or zero
+        if (abs < 0x33000000u) {
+            return static_cast<uint16_t>(sign);
+        }
+        const uint32_t exponent = abs >> 23;
+        const uint32_t mantissa = (abs & 0x007fffffu) | 0x00800000u;
+        const uint32_t shift = 126 - exponent;
+        uint32_t half = mantissa >> shift;
+        const uint32_t rest = mantissa & ((1u << shift) - 1);
+        const uint32_t halfway = 1u << (shift - 1);
+        if (rest > halfway || (rest == halfway && (half & 1u))) {
+            half++;
+        }
+        return static_cast<uint16_t>(sign | half);
+    }
+
+    // normal, round to nearest even
+    uint32_t half = ((abs - 0x38000000u) >> 13);
+    const uint32_t rest = abs & 0x1fffu;
+    if (rest > 0x1000u || (rest == 0x1000u && (half & 1u))) {
+        half++;
+    }
+    return static_cast<uint16_t>(sign | half);
+}
+
+float half_to_float(uint16_t value) {
+    const uint32_t sign = static_cast<uint32_t>(value & 0x8000u) << 16;
+    uint32_t exponent = (value >> 10) & 0x1fu;
+    uint32_t mantissa = value & 0x3ffu;
+    uint32_t bits;
+
+    if (exponent == 0x1f) {
+        bits = sign | 0x7f800000u | (mantissa << 13);
+    } else if (exponent != 0) {
+        bits = sign | ((exponent + 112) << 23) | (mantissa << 13);
+    } else if (mantissa == 0) {
+        bits = sign;
+    } else {
+        // normalize the subnormal half
+        exponent = 113;
+        while ((mantissa & 0x400u) == 0) {
+            mantissa <<= 1;
+            exponent--;
+        }
+        bits = sign | (exponent << 23) | ((mantissa & 0x3ffu) << 13);
+    }
+
+    float result;
+    std::memcpy(&result, &bits, sizeof(result));
+    return result;
+}
+
+static float dot_f32_scalar(const float *a, const float *b, size_t n) {
+    float sum[4] = {0.f, 0.f, 0.f, 0.f};
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        sum[0] += a[i] * b[i];
+        sum[1] += a[i + 1] * b[i + 1];
+        sum[2] += a[i + 2] * b[i + 2];
+        sum[3] += a[i + 3] * b[i + 3];
+    }
+    for (; i < n; i++) {
+        sum[0] += a[i] * b[i];
+    }
+    return (sum[0] + sum[1]) + (sum[2] + sum[3]);
+}
+
+static float dot_f16_scalar(const float *a, const uint16_t *b, size_t n) {
+    float sum = 0.f;
+    for (size_t i = 0; i < n; i++) {
+        sum += a[i] * half_to_float(b[i]);
+    }
+    return sum;
+}
+
+static int32_t dot_i8_scalar(const int8_t *a, const int8_t *b, size_t n) {
+    int32_t sum = 0;
+    for (size_t i = 0; i < n; i++) {
+        sum += static_cast<int32_t>(a[i]) * static_cast<int32_t>(b[i]);
+    }
+    return sum;
+}
+
+static void dot_tile_f32_scalar(const float *a, size_t a_stride, size_t rows, const float *bt, size_t bt_stride,
+                                size_t cols, size_t dim, float *out, size_t out_stride) {
+    for (size_t i = 0; i < rows; i++) {
+        float *o = out + i * out_stride;
+        std::fill(o, o + cols, 0.f);
+        for (size_t k = 0; k < dim; k++) {
+            const float x = a[i * a_stride + k];
+            const float *b = bt + k * bt_stride;
+            for (size_t j = 0; j < cols; j++) {
+                o[j] += x * b[j];
+            }
+        }
+    }
+}
+
+static void dot_rows_f32_scalar(const float *a, size_t a_rows, const float *b, size_t b_rows, size_t dim, float *out,
+                                size_t out_stride) {
+    for (size_t i = 0; i < a_rows; i++) {
+        for (size_t j = 0; j < b_rows; j++) {
+            out[i * out_stride + j] = dot_f32_scalar(a + i * dim, b + j * dim, dim);
+        }
+    }
+}
+
+static void int16_to_float_scalar(const int16_t *in, size_t n, float scale, float *out) {
+    for (size_t i = 0; i < n; i++) {
+        out[i] = in[i] * scale;
+    }
+}
+
+static float power_to_db_scalar(const float *in, size_t n, float *out) {
+    float top = -std::numeric_limits<float>::infinity();
+    for (size_t i = 0; i < n; i++) {
+        out[i] = 10.f * std::log10(std::max(in[i], DB_FLOOR));
+        top = std::max(top, out[i]);
+    }
+    return top;
+}
+
+#ifdef DEEJAI_X86_DISPATCH
+
+__attribute__((target("sse4.2"))) static float hsum128(__m128 v) {
+    v = _mm_add_ps(v, _mm_movehl_ps(v, v));
+    v = _mm_add_ss(v, _mm_shuffle_ps(v, v, 1));
+    return _mm_cvtss_f32(v);
+}
+
+__attribute__((target("sse4.2"))) static float dot_f32_sse(const float *a, const float *b, size_t n) {
+    __m128 acc0 = _mm_setzero_ps();
+    __m128 acc1 = _mm_setzero_ps();
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        acc0 = _mm_add_ps(acc0, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+        acc1 = _mm_add_ps(acc1, _mm_mul_ps(_mm_loadu_ps(a + i + 4), _mm_loadu_ps(b + i + 4)));
+    }
+    for (; i + 4 <= n; i += 4) {
+        acc0 = _mm_add_ps(acc0, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+    }
+    float sum = hsum128(_mm_add_ps(acc0, acc1));
+    for (; i < n; i++) {
+        sum += a[i] * b[i];
+    }
+    return sum;
+}
+
+__attribute__((target("sse4.2"))) static int32_t dot_i8_sse(const int8_t *a, const int8_t *b, size_t n) {
+    __m128i acc = _mm_setzero_si128();
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m128i va = _mm_cvtepi8_epi16(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(a + i)));
+        __m128i vb = _mm_cvtepi8_epi16(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(b + i)));
+        acc = _mm_add_epi32(acc, _mm_madd_epi16(va, vb));
+    }
+    acc = _mm_add_epi32(acc, _mm_shuffle_epi32(acc, _MM_SHUFFLE(1, 0, 3, 2)));
+    acc = _mm_add_epi32(acc, _mm_shuffle_epi32(acc, _MM_SHUFFLE(2, 3, 0, 1)));
+    int32_t sum = _mm_cvtsi128_si32(acc);
+    for (; i < n; i++) {
+        sum += static_cast<int32_t>(a[i]) * static_cast<int32_t>(b[i]);
+    }
+    return sum;
+}
+
+// 4 rows by 8 columns per step
+__attribute__((target("sse4.2"))) static void dot_tile_f32_sse(const float *a, size_t a_stride, size_t rows,
+                                                              const float *bt, size_t bt_stride, size_t cols,
+                                                              size_t dim, float *out, size_t out_stride) {
+    size_t i = 0;
+    for (; i + 4 <= rows; i += 4) {
+        const float *a0 = a + i * a_stride;
+        const float *a1 = a0 + a_stride;
+        const float *a2 = a1 + a_stride;
+        const float *a3 = a2 + a_stride;
+        size_t j = 0;
+        for (; j + 8 <= cols; j += 8) {
+            __m128 c00 = _mm_setzero_ps(), c01 = _mm_setzero_ps();
+            __m128 c10 = _mm_setzero_ps(), c11 = _mm_setzero_ps();
+            __m128 c20 = _mm_setzero_ps(), c21 = _mm_setzero_ps();
+            __m128 c30 = _mm_setzero_ps(), c31 = _mm_setzero_ps();
+            for (size_t k = 0; k < dim; k++) {
+                const float *b = bt + k * bt_stride + j;
+                const __m128 b0 = _mm_loadu_ps(b);
+                const __m128 b1 = _mm_loadu_ps(b + 4);
+                __m128 x = _mm_set1_ps(a0[k]);
+                c00 = _mm_add_ps(c00, _mm_mul_ps(x, b0));
+                c01 = _mm_add_ps(c01, _mm_mul_ps(x, b1));
+                x = _mm_set1_ps(a1[k]);
+                c10 = _mm_add_ps(c10, _mm_mul_ps(x, b0));
+                c11 = _mm_add_ps(c11, _mm_mul_ps(x, b1));
+                x = _mm_set1_ps(a2[k]);
+                c20 = _mm_add_ps(c20, _mm_mul_ps(x, b0));
+                c21 = _mm_add_ps(c21, _mm_mul_ps(x, b1));
+                x = _mm_set1_ps(a3[k]);
+                c30 = _mm_add_ps(c30, _mm_mul_ps(x, b0));
+                c31 = _mm_add_ps(c31, _mm_mul_ps(x, b1));
+            }
+            float *o = out + i * out_stride + j;
+            _mm_storeu_ps(o, c00);
+            _mm_storeu_ps(o + 4, c01);
+            _mm_storeu_ps(o + out_stride, c10);
+            _mm_storeu_ps(o + out_stride + 4, c11);
+            _mm_storeu_ps(o + 2 * out_stride, c20);
+            _mm_storeu_ps(o + 2 * out_stride + 4, c21);
+            _mm_storeu_ps(o + 3 * out_stride, c30);
+            _mm_storeu_ps(o + 3 * out_stride + 4, c31);
+        }
+        if (j < cols) {
+            dot_tile_f32_scalar(a0, a_stride, 4, bt + j, bt_stride, cols - j, dim, out + i * out_stride + j, out_stride);
+        }
+    }
+    if (i < rows) {
+        dot_tile_f32_scalar(a + i * a_stride, a_stride, rows - i, bt, bt_stride, cols, dim, out + i * out_stride,
+                            out_stride);
+    }
+}
+
+__attribute__((target("sse4.2"))) static void dot_rows_f32_sse(const float *a, size_t a_rows, const float *b,
+                                                              size_t b_rows, size_t dim, float *out,
+                                                              size_t out_stride) {
+    for (size_t i = 0; i < a_rows; i++) {
+        for (size_t j = 0; j < b_rows; j++) {
+            out[i * out_stride + j] = dot_f32_sse(a + i * dim, b + j * dim, dim);
+        }
+    }
+}
+
+__attribute__((target("sse4.2"))) static void int16_to_float_sse(const int16_t *in, size_t n, float scale,
+                                                                float *out) {
+    const __m128 s = _mm_set1_ps(scale);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + i));
+        _mm_storeu_ps(out + i, _mm_mul_ps(_mm_cvtepi32_ps(_mm_cvtepi16_epi32(v)), s));
+        _mm_storeu_ps(out + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(_mm_cvtepi16_epi32(_mm_srli_si128(v, 8))), s));
+    }
+    int16_to_float_scalar(in + i, n - i, scale, out + i);
+}
+
+__attribute__((target("avx2,fma"))) static float hsum256(__m256 v) {
+    __m128 lo = _mm256_castps256_ps128(v);
+    __m128 hi = _mm256_extractf128_ps(v, 1);
+    lo = _mm_add_ps(lo, hi);
+    lo = _mm_add_ps(lo, _mm_movehl_ps(lo, lo));
+    lo = _mm_add_ss(lo, _mm_shuffle_ps(lo, lo, 1));
+    return _mm_cvtss_f32(lo);
+}
+
+__attribute__((target("avx2,fma"))) static float dot_f32_avx2(const float *a, const float *b, size_t n) {
+    __m256 acc0 = _mm256_setzero_ps();
+    __m256 acc1 = _mm256_setzero_ps();
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        acc0 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i), acc0);
+        acc1 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i + 8), _mm256_loadu_ps(b + i + 8), acc1);
+    }
+    for (; i + 8 <= n; i += 8) {
+        acc0 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i), acc0);
+    }
+    float sum = hsum256(_mm256_add_ps(acc0, acc1));
+    for (; i < n; i++) {
+        sum += a[i] * b[i];
+    }
+    return sum;
+}
+
+__attribute__((target("avx2,fma,f16c"))) static float dot_f16_avx2(const float *a, const uint16_t *b, size_t n) {
+    __m256 acc = _mm256_setzero_ps();
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256 vb = _mm256_cvtph_ps(_mm_loadu_si128(reinterpret_cast<const __m128i *>(b + i)));
+        acc = _mm256_fmadd_ps(_mm256_loadu_ps(a + i), vb, acc);
+    }
+    float sum = hsum256(acc);
+    for (; i < n; i++) {
+        sum += a[i] * half_to_float(b[i]);
+    }
+    return sum;
+}
+
+__attribute__((target("avx2"))) static int32_t hsum256_epi32(__m256i v) {
+    __m128i sum128 = _mm_add_epi32(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+    sum128 = _mm_add_epi32(sum128, _mm_shuffle_epi32(sum128, _MM_SHUFFLE(1, 0, 3, 2)));
+    sum128 = _mm_add_epi32(sum128, _mm_shuffle_epi32(sum128, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_cvtsi128_si32(sum128);
+}
+
+__attribute__((target("avx2"))) static int32_t dot_i8_avx2(const int8_t *a, const int8_t *b, size_t n) {
+    __m256i acc = _mm256_setzero_si256();
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m256i va = _mm256_cvtepi8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i *>(a + i)));
+        __m256i vb = _mm256_cvtepi8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i *>(b + i)));
+        acc = _mm256_add_epi32(acc, _mm256_madd_epi16(va, vb));
+    }
+    int32_t sum = hsum256_epi32(acc);
+    for (; i < n; i++) {
+        sum += static_cast<int32_t>(a[i]) * static_cast<int32_t>(b[i]);
+    }
+    return sum;
+}
+
+__attribute__((target("avx512f,avx512bw,avx512vnni"))) static int32_t dot_i8_avx512vnni(const int8_t *a, const int8_t *b, size_t n) {
+    __m512i acc = _mm512_setzero_si512();
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        __m512i va = _mm512_cvtepi8_epi16(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(a + i)));
+        __m512i vb = _mm512_cvtepi8_epi16(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(b + i)));
+        acc = _mm512_dpwssd_epi32(acc, va, vb);
+    }
+    int32_t sum = hsum256_epi32(_mm256_add_epi32(_mm512_castsi512_si256(acc), _mm512_extracti64x4_epi64(acc, 1)));
+    for (; i < n; i++) {
+        sum += static_cast<int32_t>(a[i]) * static_cast<int32_t>(b[i]);
+    }
+    return sum;
+}
+
+// 4 rows by 16 columns per step, the accumulators fill half of the registers
+__attribute__((target("avx2,fma"))) static void dot_tile_f32_avx2(const float *a, size_t a_stride, size_t rows,
+                                                                  const float *bt, size_t bt_stride, size_t cols,
+                                                                  size_t dim, float *out, size_t out_stride) {
+    size_t i = 0;
+    for (; i + 4 <= rows; i += 4) {
+        const float *a0 = a + i * a_stride;
+        const float *a1 = a0 + a_stride;
+        const float *a2 = a1 + a_stride;
+        const float *a3 = a2 + a_stride;
+        size_t j = 0;
+        for (; j + 16 <= cols; j += 16) {
+            __m256 c00 = _mm256_setzero_ps(), c01 = _mm256_setzero_ps();
+            __m256 c10 = _mm256_setzero_ps(), c11 = _mm256_setzero_ps();
+            __m256 c20 = _mm256_setzero_ps(), c21 = _mm256_setzero_ps();
+            __m256 c30 = _mm256_setzero_ps(), c31 = _mm256_setzero_ps();
+            for (size_t k = 0; k < dim; k++) {
+                const float *b = bt + k * bt_stride + j;
+                const __m256 b0 = _mm256_loadu_ps(b);
+                const __m256 b1 = _mm256_loadu_ps(b + 8);
+                __m256 x = _mm256_broadcast_ss(a0 + k);
+                c00 = _mm256_fmadd_ps(x, b0, c00);
+                c01 = _mm256_fmadd_ps(x, b1, c01);
+                x = _mm256_broadcast_ss(a1 + k);
+                c10 = _mm256_fmadd_ps(x, b0, c10);
+                c11 = _mm256_fmadd_ps(x, b1, c11);
+                x = _mm256_broadcast_ss(a2 + k);
+                c20 = _mm256_fmadd_ps(x, b0, c20);
+                c21 = _mm256_fmadd_ps(x, b1, c21);
+                x = _mm256_broadcast_ss(a3 + k);
+                c30 = _mm256_fmadd_ps(x, b0, c30);
+                c31 = _mm256_fmadd_ps(x, b1, c31);
+            }
+            float *o = out + i * out_stride + j;
+            _mm256_storeu_ps(o, c00);
+            _mm256_storeu_ps(o + 8, c01);
+            _mm256_storeu_ps(o + out_stride, c10);
+            _mm256_storeu_ps(o + out_stride + 8, c11);
+            _mm256_storeu_ps(o + 2 * out_stride, c20);
+            _mm256_storeu_ps(o + 2 * out_stride + 8, c21);
+            _mm256_storeu_ps(o + 3 * out_stride, c30);
+            _mm256_storeu_ps(o + 3 * out_stride + 8, c31);
+        }
+        if (j < cols) {
+            dot_tile_f32_scalar(a0, a_stride, 4, bt + j, bt_stride, cols - j, dim, out + i * out_stride + j, out_stride);
+        }
+    }
+    if (i < rows) {
+        dot_tile_f32_scalar(a + i * a_stride, a_stride, rows - i, bt, bt_stride, cols, dim, out + i * out_stride,
+                            out_stride);
+    }
+}
+
+// 4 rows of a by 2 rows of b per step, the 8 sums are reduced together at the end
+__attribute__((target("avx2,fma"))) static void dot_rows_f32_avx2(const float *a, size_t a_rows, const float *b,
+                                                                  size_t b_rows, size_t dim, float *out,
+                                                                  size_t out_stride) {
+    const size_t vec_dim = dim & ~size_t(7);
+    size_t i = 0;
+    for (; i + 4 <= a_rows; i += 4) {
+        const float *a0 = a + i * dim;
+        const float *a1 = a0 + dim;
+        const float *a2 = a1 + dim;
+        const float *a3 = a2 + dim;
+        size_t j = 0;
+        for (; j + 2 <= b_rows; j += 2) {
+            const float *b0 = b + j * dim;
+            const float *b1 = b0 + dim;
+            __m256 c00 = _mm256_setzero_ps(), c10 = _mm256_setzero_ps();
+            __m256 c20 = _mm256_setzero_ps(), c30 = _mm256_setzero_ps();
+            __m256 c01 = _mm256_setzero_ps(), c11 = _mm256_setzero_ps();
+            __m256 c21 = _mm256_setzero_ps(), c31 = _mm256_setzero_ps();
+            for (size_t k = 0; k < vec_dim; k += 8) {
+                const __m256 x0 = _mm256_loadu_ps(b0 + k);
+                const __m256 x1 = _mm256_loadu_ps(b1 + k);
+                __m256 y = _mm256_loadu_ps(a0 + k);
+                c00 = _mm256_fmadd_ps(y, x0, c00);
+                c01 = _mm256_fmadd_ps(y, x1, c01);
+                y = _mm256_loadu_ps(a1 + k);
+                c10 = _mm256_fmadd_ps(y, x0, c10);
+                c11 = _mm256_fmadd_ps(y, x1, c11);
+                y = _mm256_loadu_ps(a2 + k);
+                c20 = _mm256_fmadd_ps(y, x0, c20);
+                c21 = _mm256_fmadd_ps(y, x1, c21);
+                y = _mm256_loadu_ps(a3 + k);
+                c30 = _mm256_fmadd_ps(y, x0, c30);
+                c31 = _mm256_fmadd_ps(y, x1, c31);
+            }
+            // sums of rows 0-3 of a against b0, then against b1
+            const __m256 h0 = _mm256_hadd_ps(_mm256_hadd_ps(c00, c10), _mm256_hadd_ps(c20, c30));
+            const __m256 h1 = _mm256_hadd_ps(_mm256_hadd_ps(c01, c11), _mm256_hadd_ps(c21, c31));
+            float s0[4], s1[4];
+            _mm_storeu_ps(s0, _mm_add_ps(_mm256_castps256_ps128(h0), _mm256_extractf128_ps(h0, 1)));
+            _mm_storeu_ps(s1, _mm_add_ps(_mm256_castps256_ps128(h1), _mm256_extractf128_ps(h1, 1)));
+            const float *rows[4] = {a0, a1, a2, a3};
+            for (int r = 0; r < 4; r++) {
+                for (size_t k = vec_dim; k < dim; k++) {
+                    s0[r] += rows[r][k] * b0[k];
+                    s1[r] += rows[r][k] * b1[k];
+                }
+                out[(i + r) * out_stride + j] = s0[r];
+                out[(i + r) * out_stride + j + 1] = s1[r];
+            }
+        }
+        for (; j < b_rows; j++) {
+            for (int r = 0; r < 4; r++) {
+                out[(i + r) * out_stride + j] = dot_f32_avx2(a0 + r * dim, b + j * dim, dim);
+            }
+        }
+    }
+    for (; i < a_rows; i++) {
+        for (size_t j = 0; j < b_rows; j++) {
+            out[i * out_stride + j] = dot_f32_avx2(a + i * dim, b + j * dim, dim);
+        }
+    }
+}
+
+__attribute__((target("avx2"))) static void int16_to_float_avx2(const int16_t *in, size_t n, float scale,
+                                                                float *out) {
+    const __m256 s = _mm256_set1_ps(scale);
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(in + i));
+        const __m256i lo = _mm256_cvtepi16_epi32(_mm256_castsi256_si128(v));
+        const __m256i hi = _mm256_cvtepi16_epi32(_mm256_extracti128_si256(v, 1));
+        _mm256_storeu_ps(out + i, _mm256_mul_ps(_mm256_cvtepi32_ps(lo), s));
+        _mm256_storeu_ps(out + i + 8, _mm256_mul_ps(_mm256_cvtepi32_ps(hi), s));
+    }
+    int16_to_float_scalar(in + i, n - i, scale, out + i);
+}
+
+// natural logarithm of positive normal floats, within 2 ulp of std::log
+__attribute__((target("avx2,fma"))) static __m256 log_avx2(__m256 x) {
+    const __m256i bits = _mm256_castps_si256(x);
+    const __m256 one = _mm256_set1_ps(1.f);
+    // x = 2^e m with m in [0.5, 1)
+    __m256 e = _mm256_cvtepi32_ps(_mm256_sub_epi32(_mm256_srli_epi32(bits, 23), _mm256_set1_epi32(126)));
+    __m256 m = _mm256_castsi256_ps(
+        _mm256_or_si256(_mm256_and_si256(bits, _mm256_set1_epi32(0x007fffff)), _mm256_set1_epi32(0x3f000000)));
+    // then m - 1 in [sqrt(0.5) - 1, sqrt(2) - 1)
+    const __m256 small = _mm256_cmp_ps(m, _mm256_set1_ps(SQRT_HALF), _CMP_LT_OQ);
+    e = _mm256_sub_ps(e, _mm256_and_ps(small, one));
+    m = _mm256_add_ps(_mm256_sub_ps(m, one), _mm256_and_ps(small, m));
+
+    const __m256 z = _mm256_mul_ps(m, m);
+    __m256 y = _mm256_set1_ps(LOG_POLY[0]);
+    for (int k = 1; k < 9; k++) {
+        y = _mm256_fmadd_ps(y, m, _mm256_set1_ps(LOG_POLY[k]));
+    }
+    y = _mm256_mul_ps(_mm256_mul_ps(y, m), z);
+    y = _mm256_fmadd_ps(e, _mm256_set1_ps(LN2_LOW), y);
+    y = _mm256_fnmadd_ps(z, _mm256_set1_ps(0.5f), y);
+    return _mm256_fmadd_ps(e, _mm256_set1_ps(LN2_HIGH), _mm256_add_ps(m, y));
+}
+
+__attribute__((target("avx2,fma"))) static float power_to_db_avx2(const float *in, size_t n, float *out) {
+    const __m256 floor = _mm256_set1_ps(DB_FLOOR);
+    const __m256 scale = _mm256_set1_ps(DB_PER_LN);
+    __m256 top = _mm256_set1_ps(-std::numeric_limits<float>::infinity());
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        const __m256 db = _mm256_mul_ps(log_avx2(_mm256_max_ps(_mm256_loadu_ps(in + i), floor)), scale);
+        _mm256_storeu_ps(out + i, db);
+        top = _mm256_max_ps(top, db);
+    }
+    float lanes[8];
+    _mm256_storeu_ps(lanes, top);
+    return std::max(*std::max_element(lanes, lanes + 8), power_to_db_scalar(in + i, n - i, out + i));
+}
+
+__attribute__((target("avx512f"))) static float dot_f32_avx512(const float *a, const float *b, size_t n) {
+    __m512 acc0 = _mm512_setzero_ps();
+    __m512 acc1 = _mm512_setzero_ps();
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        acc0 = _mm512_fmadd_ps(_mm512_loadu_ps(a + i), _mm512_loadu_ps(b + i), acc0);
+        acc1 = _mm512_fmadd_ps(_mm512_loadu_ps(a + i + 16), _mm512_loadu_ps(b + i + 16), acc1);
+    }
+    for (; i + 16 <= n; i += 16) {
+        acc0 = _mm512_fmadd_ps(_mm512_loadu_ps(a + i), _mm512_loadu_ps(b + i), acc0);
+    }
+    if (i < n) {
+        // the masked lanes load as zero
+        const __mmask16 mask = static_cast<__mmask16>((1u << (n - i)) - 1);
+        acc1 = _mm512_fmadd_ps(_mm512_maskz_loadu_ps(mask, a + i), _mm512_maskz_loadu_ps(mask, b + i), acc1);
+    }
+    return _mm512_reduce_add_ps(_mm512_add_ps(acc0, acc1));
+}
+
+// 4 rows by 32 columns per step, the rest of the columns and rows go to the AVX2 tile
+__attribute__((target("avx512f,avx2,fma"))) static void dot_tile_f32_avx512(const float *a, size_t a_stride,
+                                                                           size_t rows, const float *bt,
+                                                                           size_t bt_stride, size_t cols, size_t dim,
+                                                                           float *out, size_t out_stride) {
+    size_t i = 0;
+    for (; i + 4 <= rows; i += 4) {
+        const float *a0 = a + i * a_stride;
+        const float *a1 = a0 + a_stride;
+        const float *a2 = a1 + a_stride;
+        const float *a3 = a2 + a_stride;
+        size_t j = 0;
+        for (; j + 32 <= cols; j += 32) {
+            __m512 c00 = _mm512_setzero_ps(), c01 = _mm512_setzero_ps();
+            __m512 c10 = _mm512_setzero_ps(), c11 = _mm512_setzero_ps();
+            __m512 c20 = _mm512_setzero_ps(), c21 = _mm512_setzero_ps();
+            __m512 c30 = _mm512_setzero_ps(), c31 = _mm512_setzero_ps();
+            for (size_t k = 0; k < dim; k++) {
+                const float *b = bt + k * bt_stride + j;
+                const __m512 b0 = _mm512_loadu_ps(b);
+                const __m512 b1 = _mm512_loadu_ps(b + 16);
+                __m512 x = _mm512_set1_ps(a0[k]);
+                c00 = _mm512_fmadd_ps(x, b0, c00);
+                c01 = _mm512_fmadd_ps(x, b1, c01);
+                x = _mm512_set1_ps(a1[k]);
+                c10 = _mm512_fmadd_ps(x, b0, c10);
+                c11 = _mm512_fmadd_ps(x, b1, c11);
+                x = _mm512_set1_ps(a2[k]);
+                c20 = _mm512_fmadd_ps(x, b0, c20);
+                c21 = _mm512_fmadd_ps(x, b1, c21);
+                x = _mm512_set1_ps(a3[k]);
+                c30 = _mm512_fmadd_ps(x, b0, c30);
+                c31 = _mm512_fmadd_ps(x, b1, c31);
+            }
+            float *o = out + i * out_stride + j;
+            _mm512_storeu_ps(o, c00);
+            _mm512_storeu_ps(o + 16, c01);
+            _mm512_storeu_ps(o + out_stride, c10);
+            _mm512_storeu_ps(o + out_stride + 16, c11);
+            _mm512_storeu_ps(o + 2 * out_stride, c20);
+            _mm512_storeu_ps(o + 2 * out_stride + 16, c21);
+            _mm512_storeu_ps(o + 3 * out_stride, c30);
+            _mm512_storeu_ps(o + 3 * out_stride + 16, c31);
+        }
+        if (j < cols) {
+            dot_tile_f32_avx2(a0, a_stride, 4, bt + j, bt_stride, cols - j, dim, out + i * out_stride + j, out_stride);
+        }
+    }
+    if (i < rows) {
+        dot_tile_f32_avx2(a + i * a_stride, a_stride, rows - i, bt, bt_stride, cols, dim, out + i * out_stride,
+                          out_stride);
+    }
+}
+
+__attribute__((target("avx512f,avx2"))) static void int16_to_float_avx512(const int16_t *in, size_t n, float scale,
+                                                                         float *out) {
+    const __m512 s = _mm512_set1_ps(scale);
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(in + i));
+        _mm512_storeu_ps(out + i, _mm512_mul_ps(_mm512_cvtepi32_ps(_mm512_cvtepi16_epi32(v)), s));
+    }
+    int16_to_float_scalar(in + i, n - i, scale, out + i);
+}
+
+// log_avx2 on 16 lanes
+__attribute__((target("avx512f"))) static __m512 log_avx512(__m512 x) {
+    const __m512i bits = _mm512_castps_si512(x);
+    const __m512 one = _mm512_set1_ps(1.f);
+    __m512 e = _mm512_cvtepi32_ps(_mm512_sub_epi32(_mm512_srli_epi32(bits, 23), _mm512_set1_epi32(126)));
+    const __m512 mantissa = _mm512_castsi512_ps(
+        _mm512_or_si512(_mm512_and_si512(bits, _mm512_set1_epi32(0x007fffff)), _mm512_set1_epi32(0x3f000000)));
+    const __mmask16 small = _mm512_cmp_ps_mask(mantissa, _mm512_set1_ps(SQRT_HALF), _CMP_LT_OQ);
+    e = _mm512_mask_sub_ps(e, small, e, one);
+    __m512 m = _mm512_sub_ps(mantissa, one);
+    m = _mm512_mask_add_ps(m, small, m, mantissa);
+
+    const __m512 z = _mm512_mul_ps(m, m);
+    __m512 y = _mm512_set1_ps(LOG_POLY[0]);
+    for (int k = 1; k < 9; k++) {
+        y = _mm512_fmadd_ps(y, m, _mm512_set1_ps(LOG_POLY[k]));
+    }
+    y = _mm512_mul_ps(_mm512_mul_ps(y, m), z);
+    y = _mm512_fmadd_ps(e, _mm512_set1_ps(LN2_LOW), y);
+    y = _mm512_fnmadd_ps(z, _mm512_set1_ps(0.5f), y);
+    return _mm512_fmadd_ps(e, _mm512_set1_ps(LN2_HIGH), _mm512_add_ps(m, y));
+}
+
+__attribute__((target("avx512f"))) static float power_to_db_avx512(const float *in, size_t n, float *out) {
+    const __m512 floor = _mm512_set1_ps(DB_FLOOR);
+    const __m512 scale = _mm512_set1_ps(DB_PER_LN);
+    __m512 top = _mm512_set1_ps(-std::numeric_limits<float>::infinity());
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        const __m512 db = _mm512_mul_ps(log_avx512(_mm512_max_ps(_mm512_loadu_ps(in + i), floor)), scale);
+        _mm512_storeu_ps(out + i, db);
+        top = _mm512_max_ps(top, db);
+    }
+    return std::max(_mm512_reduce_max_ps(top), power_to_db_scalar(in + i, n - i, out + i));
+}
+
+#endif // DEEJAI_X86_DISPATCH
+
+#ifdef DEEJAI_NEON
+
+static float dot_f32_neon(const float *a, const float *b, size_t n) {
+    float32x4_t acc0 = vdupq_n_f32(0.f);
+    float32x4_t acc1 = vdupq_n_f32(0.f);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        acc0 = vfmaq_f32(acc0, vld1q_f32(a + i), vld1q_f32(b + i));
+        acc1 = vfmaq_f32(acc1, vld1q_f32(a + i + 4), vld1q_f32(b + i + 4));
+    }
+    float sum = vaddvq_f32(vaddq_f32(acc0, acc1));
+    for (; i < n; i++) {
+        sum += a[i] * b[i];
+    }
+    return sum;
+}
+
+static float dot_f16_neon(const float *a, const uint16_t *b, size_t n) {
+    float32x4_t acc = vdupq_n_f32(0.f);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        float32x4_t vb = vcvt_f32_f16(vreinterpret_f16_u16(vld1_u16(b + i)));
+        acc = vfmaq_f32(acc, vld1q_f32(a + i), vb);
+    }
+    float sum = vaddvq_f32(acc);
+    for (; i < n; i++) {
+        sum += a[i] * half_to_float(b[i]);
+    }
+    return sum;
+}
+
+static int32_t dot_i8_neon(const int8_t *a, const int8_t *b, size_t n) {
+    int32x4_t acc = vdupq_n_s32(0);
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        int8x16_t va = vld1q_s8(a + i);
+        int8x16_t vb = vld1q_s8(b + i);
+        acc = vpadalq_s16(acc, vmull_s8(vget_low_s8(va), vget_low_s8(vb)));
+        acc = vpadalq_s16(acc, vmull_high_s8(va, vb));
+    }
+    int32_t sum = vaddvq_s32(acc);
+    for (; i < n; i++) {
+        sum += static_cast<int32_t>(a[i]) * static_cast<int32_t>(b[i]);
+    }
+    return sum;
+}
+
+// 4 rows by 8 columns per step
+static void dot_tile_f32_neon(const float *a, size_t a_stride, size_t rows, const float *bt, size_t bt_stride,
+                              size_t cols, size_t dim, float *out, size_t out_stride) {
+    size_t i = 0;
+    for (; i + 4 <= rows; i += 4) {
+        const float *a0 = a + i * a_stride;
+        const float *a1 = a0 + a_stride;
+        const float *a2 = a1 + a_stride;
+        const float *a3 = a2 + a_stride;
+        size_t j = 0;
+        for (; j + 8 <= cols; j += 8) {
+            float32x4_t c00 = vdupq_n_f32(0.f), c01 = vdupq_n_f32(0.f);
+            float32x4_t c10 = vdupq_n_f32(0.f), c11 = vdupq_n_f32(0.f);
+            float32x4_t c20 = vdupq_n_f32(0.f), c21 = vdupq_n_f32(0.f);
+            float32x4_t c30 = vdupq_n_f32(0.f), c31 = vdupq_n_f32(0.f);
+            for (size_t k = 0; k < dim; k++) {
+                const float *b = bt + k * bt_stride + j;
+                const float32x4_t b0 = vld1q_f32(b);
+                const float32x4_t b1 = vld1q_f32(b + 4);
+                c00 = vfmaq_n_f32(c00, b0, a0[k]);
+                c01 = vfmaq_n_f32(c01, b1, a0[k]);
+                c10 = vfmaq_n_f32(c10, b0, a1[k]);
+                c11 = vfmaq_n_f32(c11, b1, a1[k]);
+                c20 = vfmaq_n_f32(c20, b0, a2[k]);
+                c21 = vfmaq_n_f32(c21, b1, a2[k]);
+                c30 = vfmaq_n_f32(c30, b0, a3[k]);
+                c31 = vfmaq_n_f32(c31, b1, a3[k]);
+            }
+            float *o = out + i * out_stride + j;
+            vst1q_f32(o, c00);
+            vst1q_f32(o + 4, c01);
+            vst1q_f32(o + out_stride, c10);
+            vst1q_f32(o + out_stride + 4, c11);
+            vst1q_f32(o + 2 * out_stride, c20);
+            vst1q_f32(o + 2 * out_stride + 4, c21);
+            vst1q_f32(o + 3 * out_stride, c30);
+            vst1q_f32(o + 3 * out_stride + 4, c31);
+        }
+        if (j < cols) {
+            dot_tile_f32_scalar(a0, a_stride, 4, bt + j, bt_stride, cols - j, dim, out + i * out_stride + j, out_stride);
+        }
+    }
+    if (i < rows) {
+        dot_tile_f32_scalar(a + i * a_stride, a_stride, rows - i, bt, bt_stride, cols, dim, out + i * out_stride,
+                            out_stride);
+    }
+}
+
+// 4 rows of a by 2 rows of b per step
+static void dot_rows_f32_neon(const float *a, size_t a_rows, const float *b, size_t b_rows, size_t dim, float *out,
+                              size_t out_stride) {
+    const size_t vec_dim = dim & ~size_t(3);
+    size_t i = 0;
+    for (; i + 4 <= a_rows; i += 4) {
+        const float *rows[4] = {a + i * dim, a + (i + 1) * dim, a + (i + 2) * dim, a + (i + 3) * dim};
+        size_t j = 0;
+        for (; j + 2 <= b_rows; j += 2) {
+            const float *b0 = b + j * dim;
+            const float *b1 = b0 + dim;
+            float32x4_t c0[4], c1[4];
+            for (int r = 0; r < 4; r++) {
+                c0[r] = vdupq_n_f32(0.f);
+                c1[r] = vdupq_n_f32(0.f);
+            }
+            for (size_t k = 0; k < vec_dim; k += 4) {
+                const float32x4_t x0 = vld1q_f32(b0 + k);
+                const float32x4_t x1 = vld1q_f32(b1 + k);
+                for (int r = 0; r < 4; r++) {
+                    const float32x4_t y = vld1q_f32(rows[r] + k);
+                    c0[r] = vfmaq_f32(c0[r], y, x0);
+                    c1[r] = vfmaq_f32(c1[r], y, x1);
+                }
+            }
+            for (int r = 0; r < 4; r++) {
+                float s0 = vaddvq_f32(c0[r]);
+                float s1 = vaddvq_f32(c1[r]);
+                for (size_t k = vec_dim; k < dim; k++) {
+                    s0 += rows[r][k] * b0[k];
+                    s1 += rows[r][k] * b1[k];
+                }
+                out[(i + r) * out_stride + j] = s0;
+                out[(i + r) * out_stride + j + 1] = s1;
+            }
+        }
+        for (; j < b_rows; j++) {
+            for (int r = 0; r < 4; r++) {
+                out[(i + r) * out_stride + j] = dot_f32_neon(rows[r], b + j * dim, dim);
+            }
+        }
+    }
+    for (; i < a_rows; i++) {
+        for (size_t j = 0; j < b_rows; j++) {
+            out[i * out_stride + j] = dot_f32_neon(a + i * dim, b + j * dim, dim);
+        }
+    }
+}
+
+static void int16_to_float_neon(const int16_t *in, size_t n, float scale, float *out) {
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        const int16x8_t v = vld1q_s16(in + i);
+        vst1q_f32(out + i, vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_low_s16(v))), scale));
+        vst1q_f32(out + i + 4, vmulq_n_f32(vcvtq_f32_s32(vmovl_high_s16(v)), scale));
+    }
+    int16_to_float_scalar(in + i, n - i, scale, out + i);
+}
+
+// natural logarithm of positive normal floats, like log_avx2
+static float32x4_t log_neon(float32x4_t x) {
+    const int32x4_t bits = vreinterpretq_s32_f32(x);
+    const float32x4_t one = vdupq_n_f32(1.f);
+    float32x4_t e = vcvtq_f32_s32(vsubq_s32(vshrq_n_s32(bits, 23), vdupq_n_s32(126)));
+    float32x4_t m =
+        vreinterpretq_f32_s32(vorrq_s32(vandq_s32(bits, vdupq_n_s32(0x007fffff)), vdupq_n_s32(0x3f000000)));
+    const uint32x4_t small = vcltq_f32(m, vdupq_n_f32(SQRT_HALF));
+    e = vsubq_f32(e, vreinterpretq_f32_u32(vandq_u32(small, vreinterpretq_u32_f32(one))));
+    m = vaddq_f32(vsubq_f32(m, one), vreinterpretq_f32_u32(vandq_u32(small, vreinterpretq_u32_f32(m))));
+
+    const float32x4_t z = vmulq_f32(m, m);
+    float32x4_t y = vdupq_n_f32(LOG_POLY[0]);
+    for (int k = 1; k < 9; k++) {
+        y = vfmaq_f32(vdupq_n_f32(LOG_POLY[k]), y, m);
+    }
+    y = vmulq_f32(vmulq_f32(y, m), z);
+    y = vfmaq_f32(y, e, vdupq_n_f32(LN2_LOW));
+    y = vfmsq_f32(y, z, vdupq_n_f32(0.5f));
+    return vfmaq_f32(vaddq_f32(m, y), e, vdupq_n_f32(LN2_HIGH));
+}
+
+static float power_to_db_neon(const float *in, size_t n, float *out) {
+    const float32x4_t floor = vdupq_n_f32(DB_FLOOR);
+    float32x4_t top = vdupq_n_f32(-std::numeric_limits<float>::infinity());
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        const float32x4_t db = vmulq_n_f32(log_neon(vmaxq_f32(vld1q_f32(in + i), floor)), DB_PER_LN);
+        vst1q_f32(out + i, db);
+        top = vmaxq_f32(top, db);
+    }
+    return std::max(vmaxvq_f32(top), power_to_db_scalar(in + i, n - i, out + i));
+}
+
+#endif // DEEJAI_NEON
+
+std::vector<kernel_table> supported() {
+    std::vector<kernel_table> tables = {{"scalar", dot_f32_scalar, dot_f16_scalar, dot_i8_scalar, dot_tile_f32_scalar,
+                                         dot_rows_f32_scalar, int16_to_float_scalar, power_to_db_scalar}};
+#ifdef DEEJAI_X86_DISPATCH
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse4.2")) {
+        tables.push_back({"sse4.2", dot_f32_sse, dot_f16_scalar, dot_i8_sse, dot_tile_f32_sse, dot_rows_f32_sse,
+                          int16_to_float_sse, power_to_db_scalar});
+    }
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma") && __builtin_cpu_supports("f16c")) {
+        tables.push_back({"avx2", dot_f32_avx2, dot_f16_avx2, dot_i8_avx2, dot_tile_f32_avx2, dot_rows_f32_avx2,
+                          int16_to_float_avx2, power_to_db_avx2});
+        if (__builtin_cpu_supports("avx512f")) {
+            kernel_table table = tables.back();
+            table.name = "avx512";
+            table.dot_f32 = dot_f32_avx512;
+            table.dot_tile_f32 = dot_tile_f32_avx512;
+            table.int16_to_float = int16_to_float_avx512;
+            table.power_to_db = power_to_db_avx512;
+            if (__builtin_cpu_supports("avx512vnni") && __builtin_cpu_supports("avx512bw")) {
+                table.name = "avx512-vnni";
+                table.dot_i8 = dot_i8_avx512vnni;
+            }
+            tables.push_back(table);
+        }
+    }
+#endif // DEEJAI_X86_DISPATCH
+#ifdef DEEJAI_NEON
+    tables.push_back({"neon", dot_f32_neon, dot_f16_neon, dot_i8_neon, dot_tile_f32_neon, dot_rows_f32_neon,
+                      int16_to_float_neon, power_to_db_neon});
+#endif // DEEJAI_NEON
+    return tables;
+}
+
+static kernel_table select_kernels() {
+    return supported().back();
+}
+
+const kernel_table &active() {
+    static const kernel_table table = select_kernels();
+    return table;
+}
+
+} // namespace deejai::kernels
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace deejai::kernels {
+
+// Vector kernels of similarity scoring, the reorder distances and the scan frontend. The
+// implementation is chosen once at startup from the features of the running CPU, so a
+// portable build still uses the widest vector unit available.
+struct kernel_table {
+    const char *name;
+    float (*dot_f32)(const float *a, const float *b, size_t n);
+    float (*dot_f16)(const float *a, const uint16_t *b, size_t n);
+    int32_t (*dot_i8)(const int8_t *a, const int8_t *b, size_t n);
+    // out[i][j] = dot(a[i], column j of bt) for a block of rows against a transposed block,
+    // bt holds dim rows of cols values
+    void (*dot_tile_f32)(const float *a, size_t a_stride, size_t rows, const float *bt, size_t bt_stride, size_t cols,
+                         size_t dim, float *out, size_t out_stride);
+    // out[i][j] = dot(a[i], b[j]) with both blocks stored by rows of dim values
+    void (*dot_rows_f32)(const float *a, size_t a_rows, const float *b, size_t b_rows, size_t dim, float *out,
+                         size_t out_stride);
+    // out[i] = in[i] * scale, for 16 bit PCM samples
+    void (*int16_to_float)(const int16_t *in, size_t n, float scale, float *out);
+    // out[i] = 10 log10(max(in[i], 1e-10)), returns the largest out[i]
+    float (*power_to_db)(const float *in, size_t n, float *out);
+};
+
+const kernel_table &active();
+// every implementation the running CPU supports, from the narrowest to the active one
+std::vector<kernel_table> supported();
+
+inline float dot_f32(const float *a, const float *b, size_t n) {
+    return active().dot_f32(a, b, n);
+}
+
+inline float dot_f16(const float *a, const uint16_t *b, size_t n) {
+    return active().dot_f16(a, b, n);
+}
+
+inline int32_t dot_i8(const int8_t *a, const int8_t *b, size_t n) {
+    return active().dot_i8(a, b, n);
+}
+
+inline void dot_tile_f32(const float *a, size_t a_stride, size_t rows, const float *bt, size_t bt_stride, size_t cols,
+                         size_t dim, float *out, size_t out_stride) {
+    active().dot_tile_f32(a, a_stride, rows, bt, bt_stride, cols, dim, out, out_stride);
+}
+
+inline void dot_rows_f32(const float *a, size_t a_rows, const float *b, size_t b_rows, size_t dim, float *out,
+                         size_t out_stride) {
+    active().dot_rows_f32(a, a_rows, b, b_rows, dim, out, out_stride);
+}
+
+inline void int16_to_float(const int16_t *in, size_t n, float scale, float *out) {
+    active().int16_to_float(in, n, scale, out);
+}
+
+inline float power_to_db(const float *in, size_t n, float *out) {
+    return active().power_to_db(in, n, out);
+}
+
+uint16_t float_to_half(float value);
+float half_to_float(uint16_t value);
+
+} // namespace deejai::kernels
@@ -0,0 +1,387 @@
+#include "deejai/knn_graph.hpp"
+#include "deejai/top_k.hpp"
+#include "deejai/utils.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <numeric>
+#include <queue>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace deejai {
+
+// The file holds the header, the n + 1 row offsets, then the neighbour ids and their
+// similarities. Every array starts aligned to its element size, so the mapped file is
+// used in place.
+static constexpr char GRAPH_MAGIC[8] = {'D', 'J', 'A', 'I', 'K', 'N', 'N', '1'};
+
+struct graph_header {
+    char magic[8];
+    uint64_t size;
+    uint32_t k;
+    uint32_t reserved;
+    uint64_t bundle_checksum;
+};
+static_assert(sizeof(graph_header) == 32);
+
+// rows of the library scored per block, as in generator::most_similar_batch
+static constexpr size_t BLOCK_ROWS = 256;
+// previous_ids entry of a track that is not in the new bundle
+static constexpr track_id REMOVED_TRACK = UINT32_MAX;
+
+// The arrays of a graph being built, in the buffer that becomes its storage. Every row
+// holds exactly kept neighbours.
+struct graph_arrays {
+    std::shared_ptr<std::vector<uint64_t>> buffer;
+    char *data = nullptr;
+    size_t bytes = 0;
+    track_id *neighbours = nullptr;
+    float *similarities = nullptr;
+};
+
+static graph_arrays allocate_graph(size_t n, size_t kept, uint64_t bundle_checksum) {
+    const size_t edges = n * kept;
+    graph_arrays graph;
+    graph.bytes = sizeof(graph_header) + (n + 1) * sizeof(uint64_t) + edges * (sizeof(track_id) + sizeof(float));
+    // uint64_t elements keep the offsets aligned
+    graph.buffer = std::make_shared<std::vector<uint64_t>>((graph.bytes + sizeof(uint64_t) - 1) / sizeof(uint64_t));
+    graph.data = reinterpret_cast<char *>(graph.buffer->data());
+    graph_header header = {};
+    std::memcpy(header.magic, GRAPH_MAGIC, sizeof(GRAPH_MAGIC));
+    header.size = n;
+    header.k = static_cast<uint32_t>(kept);
+    header.bundle_checksum = bundle_checksum;
+    std::memcpy(graph.data, &header, sizeof(header));
+
+    uint64_t *offsets = reinterpret_cast<uint64_t *>(graph.data + sizeof(graph_header));
+    graph.neighbours = reinterpret_cast<track_id *>(offsets + n + 1);
+    graph.similarities = reinterpret_cast<float *>(graph.neighbours + edges);
+    for (size_t i = 0; i <= n; i++) {
+        offsets[i] = i * kept;
+    }
+    return graph;
+}
+
+static std::vector<float> inverse_norms(const embeddings &vectors) {
+    std::vector<float> inv_norms(vectors.size());
+    for (size_t i = 0; i < vectors.size(); i++) {
+        const float norm = vectors.norm(i);
+        inv_norms[i] = norm > 0.f ? 1.f / norm : 0.f;
+    }
+    return inv_norms;
+}
+
+// Fills the neighbours of rows on jobs threads, a block of rows at a time. Without
+// columns every row is scored against the whole library, with them only against those
+// tracks, on top of the neighbours seed puts in the heap of the row.
+static void fill_rows(const embeddings &vectors, const std::vector<float> &inv_norms, const std::vector<track_id> &rows,
+                      const std::vector<track_id> *columns,
+                      const std::function<void(track_id, top_k<track_id> &)> &seed, const graph_arrays &graph,
+                      size_t kept, size_t jobs) {
+    const size_t n = vectors.size();
+    // the normalized columns, scored as one matrix since they are not contiguous rows
+    matrixf column_vectors;
+    if (columns != nullptr) {
+        column_vectors.resize(columns->size(), vectors.dim());
+        for (size_t c = 0; c < columns->size(); c++) {
+            const track_id id = (*columns)[c];
+            column_vectors.row(c) = vectors.row(id) * inv_norms[id];
+        }
+    }
+    const bool score_columns = columns == nullptr || !columns->empty();
+
+    // each worker takes a block of rows and scores it against the columns
+    const size_t num_blocks = (rows.size() + BLOCK_ROWS - 1) / BLOCK_ROWS;
+    std::atomic<size_t> next_block = 0;
+    auto worker = [&]() {
+        matrixf queries;
+        matrixf scores;
+        for (size_t block = next_block++; block < num_blocks; block = next_block++) {
+            const size_t begin = block * BLOCK_ROWS;
+            const size_t end = std::min(begin + BLOCK_ROWS, rows.size());
+            std::vector<top_k<track_id>> heaps(end - begin, top_k<track_id>(kept));
+            if (seed) {
+                for (size_t q = begin; q < end; q++) {
+                    seed(rows[q], heaps[q - begin]);
+                }
+            }
+
+            if (score_columns) {
+                queries.resize(end - begin, vectors.dim());
+                for (size_t q = begin; q < end; q++) {
+                    queries.row(q - begin) = vectors.row(rows[q]) * inv_norms[rows[q]];
+                }
+            }
+            const size_t num_columns = columns != nullptr ? columns->size() : n;
+            for (size_t col = 0; score_columns && col < num_columns; col += BLOCK_ROWS) {
+                const size_t col_end = std::min(col + BLOCK_ROWS, num_columns);
+                if (columns != nullptr) {
+                    scores.noalias() = queries * column_vectors.middleRows(col, col_end - col).transpose();
+                } else {
+                    vectors.dot_block(queries, col, col_end, scores);
+                }
+                for (size_t q = 0; q < end - begin; q++) {
+                    const float *row_scores = scores.row(q).data();
+                    const track_id self = rows[begin + q];
+                    top_k<track_id> &heap = heaps[q];
+                    float threshold = heap.threshold();
+                    for (size_t c = col; c < col_end; c++) {
+                        const track_id id = columns != nullptr ? (*columns)[c] : static_cast<track_id>(c);
+                        const float score = columns != nullptr ? row_scores[c - col] : row_scores[c - col] * inv_norms[c];
+                        if (score > threshold && id != self) {
+                            heap.push(id, score);
+                            threshold = heap.threshold();
+                        }
+                    }
+                }
+            }
+
+            for (size_t q = 0; q < end - begin; q++) {
+                size_t edge = static_cast<size_t>(rows[begin + q]) * kept;
+                for (const auto &[id, sim] : heaps[q].sorted()) {
+                    graph.neighbours[edge] = id;
+                    graph.similarities[edge] = sim;
+                    edge++;
+                }
+            }
+        }
+    };
+
+    const size_t num_threads = std::max<size_t>(1, std::min(jobs, num_blocks));
+    std::vector<std::thread> threads;
+    for (size_t t = 1; t < num_threads; t++) {
+        threads.emplace_back(worker);
+    }
+    worker();
+    for (auto &thread : threads) {
+        thread.join();
+    }
+}
+
+size_t knn_graph::kept_neighbours(size_t size, int k) {
+    return size > 1 ? std::min(static_cast<size_t>(std::max(k, 0)), size - 1) : 0;
+}
+
+knn_graph knn_graph::build(const embeddings &vectors, int k, uint64_t bundle_checksum, size_t jobs) {
+    const size_t n = vectors.size();
+    const size_t kept = kept_neighbours(n, k);
+    const graph_arrays arrays = allocate_graph(n, kept, bundle_checksum);
+    std::vector<track_id> rows(n);
+    std::iota(rows.begin(), rows.end(), 0);
+    fill_rows(vectors, inverse_norms(vectors), rows, nullptr, nullptr, arrays, kept, jobs);
+    knn_graph graph;
+    graph.attach(arrays.buffer, arrays.data, arrays.bytes);
+    return graph;
+}
+
+knn_graph knn_graph::update(const knn_graph &previous, const std::vector<track_id> &previous_ids,
+                            const embeddings &vectors, int k, uint64_t bundle_checksum, size_t jobs) {
+    const size_t n = vectors.size();
+    const size_t kept = kept_neighbours(n, k);
+    if (previous.size() != previous_ids.size() || static_cast<size_t>(previous.k()) != kept) {
+        return build(vectors, k, bundle_checksum, jobs);
+    }
+
+    std::vector<track_id> old_ids(n, REMOVED_TRACK);
+    for (size_t old = 0; old < previous_ids.size(); old++) {
+        if (previous_ids[old] != REMOVED_TRACK) {
+            old_ids[previous_ids[old]] = static_cast<track_id>(old);
+        }
+    }
+    // A row that lost a neighbour does not know its next best one and is scored again
+    // like the rows of the added tracks. The others keep their neighbours and only meet
+    // the added tracks.
+    std::vector<track_id> added;
+    std::vector<track_id> rescored;
+    std::vector<track_id> kept_rows;
+    for (size_t i = 0; i < n; i++) {
+        const track_id old = old_ids[i];
+        if (old == REMOVED_TRACK) {
+            added.push_back(static_cast<track_id>(i));
+            rescored.push_back(static_cast<track_id>(i));
+            continue;
+        }
+        const auto ids = previous.neighbours(old);
+        const bool lost = std::any_of(ids.begin(), ids.end(), [&](track_id id) { return previous_ids[id] == REMOVED_TRACK; });
+        (lost ? rescored : kept_rows).push_back(static_cast<track_id>(i));
+    }
+
+    const graph_arrays arrays = allocate_graph(n, kept, bundle_checksum);
+    const std::vector<float> inv_norms = inverse_norms(vectors);
+    fill_rows(vectors, inv_norms, rescored, nullptr, nullptr, arrays, kept, jobs);
+    auto seed = [&](track_id row, top_k<track_id> &heap) {
+        const track_id old = old_ids[row];
+        const auto ids = previous.neighbours(old);
+        const auto sims = previous.similarities(old);
+        for (size_t e = 0; e < ids.size(); e++) {
+            heap.push(previous_ids[ids[e]], sims[e]);
+        }
+    };
+    fill_rows(vectors, inv_norms, kept_rows, &added, seed, arrays, kept, jobs);
+    std::cout << "Neighbour graph updated: " << added.size() << " added and " << rescored.size() - added.size()
+              << " affected songs rescored" << std::endl;
+    knn_graph graph;
+    graph.attach(arrays.buffer, arrays.data, arrays.bytes);
+    return graph;
+}
+
+bool knn_graph::save(const std::filesystem::path &path) const {
+    return utils::atomic_write_file(path, m_data, m_bytes);
+}
+
+std::optional<knn_graph> knn_graph::load(const std::filesystem::path &path) {
+    auto file = utils::mapped_file::open(path);
+    if (!file.has_value()) {
+        return std::nullopt;
+    }
+    auto storage = std::make_shared<utils::mapped_file>(std::move(*file));
+    knn_graph graph;
+    if (!graph.attach(storage, storage->data(), storage->size())) {
+        std::cerr << "Invalid neighbour graph " << path << std::endl;
+        return std::nullopt;
+    }
+    return graph;
+}
+
+std::optional<uint64_t> knn_graph::stored_bundle_checksum(const std::filesystem::path &path) {
+    graph_header header;
+    std::ifstream ifs(path, std::ios::binary);
+    if (!ifs.read(reinterpret_cast<char *>(&header), sizeof(header)) ||
+        std::memcmp(header.magic, GRAPH_MAGIC, sizeof(GRAPH_MAGIC)) != 0) {
+        return std::nullopt;
+    }
+    return header.bundle_checksum;
+}
+
+// Points the arrays into data after checking that the sizes, offsets and ids are
+// consistent, so a truncated or foreign file is rejected instead of read out of bounds.
+bool knn_graph::attach(std::shared_ptr<const void> storage, const char *data, size_t size) {
+    graph_header header;
+    if (size < sizeof(header)) {
+        return false;
+    }
+    std::memcpy(&header, data, sizeof(header));
+    const size_t available = size - sizeof(header);
+    if (std::memcmp(header.magic, GRAPH_MAGIC, sizeof(GRAPH_MAGIC)) != 0 ||
+        header.size >= available / sizeof(uint64_t)) {
+        return false;
+    }
+
+    const size_t n = header.size;
+    const uint64_t *offsets = reinterpret_cast<const uint64_t *>(data + sizeof(header));
+    const size_t edges = offsets[n];
+    const size_t edge_bytes = available - (n + 1) * sizeof(uint64_t);
+    if (offsets[0] != 0 || edges != edge_bytes / (sizeof(track_id) + sizeof(float)) ||
+        edge_bytes % (sizeof(track_id) + sizeof(float)) != 0) {
+        return false;
+    }
+    for (size_t i = 0; i < n; i++) {
+        if (offsets[i] > offsets[i + 1]) {
+            return false;
+        }
+    }
+    const track_id *neighbours = reinterpret_cast<const track_id *>(offsets + n + 1);
+    for (size_t e = 0; e < edges; e++) {
+        if (neighbours[e] >= n) {
+            return false;
+        }
+    }
+
+    m_storage = std::move(storage);
+    m_data = data;
+    m_bytes = size;
+    m_offsets = offsets;
+    m_neighbours = neighbours;
+    m_similarities = reinterpret_cast<const float *>(neighbours + edges);
+    m_size = n;
+    m_k = static_cast<int>(header.k);
+    m_bundle_checksum = header.bundle_checksum;
+    return true;
+}
+
+size_t knn_graph::size() const {
+    return m_size;
+}
+
+bool knn_graph::empty() const {
+    return m_size == 0;
+}
+
+int knn_graph::k() const {
+    return m_k;
+}
+
+uint64_t knn_graph::bundle_checksum() const {
+    return m_bundle_checksum;
+}
+
+size_t knn_graph::memory_bytes() const {
+    return m_bytes;
+}
+
+std::span<const track_id> knn_graph::neighbours(track_id id) const {
+    return {m_neighbours + m_offsets[id], m_offsets[id + 1] - m_offsets[id]};
+}
+
+std::span<const float> knn_graph::similarities(track_id id) const {
+    return {m_similarities + m_offsets[id], m_offsets[id + 1] - m_offsets[id]};
+}
+
+std::vector<track_id> knn_graph::shortest_path(track_id from, track_id to, const std::vector<bool> &excluded,
+                                               size_t max_reached) const {
+    if (from >= m_size || to >= m_size) {
+        return {};
+    }
+
+    // Dijkstra over the tracks reached so far, the rest of the library is never touched
+    std::unordered_map<track_id, std::pair<float, track_id>> reached = {{from, {0.f, from}}};
+    using entry = std::pair<float, track_id>;
+    std::priority_queue<entry, std::vector<entry>, std::greater<>> queue;
+    queue.emplace(0.f, from);
+    bool found = false;
+    while (!queue.empty() && reached.size() <= max_reached) {
+        const auto [distance, id] = queue.top();
+        queue.pop();
+        if (id == to) {
+            found = true;
+            break;
+        }
+        if (distance > reached[id].first) {
+            continue;
+        }
+        const auto ids = neighbours(id);
+        const auto sims = similarities(id);
+        for (size_t e = 0; e < ids.size(); e++) {
+            const track_id next = ids[e];
+            if (excluded[next] && next != to) {
+                continue;
+            }
+            const float next_distance = distance + std::max(1.f - sims[e], 0.f);
+            auto [it, inserted] = reached.try_emplace(next, next_distance, id);
+            if (inserted || next_distance < it->second.first) {
+                it->second = {next_distance, id};
+                queue.emplace(next_distance, next);
+            }
+        }
+    }
+
+    if (!found) {
+        return {};
+    }
+    std::vector<track_id> path = {to};
+    while (path.back() != from) {
+        path.push_back(reached[path.back()].second);
+    }
+    std::reverse(path.begin(), path.end());
+    return path;
+}
+
+} // namespace deejai
@@ -0,0 +1,73 @@
+#pragma once
+
+#include "deejai/embeddings.hpp"
+#include "deejai/string_table.hpp"
+
+#include <cstdint>
+#include <cstddef>
+#include <filesystem>
+#include <memory>
+#include <optional>
+#include <span>
+#include <vector>
+
+namespace deejai {
+
+// number of neighbours kept per track by scan
+constexpr int DEFAULT_GRAPH_NEIGHBOURS = 20;
+
+// Graph linking every track of a bundle to its nearest neighbours by cosine similarity,
+// in compressed sparse rows: the neighbours of track i are the entries offsets[i] to
+// offsets[i + 1], best first. Scan builds it next to the bundle and the generator maps
+// the file, so loading it costs nothing until a track's neighbours are read.
+class knn_graph {
+  public:
+    knn_graph() = default;
+
+    // Exact graph from a blocked pass over all the pairs of rows on jobs threads.
+    // bundle_checksum ties the graph to the bundle file the rows were loaded from.
+    static knn_graph build(const embeddings &vectors, int k, uint64_t bundle_checksum, size_t jobs);
+    // The same from the graph of an earlier version of the bundle, whose track i is now
+    // track previous_ids[i], or UINT32_MAX when it was removed. Only the rows of the added
+    // tracks and of the tracks that lost a neighbour are scored against every row, the
+    // others only against the added tracks.
+    static knn_graph update(const knn_graph &previous, const std::vector<track_id> &previous_ids,
+                            const embeddings &vectors, int k, uint64_t bundle_checksum, size_t jobs);
+    // neighbours per track of the graph of size tracks
+    static size_t kept_neighbours(size_t size, int k);
+    bool save(const std::filesystem::path &path) const;
+    static std::optional<knn_graph> load(const std::filesystem::path &path);
+    // bundle_checksum in the header of a saved graph, without reading or checking the rest
+    static std::optional<uint64_t> stored_bundle_checksum(const std::filesystem::path &path);
+
+    size_t size() const;
+    bool empty() const;
+    int k() const;
+    uint64_t bundle_checksum() const;
+    size_t memory_bytes() const;
+
+    std::span<const track_id> neighbours(track_id id) const;
+    std::span<const float> similarities(track_id id) const;
+
+    // Shortest path between two tracks, with edges weighted by their cosine distance.
+    // Excluded tracks are not crossed. Empty when the graph does not connect them or the
+    // search reaches more than max_reached tracks before finding it.
+    std::vector<track_id> shortest_path(track_id from, track_id to, const std::vector<bool> &excluded,
+                                        size_t max_reached = SIZE_MAX) const;
+
+  private:
+    bool attach(std::shared_ptr<const void> storage, const char *data, size_t size);
+
+    // owns the bytes the arrays point into, shared by the copies of the graph
+    std::shared_ptr<const void> m_storage;
+    const char *m_data = nullptr;
+    size_t m_bytes = 0;
+    const uint64_t *m_offsets = nullptr;
+    const track_id *m_neighbours = nullptr;
+    const float *m_similarities = nullptr;
+    size_t m_size = 0;
+    int m_k = 0;
+    uint64_t m_bundle_checksum = 0;
+};
+
+} // namespace deejai
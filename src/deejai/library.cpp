@@ -0,0 +1,58 @@
+#include "deejai/library.hpp"
+#include "deejai/common.hpp"
+#include "deejai/utils.hpp"
+
+#include <algorithm>
+#include <functional>
+#include <iostream>
+#include <utility>
+
+namespace deejai {
+
+std::optional<library> library::load(const std::filesystem::path &vecs_dir) {
+    const std::filesystem::path path = vecs_dir / BUNDLED_VECS_DIRNAME / BUNDLED_VECS_FILENAME;
+    auto loaded = load_bundle(path);
+    if (!loaded.has_value()) {
+        return std::nullopt;
+    }
+    // bundles are stored sorted by path, so the row of a track is its id in the table
+    const auto &tracks = loaded->tracks;
+    if (std::adjacent_find(tracks.begin(), tracks.end(), std::greater_equal<>()) != tracks.end()) {
+        std::cerr << path << ": the tracks are not sorted or not unique, scan again to rebuild it." << std::endl;
+        return std::nullopt;
+    }
+    library lib;
+    lib.m_tracks = string_table(loaded->tracks);
+    lib.m_vectors = std::move(loaded->vectors);
+
+    const std::filesystem::path graph_path = vecs_dir / BUNDLED_VECS_DIRNAME / KNN_GRAPH_FILENAME;
+    if (!std::filesystem::is_regular_file(graph_path)) {
+        return lib;
+    }
+    auto graph = knn_graph::load(graph_path);
+    if (graph.has_value() && graph->size() == lib.m_tracks.size() &&
+        graph->bundle_checksum() == utils::stored_checksum(path)) {
+        lib.m_graph = std::move(*graph);
+    } else if (graph.has_value()) {
+        std::cerr << graph_path << ": was built for another bundle, scan again to rebuild it." << std::endl;
+    }
+    return lib;
+}
+
+const string_table &library::tracks() const {
+    return m_tracks;
+}
+
+const embeddings &library::vectors() const {
+    return m_vectors;
+}
+
+const knn_graph &library::graph() const {
+    return m_graph;
+}
+
+size_t library::memory_bytes() const {
+    return m_tracks.memory_bytes() + m_vectors.memory_bytes() + m_graph.memory_bytes();
+}
+
+} // namespace deejai
@@ -0,0 +1,35 @@
+#pragma once
+
+#include "deejai/embeddings.hpp"
+#include "deejai/knn_graph.hpp"
+#include "deejai/string_table.hpp"
+
+#include <filesystem>
+#include <optional>
+
+namespace deejai {
+
+// One loaded bundle: the track table, the vectors and the neighbour graph. A library is
+// never modified once loaded, so it is shared by all the queries running on it and a
+// reload builds a new one next to it.
+class library {
+  public:
+    library() = default;
+
+    // Loads the bundle and its graph from a vector directory, nullopt when there is no
+    // readable bundle or its tracks are not sorted and unique. A graph built for another
+    // bundle is ignored.
+    static std::optional<library> load(const std::filesystem::path &vecs_dir);
+
+    const string_table &tracks() const;
+    const embeddings &vectors() const;
+    const knn_graph &graph() const;
+    size_t memory_bytes() const;
+
+  private:
+    string_table m_tracks;
+    embeddings m_vectors;
+    knn_graph m_graph;
+};
+
+} // namespace deejai
@@ -0,0 +1,379 @@
+#pragma once
+
+#include "deejai/common.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+namespace deejai {
+
+// Math evaluated by the compiler for the tables of the frontend, in double precision and
+// rounded to float once.
+namespace constexpr_math {
+
+constexpr double LN2 = 0.69314718055994530942;
+constexpr double PI = 3.14159265358979323846;
+
+constexpr double exp(double x) {
+    // e^x = 2^k e^r with |r| <= ln(2) / 2
+    int k = static_cast<int>(x / LN2 + (x < 0 ? -0.5 : 0.5));
+    const double r = x - k * LN2;
+    double term = 1.0;
+    double sum = 1.0;
+    for (int n = 1; n < 20; n++) {
+        term *= r / n;
+        sum += term;
+    }
+    for (; k > 0; k--) {
+        sum *= 2.0;
+    }
+    for (; k < 0; k++) {
+        sum /= 2.0;
+    }
+    return sum;
+}
+
+// x > 0
+constexpr double log(double x) {
+    int e = 0;
+    while (x >= 2.0) {
+        x /= 2.0;
+        e++;
+    }
+    while (x < 1.0) {
+        x *= 2.0;
+        e--;
+    }
+    // ln(x) = 2 atanh(y) with y = (x - 1) / (x + 1) in [0, 1/3)
+    const double y = (x - 1.0) / (x + 1.0);
+    double term = y;
+    double sum = 0.0;
+    for (int n = 1; n < 40; n += 2) {
+        sum += term / n;
+        term *= y * y;
+    }
+    return 2.0 * sum + e * LN2;
+}
+
+struct rotation {
+    double cos;
+    double sin;
+};
+
+// cos and sin of 2 pi k / n, reduced to the first quadrant in integers
+constexpr rotation turn(int64_t k, int64_t n) {
+    k %= n;
+    if (k < 0) {
+        k += n;
+    }
+    const int64_t quadrant = 4 * k / n;
+    const double theta = 2.0 * PI * static_cast<double>(4 * k - quadrant * n) / static_cast<double>(4 * n);
+    double c = 0.0;
+    double s = 0.0;
+    double term = 1.0;
+    // theta <= pi / 2, the terms past the 24th are below double precision
+    for (int i = 0; i < 24; i++) {
+        // term = theta^i / i!
+        if (i % 2 == 0) {
+            c += (i % 4 == 0) ? term : -term;
+        } else {
+            s += (i % 4 == 1) ? term : -term;
+        }
+        term *= theta / (i + 1);
+    }
+    switch (quadrant) {
+    case 0:
+        return {c, s};
+    case 1:
+        return {-s, c};
+    case 2:
+        return {-c, -s};
+    default:
+        return {s, -c};
+    }
+}
+
+} // namespace constexpr_math
+
+// The tables of mel_frontend, built by the compiler.
+namespace mel_tables {
+
+// the weights of one mel filter, which are zero outside [begin, end)
+struct band {
+    int begin;
+    int end;
+    int offset;
+};
+
+template <int N_MELS, size_t WEIGHTS>
+struct mel_bank {
+    std::array<band, N_MELS> bands;
+    std::array<float, WEIGHTS> weights;
+};
+
+template <int N>
+struct complex_table {
+    std::array<float, N> re;
+    std::array<float, N> im;
+};
+
+constexpr double hz_to_mel(double hz) {
+    // Slaney: linear below 1 kHz, logarithmic above
+    const double f_sp = 200.0 / 3.0;
+    const double logstep = constexpr_math::log(6.4) / 27.0;
+    return hz >= 1000.0 ? 1000.0 / f_sp + constexpr_math::log(hz / 1000.0) / logstep : hz / f_sp;
+}
+
+constexpr double mel_to_hz(double mel) {
+    const double f_sp = 200.0 / 3.0;
+    const double logstep = constexpr_math::log(6.4) / 27.0;
+    const double min_log_mel = 1000.0 / f_sp;
+    return mel > min_log_mel ? 1000.0 * constexpr_math::exp(logstep * (mel - min_log_mel)) : mel * f_sp;
+}
+
+// the centre frequencies of the filters and the band edges, from 0 Hz to the Nyquist frequency
+template <int SAMPLING_RATE, int N_MELS>
+constexpr std::array<double, N_MELS + 2> mel_frequencies() {
+    std::array<double, N_MELS + 2> hz = {};
+    const double max_mel = hz_to_mel(SAMPLING_RATE / 2);
+    for (int i = 0; i < N_MELS + 2; i++) {
+        hz[i] = mel_to_hz(max_mel * i / (N_MELS + 1));
+    }
+    return hz;
+}
+
+// Calls visit(m, k, weight) for the non-zero weights of every filter, with the Slaney
+// area normalisation. Only the bins around the band of each filter are tried, which
+// keeps the compile time low.
+template <int SAMPLING_RATE, int N_FFT, int N_MELS, typename F>
+constexpr void visit_weights(F &&visit) {
+    const int n_bins = N_FFT / 2 + 1;
+    const std::array<double, N_MELS + 2> hz = mel_frequencies<SAMPLING_RATE, N_MELS>();
+    for (int m = 0; m < N_MELS; m++) {
+        const int first = std::max(0, static_cast<int>(hz[m] * N_FFT / SAMPLING_RATE) - 1);
+        const int last = std::min(n_bins - 1, static_cast<int>(hz[m + 2] * N_FFT / SAMPLING_RATE) + 1);
+        for (int k = first; k <= last; k++) {
+            const double freq = static_cast<double>(k) * SAMPLING_RATE / N_FFT;
+            const double lower = (freq - hz[m]) / (hz[m + 1] - hz[m]);
+            const double upper = (hz[m + 2] - freq) / (hz[m + 2] - hz[m + 1]);
+            const double weight = std::max(0.0, std::min(lower, upper)) * 2.0 / (hz[m + 2] - hz[m]);
+            if (weight > 0.0) {
+                visit(m, k, weight);
+            }
+        }
+    }
+}
+
+template <int SAMPLING_RATE, int N_FFT, int N_MELS>
+constexpr size_t mel_weight_count() {
+    size_t count = 0;
+    visit_weights<SAMPLING_RATE, N_FFT, N_MELS>([&](int, int, double) { count++; });
+    return count;
+}
+
+template <int SAMPLING_RATE, int N_FFT, int N_MELS>
+constexpr auto make_mel_bank() {
+    mel_bank<N_MELS, mel_weight_count<SAMPLING_RATE, N_FFT, N_MELS>()> bank = {};
+    for (band &b : bank.bands) {
+        b = {0, 0, 0};
+    }
+    int offset = 0;
+    visit_weights<SAMPLING_RATE, N_FFT, N_MELS>([&](int m, int k, double weight) {
+        band &b = bank.bands[m];
+        if (b.end == 0) {
+            b = {k, k, offset};
+        }
+        // the weights of a filter are contiguous
+        b.end = k + 1;
+        bank.weights[offset++] = static_cast<float>(weight);
+    });
+    return bank;
+}
+
+// periodic Hann window, like scipy.signal.get_window('hann')
+template <int N_FFT>
+constexpr std::array<float, N_FFT> make_window() {
+    std::array<float, N_FFT> window = {};
+    for (int n = 0; n < N_FFT; n++) {
+        window[n] = static_cast<float>(0.5 - 0.5 * constexpr_math::turn(n, N_FFT).cos);
+    }
+    return window;
+}
+
+template <int N>
+constexpr std::array<uint32_t, N> make_bit_reversal() {
+    std::array<uint32_t, N> reversed = {};
+    int bits = 0;
+    while ((1 << bits) < N) {
+        bits++;
+    }
+    for (uint32_t i = 0; i < N; i++) {
+        uint32_t r = 0;
+        for (int b = 0; b < bits; b++) {
+            r |= ((i >> b) & 1u) << (bits - 1 - b);
+        }
+        reversed[i] = r;
+    }
+    return reversed;
+}
+
+// e^(-2 pi i j / (2 half)) of the butterflies with span half at [half + j] of an N point
+// FFT, so every stage reads its twiddles contiguously
+template <int N>
+constexpr complex_table<N> make_stage_twiddles() {
+    complex_table<N> tw = {};
+    for (int half = 1; half < N; half *= 2) {
+        for (int j = 0; j < half; j++) {
+            const constexpr_math::rotation r = constexpr_math::turn(j, 2 * half);
+            tw.re[half + j] = static_cast<float>(r.cos);
+            tw.im[half + j] = static_cast<float>(-r.sin);
+        }
+    }
+    return tw;
+}
+
+// e^(-2 pi i k / N_FFT) for k up to N_FFT / 2, which splits a half size FFT into the
+// spectrum of N_FFT real samples
+template <int N_FFT>
+constexpr complex_table<N_FFT / 2 + 1> make_spectrum_twiddles() {
+    complex_table<N_FFT / 2 + 1> tw = {};
+    for (int k = 0; k <= N_FFT / 2; k++) {
+        const constexpr_math::rotation r = constexpr_math::turn(k, N_FFT);
+        tw.re[k] = static_cast<float>(r.cos);
+        tw.im[k] = static_cast<float>(-r.sin);
+    }
+    return tw;
+}
+
+} // namespace mel_tables
+
+// The mel power spectrogram of librosa.feature.melspectrogram for one STFT shape, with
+// the Hann window, the FFT twiddles and the Slaney mel filters computed at compile time.
+// Frames are centred and padded with zeros and the filters span 0 Hz to the Nyquist
+// frequency, like mel_spectrogram().
+template <int SAMPLING_RATE, int N_FFT, int HOP, int N_MELS>
+class mel_frontend {
+  public:
+    static_assert(N_FFT >= 8 && (N_FFT & (N_FFT - 1)) == 0, "the FFT size must be a power of two");
+    static constexpr int N_BINS = N_FFT / 2 + 1;
+
+    static size_t frames(size_t size) {
+        return 1 + size / HOP;
+    }
+
+    // n_mels rows by frames
+    static matrixf mel_spectrogram(const float *samples, size_t size) {
+        matrixf mel(N_MELS, frames(size));
+        mel_spectrogram(samples, size, mel.data());
+        return mel;
+    }
+
+    // into out, n_mels rows by frames in row-major order
+    static void mel_spectrogram(const float *samples, size_t size, float *out) {
+        const size_t num_frames = frames(size);
+        std::array<float, N_FFT> frame;
+        std::array<float, N_BINS> power;
+        for (size_t f = 0; f < num_frames; f++) {
+            window_frame(samples, size, f, frame.data());
+            power_spectrum(frame.data(), power.data());
+            for (int m = 0; m < N_MELS; m++) {
+                const mel_tables::band &b = MEL_BANK.bands[m];
+                const float *weights = MEL_BANK.weights.data() + b.offset;
+                float sum = 0.f;
+                for (int k = b.begin; k < b.end; k++) {
+                    sum += weights[k - b.begin] * power[k];
+                }
+                out[m * num_frames + f] = sum;
+            }
+        }
+    }
+
+  private:
+    // the real FFT of N_FFT samples is a complex FFT of half the size
+    static constexpr int N_HALF = N_FFT / 2;
+
+    static constexpr auto MEL_BANK = mel_tables::make_mel_bank<SAMPLING_RATE, N_FFT, N_MELS>();
+    static constexpr std::array<float, N_FFT> WINDOW = mel_tables::make_window<N_FFT>();
+    static constexpr std::array<uint32_t, N_HALF> BIT_REVERSAL = mel_tables::make_bit_reversal<N_HALF>();
+    static constexpr mel_tables::complex_table<N_HALF> STAGE_TWIDDLES = mel_tables::make_stage_twiddles<N_HALF>();
+    static constexpr mel_tables::complex_table<N_BINS> SPECTRUM_TWIDDLES =
+        mel_tables::make_spectrum_twiddles<N_FFT>();
+
+    // the windowed samples of frame f, centred on sample f * HOP
+    static void window_frame(const float *samples, size_t size, size_t f, float *out) {
+        const int64_t start = static_cast<int64_t>(f * HOP) - N_FFT / 2;
+        if (start >= 0 && start + N_FFT <= static_cast<int64_t>(size)) {
+            const float *x = samples + start;
+            for (int n = 0; n < N_FFT; n++) {
+                out[n] = WINDOW[n] * x[n];
+            }
+            return;
+        }
+        for (int n = 0; n < N_FFT; n++) {
+            const int64_t i = start + n;
+            out[n] = i >= 0 && i < static_cast<int64_t>(size) ? WINDOW[n] * samples[i] : 0.f;
+        }
+    }
+
+    // |X[k]|^2 of the real FFT of the frame
+    static void power_spectrum(const float *frame, float *power) {
+        // even samples as the real and odd samples as the imaginary parts, in bit reversed order
+        std::array<float, N_HALF> re;
+        std::array<float, N_HALF> im;
+        for (int n = 0; n < N_HALF; n++) {
+            re[BIT_REVERSAL[n]] = frame[2 * n];
+            im[BIT_REVERSAL[n]] = frame[2 * n + 1];
+        }
+
+        // radix 2 butterflies, the first stage needs no twiddles
+        for (int a = 0; a < N_HALF; a += 2) {
+            const float tr = re[a + 1];
+            const float ti = im[a + 1];
+            re[a + 1] = re[a] - tr;
+            im[a + 1] = im[a] - ti;
+            re[a] += tr;
+            im[a] += ti;
+        }
+        for (int half = 2; half < N_HALF; half *= 2) {
+            const float *wr = STAGE_TWIDDLES.re.data() + half;
+            const float *wi = STAGE_TWIDDLES.im.data() + half;
+            for (int start = 0; start < N_HALF; start += 2 * half) {
+                float *re_a = re.data() + start;
+                float *im_a = im.data() + start;
+                float *re_b = re_a + half;
+                float *im_b = im_a + half;
+                for (int j = 0; j < half; j++) {
+                    const float tr = re_b[j] * wr[j] - im_b[j] * wi[j];
+                    const float ti = re_b[j] * wi[j] + im_b[j] * wr[j];
+                    re_b[j] = re_a[j] - tr;
+                    im_b[j] = im_a[j] - ti;
+                    re_a[j] += tr;
+                    im_a[j] += ti;
+                }
+            }
+        }
+
+        // X[k] = E[k] + W^k O[k], with E and O the spectra of the even and odd samples
+        power[0] = (re[0] + im[0]) * (re[0] + im[0]);
+        power[N_HALF] = (re[0] - im[0]) * (re[0] - im[0]);
+        for (int k = 1; k < N_HALF; k++) {
+            const float ar = re[k];
+            const float ai = im[k];
+            const float br = re[N_HALF - k];
+            const float bi = im[N_HALF - k];
+            const float er = 0.5f * (ar + br);
+            const float ei = 0.5f * (ai - bi);
+            const float or_ = 0.5f * (ai + bi);
+            const float oi = -0.5f * (ar - br);
+            const float wr = SPECTRUM_TWIDDLES.re[k];
+            const float wi = SPECTRUM_TWIDDLES.im[k];
+            const float xr = er + wr * or_ - wi * oi;
+            const float xi = ei + wr * oi + wi * or_;
+            power[k] = xr * xr + xi * xi;
+        }
+    }
+};
+
+} // namespace deejai
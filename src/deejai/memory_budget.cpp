@@ -0,0 +1,54 @@
+#include "deejai/memory_budget.hpp"
+
+#include <algorithm>
+
+namespace deejai {
+
+memory_budget::reservation::reservation(memory_budget &budget, size_t bytes) :
+    m_budget(budget), m_bytes(budget.acquire(bytes)) {}
+
+memory_budget::reservation::~reservation() {
+    m_budget.release(m_bytes);
+}
+
+memory_budget::memory_budget(size_t limit) : m_limit(limit) {}
+
+size_t memory_budget::limit() const {
+    return m_limit;
+}
+
+size_t memory_budget::peak() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_peak;
+}
+
+size_t memory_budget::waits() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_waits;
+}
+
+size_t memory_budget::acquire(size_t bytes) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if (m_limit > 0) {
+        // fits once nothing else runs
+        bytes = std::min(bytes, m_limit);
+        if (m_reserved + bytes > m_limit) {
+            m_waits++;
+            m_released.wait(lock, [&] { return m_reserved + bytes <= m_limit; });
+        }
+    }
+    m_reserved += bytes;
+    m_peak = std::max(m_peak, m_reserved);
+    return bytes;
+}
+
+void memory_budget::release(size_t bytes) {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_reserved -= bytes;
+    }
+    // the waiting files differ in size, any of them may fit now
+    m_released.notify_all();
+}
+
+} // namespace deejai
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+
+namespace deejai {
+
+// Admission control of the scan workers by the estimated memory of their files. A worker
+// waits until its file fits in what the running files leave of the budget, while smaller
+// files may still start meanwhile. A file estimated above the whole budget runs alone.
+class memory_budget {
+  public:
+    // Holds the memory of one file until it is destroyed.
+    class reservation {
+      public:
+        reservation(memory_budget &budget, size_t bytes);
+        ~reservation();
+        reservation(const reservation &) = delete;
+        reservation &operator=(const reservation &) = delete;
+
+      private:
+        memory_budget &m_budget;
+        size_t m_bytes;
+    };
+
+    // a limit of 0 admits every file at once
+    explicit memory_budget(size_t limit);
+    memory_budget(const memory_budget &) = delete;
+    memory_budget &operator=(const memory_budget &) = delete;
+
+    size_t limit() const;
+    // the most memory reserved at once
+    size_t peak() const;
+    // files that had to wait for memory
+    size_t waits() const;
+
+  private:
+    // the reserved bytes, at most the limit
+    size_t acquire(size_t bytes);
+    void release(size_t bytes);
+
+    const size_t m_limit;
+    mutable std::mutex m_mutex;
+    std::condition_variable m_released;
+    size_t m_reserved = 0;
+    size_t m_peak = 0;
+    size_t m_waits = 0;
+};
+
+} // namespace deejai
@@ -0,0 +1,189 @@
+#include "deejai/playlist_session.hpp"
+#include "deejai/generator.hpp"
+#include "deejai/utils.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+namespace deejai {
+
+static constexpr std::string_view SESSION_HEADER = "deej-ai-session 1";
+
+// the rolling sum is recomputed from scratch after this many evictions
+static constexpr size_t RESUM_INTERVAL = 4096;
+
+playlist_session::playlist_session(const generator &gen, std::shared_ptr<const library> lib, int lookback, float noise)
+    : m_generator(&gen), m_library(std::move(lib)), m_lookback(std::max(lookback, 1)), m_noise(noise),
+      m_context_sum(vectorf::Zero(m_library->vectors().dim())), m_excluded(m_library->tracks().size(), false) {}
+
+playlist_session::playlist_session(const generator &gen, const std::vector<std::string> &seed_tracks, int lookback,
+                                   float noise, std::optional<uint64_t> seed)
+    : playlist_session(gen, gen.snapshot(), seed_tracks, lookback, noise, seed) {}
+
+playlist_session::playlist_session(const generator &gen, std::shared_ptr<const library> lib,
+                                   const std::vector<std::string> &seed_tracks, int lookback, float noise,
+                                   std::optional<uint64_t> seed)
+    : playlist_session(gen, std::move(lib), lookback, noise) {
+    m_rng = utils::make_rng(seed);
+
+    std::vector<std::string> tracks = seed_tracks;
+    gen.remove_invalid_tracks(*m_library, tracks);
+    for (track_id id : gen.track_ids(*m_library, tracks)) {
+        push(id);
+    }
+}
+
+int playlist_session::lookback() const {
+    return m_lookback;
+}
+
+float playlist_session::noise() const {
+    return m_noise;
+}
+
+size_t playlist_session::played() const {
+    return m_played;
+}
+
+void playlist_session::push(track_id id) {
+    if (!m_excluded[id]) {
+        m_excluded[id] = true;
+        m_played++;
+    }
+    m_context.push_back(id);
+    m_context_sum += m_library->vectors().row(id);
+    if (m_context.size() > static_cast<size_t>(m_lookback)) {
+        m_context_sum -= m_library->vectors().row(m_context.front());
+        m_context.pop_front();
+        if (++m_evictions >= RESUM_INTERVAL) {
+            resum_context();
+        }
+    }
+}
+
+void playlist_session::resum_context() {
+    m_context_sum.setZero();
+    for (track_id id : m_context) {
+        m_context_sum += m_library->vectors().row(id);
+    }
+    m_evictions = 0;
+}
+
+std::vector<std::string> playlist_session::next(int k) {
+    // like the append playlists, nothing is searched without a valid track to follow
+    if (m_context.empty()) {
+        return {};
+    }
+    generator::query_scope scope(*m_generator, "session");
+    std::vector<track_id> tracks;
+    for (int i = 0; i < k; i++) {
+        vectorf query = m_context_sum;
+        utils::add_noise(query, m_noise, m_rng);
+        const std::vector<track_id> context(m_context.begin(), m_context.end());
+        auto similar = m_generator->most_similar_near(*m_library, context, m_excluded, query, 1);
+        if (similar.empty()) {
+            break;
+        }
+        push(similar.front().first);
+        tracks.push_back(similar.front().first);
+    }
+    scope.set_excluded(m_played);
+    return m_generator->track_paths(*m_library, tracks);
+}
+
+std::string playlist_session::serialize() const {
+    std::ostringstream out;
+    out << SESSION_HEADER << "\n";
+    out << "lookback " << m_lookback << "\n";
+    out << "noise " << std::setprecision(9) << m_noise << "\n";
+    out << "rng " << m_rng << "\n";
+    for (track_id id : m_context) {
+        out << "context " << m_library->tracks().at(id) << "\n";
+    }
+    for (size_t id = 0; id < m_excluded.size(); id++) {
+        if (m_excluded[id]) {
+            out << "excluded " << m_library->tracks().at(id) << "\n";
+        }
+    }
+    return out.str();
+}
+
+std::optional<playlist_session> playlist_session::deserialize(const generator &gen, const std::string &data) {
+    std::istringstream in(data);
+    std::string line;
+    if (!std::getline(in, line) || line != SESSION_HEADER) {
+        return std::nullopt;
+    }
+
+    int lookback = 3;
+    float noise = 0.0f;
+    std::string rng_state;
+    std::vector<std::string> context;
+    std::vector<std::string> excluded;
+    while (std::getline(in, line)) {
+        const size_t space = line.find(' ');
+        const std::string key = line.substr(0, space);
+        const std::string value = space == std::string::npos ? "" : line.substr(space + 1);
+        if (key == "lookback") {
+            std::istringstream(value) >> lookback;
+        } else if (key == "noise") {
+            std::istringstream(value) >> noise;
+        } else if (key == "rng") {
+            rng_state = value;
+        } else if (key == "context") {
+            context.push_back(value);
+        } else if (key == "excluded") {
+            excluded.push_back(value);
+        }
+    }
+
+    playlist_session session(gen, gen.snapshot(), lookback, noise);
+    std::istringstream rng_in(rng_state);
+    if (!(rng_in >> session.m_rng)) {
+        return std::nullopt;
+    }
+    for (const auto &track : excluded) {
+        if (auto id = session.m_library->tracks().find(track)) {
+            if (!session.m_excluded[*id]) {
+                session.m_excluded[*id] = true;
+                session.m_played++;
+            }
+        }
+    }
+    for (const auto &track : context) {
+        if (auto id = session.m_library->tracks().find(track)) {
+            session.m_context.push_back(*id);
+        }
+    }
+    while (session.m_context.size() > static_cast<size_t>(session.m_lookback)) {
+        session.m_context.pop_front();
+    }
+    session.resum_context();
+    return session;
+}
+
+bool playlist_session::save(const std::filesystem::path &path) const {
+    if (!utils::atomic_write_file(path, serialize())) {
+        std::cerr << "Failed to save the playlist session to " << path << std::endl;
+        return false;
+    }
+    return true;
+}
+
+std::optional<playlist_session> playlist_session::load(const generator &gen, const std::filesystem::path &path) {
+    std::ifstream ifs(path, std::ios::binary);
+    if (!ifs) {
+        return std::nullopt;
+    }
+    const std::string data((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
+    auto session = deserialize(gen, data);
+    if (!session.has_value()) {
+        std::cerr << path << ": is not a valid playlist session." << std::endl;
+    }
+    return session;
+}
+
+} // namespace deejai
@@ -0,0 +1,71 @@
+#pragma once
+
+#include "deejai/common.hpp"
+#include "deejai/string_table.hpp"
+
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <memory>
+#include <optional>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace deejai {
+
+class generator;
+class library;
+
+// Incremental 'append' generation. The session keeps the running sum of the last
+// lookback tracks, the tracks that may not be picked again and its random state, so
+// every call to next() only searches the library once per returned track. The state
+// can be saved and resumed later, for an endless radio. A session keeps the library it
+// started on when the generator reloads, a saved session resumes on the current one.
+class playlist_session {
+  public:
+    // The generator must outlive the session.
+    playlist_session(const generator &gen, const std::vector<std::string> &seed_tracks, int lookback = 3,
+                     float noise = 0.0f, std::optional<uint64_t> seed = std::nullopt);
+    // On a library the caller already pinned with generator::snapshot(), instead of the
+    // current one.
+    playlist_session(const generator &gen, std::shared_ptr<const library> lib,
+                     const std::vector<std::string> &seed_tracks, int lookback = 3, float noise = 0.0f,
+                     std::optional<uint64_t> seed = std::nullopt);
+
+    // The next k tracks, fewer when the library runs out and none without a context, when
+    // no seed track was in the library.
+    std::vector<std::string> next(int k);
+
+    int lookback() const;
+    float noise() const;
+    // number of tracks the session will not return again, seeds included
+    size_t played() const;
+
+    std::string serialize() const;
+    // Tracks that left the library since the session was saved are dropped.
+    static std::optional<playlist_session> deserialize(const generator &gen, const std::string &data);
+
+    bool save(const std::filesystem::path &path) const;
+    static std::optional<playlist_session> load(const generator &gen, const std::filesystem::path &path);
+
+  private:
+    playlist_session(const generator &gen, std::shared_ptr<const library> lib, int lookback, float noise);
+
+    void push(track_id id);
+    void resum_context();
+
+    const generator *m_generator;
+    std::shared_ptr<const library> m_library;
+    int m_lookback;
+    float m_noise;
+    std::mt19937 m_rng;
+    std::deque<track_id> m_context;
+    vectorf m_context_sum;
+    std::vector<bool> m_excluded;
+    size_t m_played = 0;
+    // evictions since the sum was last recomputed, bounds the rounding drift
+    size_t m_evictions = 0;
+};
+
+} // namespace deejai
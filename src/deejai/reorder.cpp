@@ -0,0 +1,744 @@
+#include "deejai/reorder.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <deque>
+#include <limits>
+#include <numeric>
+#include <random>
+#include <thread>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+namespace deejai {
+
+std::optional<reorder_solver> reorder_solver_from_string(const std::string &name) {
+    if (name == "auto") {
+        return reorder_solver::automatic;
+    }
+    if (name == "exact") {
+        return reorder_solver::exact;
+    }
+    if (name == "annealing") {
+        return reorder_solver::annealing;
+    }
+    if (name == "local-search") {
+        return reorder_solver::local_search;
+    }
+    return std::nullopt;
+}
+
+std::string reorder_solver_name(reorder_solver solver) {
+    switch (solver) {
+    case reorder_solver::exact:
+        return "exact";
+    case reorder_solver::annealing:
+        return "annealing";
+    case reorder_solver::local_search:
+        return "local-search";
+    default:
+        return "auto";
+    }
+}
+
+reorder_solver select_reorder_solver(int n, reorder_solver requested) {
+    // the exact solver needs O(2^n * n) memory, so it is never forced on large playlists
+    if (requested == reorder_solver::exact && n > EXACT_REORDER_MAX_TRACKS) {
+        requested = reorder_solver::automatic;
+    }
+    if (requested != reorder_solver::automatic) {
+        return requested;
+    }
+    if (n <= EXACT_REORDER_MAX_TRACKS) {
+        return reorder_solver::exact;
+    }
+    if (n >= LOCAL_SEARCH_REORDER_MIN_TRACKS) {
+        return reorder_solver::local_search;
+    }
+    return reorder_solver::annealing;
+}
+
+float path_length(const distance_matrix &dist, const std::vector<int> &path) {
+    float length = 0.f;
+    for (size_t i = 0; i + 1 < path.size(); i++) {
+        length += dist(path[i], path[i + 1]);
+    }
+    return length;
+}
+
+typedef std::optional<std::chrono::steady_clock::time_point> deadline_t;
+
+static deadline_t make_deadline(const reorder_options &options) {
+    if (options.time_budget_ms <= 0.0) {
+        return std::nullopt;
+    }
+    return std::chrono::steady_clock::now() + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                                                  std::chrono::duration<double, std::milli>(options.time_budget_ms));
+}
+
+static bool expired(const deadline_t &deadline) {
+    return deadline.has_value() && std::chrono::steady_clock::now() >= *deadline;
+}
+
+static uint64_t make_seed(const reorder_options &options) {
+    return options.seed.has_value() ? *options.seed : std::random_device{}();
+}
+
+// Held-Karp over the subsets of the tracks: cost[mask][j] is the shortest path that visits
+// the tracks of mask and ends at j.
+static std::vector<int> held_karp(const distance_matrix &dist, int first) {
+    const int n = dist.size();
+    const size_t subsets = size_t(1) << n;
+    const float inf = std::numeric_limits<float>::infinity();
+    std::vector<float> cost(subsets * n, inf);
+    std::vector<int8_t> parent(subsets * n, -1);
+
+    for (int j = 0; j < n; j++) {
+        if (first < 0 || j == first) {
+            cost[(size_t(1) << j) * n + j] = 0.f;
+        }
+    }
+    for (size_t mask = 1; mask < subsets; mask++) {
+        for (int j = 0; j < n; j++) {
+            const float c = cost[mask * n + j];
+            if (c == inf) {
+                continue;
+            }
+            for (int k = 0; k < n; k++) {
+                const size_t next = mask | (size_t(1) << k);
+                if (next == mask) {
+                    continue;
+                }
+                const float candidate = c + dist(j, k);
+                if (candidate < cost[next * n + k]) {
+                    cost[next * n + k] = candidate;
+                    parent[next * n + k] = static_cast<int8_t>(j);
+                }
+            }
+        }
+    }
+
+    const size_t full = subsets - 1;
+    int last = 0;
+    for (int j = 1; j < n; j++) {
+        if (cost[full * n + j] < cost[full * n + last]) {
+            last = j;
+        }
+    }
+    std::vector<int> path;
+    size_t mask = full;
+    for (int j = last; j >= 0;) {
+        path.push_back(j);
+        const int prev = parent[mask * n + j];
+        mask &= ~(size_t(1) << j);
+        j = prev;
+    }
+    std::reverse(path.begin(), path.end());
+    return path;
+}
+
+// The open path is solved as a tour through one extra virtual track, which sits between
+// the two ends of the path. It is free to connect to every track, unless the path has a
+// fixed start: then every other track pays a penalty larger than any detour, so the
+// shortest tours keep the first track next to it.
+struct closed_path_metric {
+    const distance_matrix &dist;
+    int virtual_track;
+    int first;
+    float penalty;
+
+    float operator()(int a, int b) const {
+        if (a == virtual_track || b == virtual_track) {
+            const int other = a == virtual_track ? b : a;
+            return (first < 0 || other == first || other == virtual_track) ? 0.f : penalty;
+        }
+        return dist(a, b);
+    }
+};
+
+template <typename Metric>
+static float tour_length(const Metric &dist, const std::vector<int> &tour) {
+    float length = 0.f;
+    for (size_t i = 0; i < tour.size(); i++) {
+        length += dist(tour[i], tour[(i + 1) % tour.size()]);
+    }
+    return length;
+}
+
+// Length of the edges leaving the given positions, counting every edge once.
+template <typename Metric>
+static float edges_length(const Metric &dist, const std::vector<int> &tour, int *positions, int count) {
+    const int n = tour.size();
+    std::sort(positions, positions + count);
+    float length = 0.f;
+    for (int k = 0; k < count; k++) {
+        if (k > 0 && positions[k] == positions[k - 1]) {
+            continue;
+        }
+        const int p = positions[k];
+        length += dist(tour[p], tour[(p + 1) % n]);
+    }
+    return length;
+}
+
+template <typename Metric>
+static float swap_delta(const Metric &dist, std::vector<int> &tour, int i, int j) {
+    const int n = tour.size();
+    int positions[4] = {(i + n - 1) % n, i, (j + n - 1) % n, j};
+    const float before = edges_length(dist, tour, positions, 4);
+    std::swap(tour[i], tour[j]);
+    const float after = edges_length(dist, tour, positions, 4);
+    std::swap(tour[i], tour[j]);
+    return after - before;
+}
+
+// reverses tour[i + 1..j], with i < j
+template <typename Metric>
+static float two_opt_delta(const Metric &dist, const std::vector<int> &tour, int i, int j) {
+    const int n = tour.size();
+    const int a = tour[i];
+    const int b = tour[i + 1];
+    const int c = tour[j];
+    const int d = tour[(j + 1) % n];
+    return dist(a, c) + dist(b, d) - dist(a, b) - dist(c, d);
+}
+
+// moves the segment tour[i..i + len - 1] between tour[p] and tour[p + 1], p outside the segment
+template <typename Metric>
+static float or_opt_delta(const Metric &dist, const std::vector<int> &tour, int i, int len, int p) {
+    const int n = tour.size();
+    const int prev = tour[(i + n - 1) % n];
+    const int first = tour[i];
+    const int last = tour[(i + len - 1) % n];
+    const int next = tour[(i + len) % n];
+    const int x = tour[p];
+    const int y = tour[(p + 1) % n];
+    const float removed = dist(prev, first) + dist(last, next) - dist(prev, next);
+    const float inserted = dist(x, first) + dist(last, y) - dist(x, y);
+    return inserted - removed;
+}
+
+static void apply_or_opt(std::vector<int> &tour, int i, int len, int p) {
+    // positions are not wrapped: the caller only picks segments inside the vector
+    if (p > i) {
+        std::rotate(tour.begin() + i, tour.begin() + i + len, tour.begin() + p + 1);
+    } else {
+        std::rotate(tour.begin() + p + 1, tour.begin() + i, tour.begin() + i + len);
+    }
+}
+
+// Simulated annealing over swap, 2-opt and or-opt moves. Every move is scored by the
+// change of the edges it touches, so an iteration costs O(1) unless it is accepted.
+// The schedule starts at the given temperature and stops early at the deadline.
+template <typename Metric>
+static std::vector<int> anneal_tour(const Metric &dist, std::vector<int> tour, std::mt19937 &rng,
+                                    double start_temperature, const deadline_t &deadline) {
+    const int n = tour.size();
+    if (n < 4) {
+        return tour;
+    }
+
+    // moves are cheap now, so larger playlists get proportionally more of them
+    const double steps = std::max(23000.0, 200.0 * n);
+    double T = start_temperature;
+    double absoluteTemperature = 1e-4;
+    double coolingRate = std::pow(absoluteTemperature / T, 1.0 / steps);
+
+    std::uniform_real_distribution<double> dist01(0.0, 1.0);
+    std::uniform_int_distribution<int> position(0, n - 1);
+    std::uniform_int_distribution<int> move_type(0, 2);
+    std::uniform_int_distribution<int> segment_length(1, 3);
+
+    std::vector<int> best_tour = tour;
+    double current_dist = tour_length(dist, tour);
+    double best_dist = current_dist;
+
+    for (size_t iteration = 0; T > absoluteTemperature; iteration++) {
+        if ((iteration & 1023) == 0 && expired(deadline)) {
+            break;
+        }
+        const int move = move_type(rng);
+        int i = position(rng);
+        int j = position(rng);
+        int len = 1;
+        bool valid = false;
+        double delta = 0.0;
+        if (move == 0) {
+            valid = i != j;
+            if (valid) {
+                delta = swap_delta(dist, tour, i, j);
+            }
+        } else if (move == 1) {
+            if (i > j) {
+                std::swap(i, j);
+            }
+            valid = j - i >= 2 && !(i == 0 && j == n - 1);
+            if (valid) {
+                delta = two_opt_delta(dist, tour, i, j);
+            }
+        } else {
+            len = std::min(segment_length(rng), n - 3);
+            valid = i + len <= n && !(j >= i - 1 && j < i + len) && !(i == 0 && j == n - 1);
+            if (valid) {
+                delta = or_opt_delta(dist, tour, i, len, j);
+            }
+        }
+
+        if (valid && (delta < 0 || dist01(rng) < std::exp(-delta / T))) {
+            if (move == 0) {
+                std::swap(tour[i], tour[j]);
+            } else if (move == 1) {
+                std::reverse(tour.begin() + i + 1, tour.begin() + j + 1);
+            } else {
+                apply_or_opt(tour, i, len, j);
+            }
+            current_dist += delta;
+            if (current_dist < best_dist) {
+                best_tour = tour;
+                best_dist = current_dist;
+            }
+        }
+
+        T *= coolingRate;
+    }
+    return best_tour;
+}
+
+// one independent chain per allowed thread
+static size_t chain_count(const reorder_options &options) {
+    size_t num_chains = std::max(1u, std::thread::hardware_concurrency());
+    if (options.jobs > 0) {
+        num_chains = std::min(num_chains, static_cast<size_t>(options.jobs));
+    }
+    return num_chains;
+}
+
+static std::mt19937 chain_rng(uint64_t seed, size_t index) {
+    std::seed_seq seq{static_cast<uint32_t>(seed), static_cast<uint32_t>(seed >> 32), static_cast<uint32_t>(index)};
+    return std::mt19937(seq);
+}
+
+// Runs chain(index) for every chain on its own thread and returns the best path or tour.
+template <typename Chain>
+static std::vector<int> best_of_chains(size_t num_chains, const Chain &chain) {
+    std::vector<std::vector<int>> best_results(num_chains);
+    std::vector<float> best_lengths(num_chains);
+    auto run = [&](size_t index) { std::tie(best_results[index], best_lengths[index]) = chain(index); };
+
+    std::vector<std::thread> threads;
+    for (size_t i = 1; i < num_chains; i++) {
+        threads.emplace_back(run, i);
+    }
+    run(0);
+    for (auto &thread : threads) {
+        thread.join();
+    }
+
+    const size_t best = std::min_element(best_lengths.begin(), best_lengths.end()) - best_lengths.begin();
+    return best_results[best];
+}
+
+// Runs independent annealing chains on all the allowed threads and returns the best tour.
+template <typename Metric>
+static std::vector<int> solve_tour(const Metric &dist, const std::vector<int> &tour, const reorder_options &options) {
+    const deadline_t deadline = make_deadline(options);
+    const uint64_t seed = make_seed(options);
+
+    return best_of_chains(chain_count(options), [&](size_t index) {
+        std::mt19937 rng = chain_rng(seed, index);
+
+        // the first chain starts from the given order, the others from random tours
+        std::vector<int> best = tour;
+        if (index > 0) {
+            std::shuffle(best.begin(), best.end(), rng);
+        }
+        best = anneal_tour(dist, best, rng, 10.0, deadline);
+        float best_length = tour_length(dist, best);
+        // reheat from the best tour while the time budget lasts
+        while (deadline.has_value() && !expired(deadline)) {
+            std::vector<int> candidate = anneal_tour(dist, best, rng, 1.0, deadline);
+            const float length = tour_length(dist, candidate);
+            if (length < best_length) {
+                best = std::move(candidate);
+                best_length = length;
+            }
+        }
+        return std::make_pair(std::move(best), best_length);
+    });
+}
+
+static std::vector<int> anneal_path(const distance_matrix &dist, int first, const reorder_options &options) {
+    const int n = dist.size();
+    // twice the longest edge is more than any detour that avoids the penalty can save
+    const closed_path_metric metric = {dist, n, first, 2.f * dist.max() + 1.f};
+
+    std::vector<int> tour(n);
+    std::iota(tour.begin(), tour.end(), 0);
+    if (first >= 0) {
+        std::rotate(tour.begin(), tour.begin() + first, tour.begin() + first + 1);
+    }
+    tour.push_back(n);
+    tour = solve_tour(metric, tour, options);
+
+    // cut the tour open at the virtual track
+    const auto cut = std::find(tour.begin(), tour.end(), n);
+    std::vector<int> path(cut + 1, tour.end());
+    path.insert(path.end(), tour.begin(), cut);
+    if (first >= 0 && path.front() != first) {
+        if (path.back() == first) {
+            std::reverse(path.begin(), path.end());
+        } else {
+            std::rotate(path.begin(), std::find(path.begin(), path.end(), first), path.end());
+        }
+    }
+    return path;
+}
+
+// The closest tracks of every track, nearest first.
+static std::vector<std::vector<int>> neighbour_lists(const distance_matrix &dist, int k) {
+    const int n = dist.size();
+    k = std::min(k, n - 1);
+    std::vector<std::vector<int>> neighbours(n);
+    std::vector<int> order(n);
+    std::vector<float> row(n);
+    for (int a = 0; a < n; a++) {
+        for (int x = 0; x < n; x++) {
+            row[x] = dist(a, x);
+        }
+        std::iota(order.begin(), order.end(), 0);
+        std::swap(order[a], order[n - 1]);
+        auto closer = [&](int x, int y) { return row[x] < row[y]; };
+        std::nth_element(order.begin(), order.begin() + k, order.end() - 1, closer);
+        std::sort(order.begin(), order.begin() + k, closer);
+        neighbours[a].assign(order.begin(), order.begin() + k);
+    }
+    return neighbours;
+}
+
+static std::vector<int> nearest_neighbour_path(const distance_matrix &dist, const std::vector<std::vector<int>> &neighbours,
+                                               int start) {
+    const int n = dist.size();
+    std::vector<char> used(n, 0);
+    std::vector<int> path;
+    path.reserve(n);
+    for (int current = start; current >= 0;) {
+        path.push_back(current);
+        used[current] = 1;
+        int next = -1;
+        for (int c : neighbours[current]) {
+            if (!used[c]) {
+                next = c;
+                break;
+            }
+        }
+        // all the neighbours are taken, fall back to a full scan
+        if (next < 0) {
+            for (int c = 0; c < n; c++) {
+                if (!used[c] && (next < 0 || dist(current, c) < dist(current, next))) {
+                    next = c;
+                }
+            }
+        }
+        current = next;
+    }
+    return path;
+}
+
+// First improvement 2-opt and or-opt over the nearest neighbour lists. Only the moves
+// that connect a track to one of its neighbours are tried, and only the tracks whose
+// edges changed are examined again.
+class path_optimizer {
+  public:
+    path_optimizer(const distance_matrix &dist, const std::vector<std::vector<int>> &neighbours, std::vector<int> path,
+                   bool fixed_start)
+        : m_dist(dist), m_neighbours(neighbours), m_path(std::move(path)), m_position(m_path.size()),
+          m_queued(m_path.size(), 0), m_fixed_start(fixed_start) {
+        for (size_t i = 0; i < m_path.size(); i++) {
+            m_position[m_path[i]] = i;
+        }
+    }
+
+    const std::vector<int> &path() const {
+        return m_path;
+    }
+
+    void set_path(const std::vector<int> &path) {
+        m_path = path;
+        for (size_t i = 0; i < m_path.size(); i++) {
+            m_position[m_path[i]] = i;
+        }
+    }
+
+    void push(int track) {
+        if (!m_queued[track]) {
+            m_queued[track] = 1;
+            m_queue.push_back(track);
+        }
+    }
+
+    void push_all() {
+        for (int track : m_path) {
+            push(track);
+        }
+    }
+
+    void optimize(const deadline_t &deadline) {
+        for (size_t iteration = 0; !m_queue.empty(); iteration++) {
+            if ((iteration & 255) == 0 && expired(deadline)) {
+                break;
+            }
+            const int track = m_queue.front();
+            m_queue.pop_front();
+            m_queued[track] = 0;
+            while (improve_two_opt(track) || improve_or_opt(track)) {
+            }
+        }
+        m_queue.clear();
+        std::fill(m_queued.begin(), m_queued.end(), 0);
+    }
+
+    // Moves the middle two of four random segments past each other, which no sequence
+    // of improving 2-opt moves can undo. The start of the path stays in place.
+    void double_bridge(std::mt19937 &rng) {
+        const int n = m_path.size();
+        const int lo = m_fixed_start ? 1 : 0;
+        if (n - lo < 4) {
+            return;
+        }
+        std::uniform_int_distribution<int> cut(lo + 1, n - 1);
+        int cuts[3] = {cut(rng), cut(rng), cut(rng)};
+        std::sort(cuts, cuts + 3);
+        if (cuts[0] == cuts[1] || cuts[1] == cuts[2]) {
+            return;
+        }
+        std::rotate(m_path.begin() + cuts[0], m_path.begin() + cuts[1], m_path.begin() + cuts[2]);
+        for (int i = cuts[0]; i < cuts[2]; i++) {
+            m_position[m_path[i]] = i;
+        }
+        for (int c : cuts) {
+            push(m_path[c - 1]);
+            push(m_path[c]);
+        }
+        push(m_path[cuts[0] + cuts[2] - cuts[1] - 1]);
+        push(m_path[cuts[0] + cuts[2] - cuts[1]]);
+    }
+
+  private:
+    static constexpr float EPSILON = 1e-6f;
+
+    // distance between the tracks at two positions, 0 when one is past the ends
+    float link(int i, int j) const {
+        const int n = m_path.size();
+        if (i < 0 || j < 0 || i >= n || j >= n) {
+            return 0.f;
+        }
+        return m_dist(m_path[i], m_path[j]);
+    }
+
+    float edge(int i) const {
+        return link(i, i + 1);
+    }
+
+    float reverse_delta(int l, int r) const {
+        return link(l - 1, r) + link(l, r + 1) - edge(l - 1) - edge(r);
+    }
+
+    void push_position(int i) {
+        if (i >= 0 && i < static_cast<int>(m_path.size())) {
+            push(m_path[i]);
+        }
+    }
+
+    void reverse(int l, int r) {
+        std::reverse(m_path.begin() + l, m_path.begin() + r + 1);
+        for (int i = l; i <= r; i++) {
+            m_position[m_path[i]] = i;
+        }
+        push_position(l - 1);
+        push_position(l);
+        push_position(r);
+        push_position(r + 1);
+    }
+
+    // moves path[i..i + len - 1] between the positions after and after + 1
+    void move_segment(int i, int len, int after, bool reversed) {
+        push_position(i - 1);
+        push_position(i + len);
+        push_position(after);
+        push_position(after + 1);
+        int start, lo, hi;
+        if (after < i) {
+            std::rotate(m_path.begin() + after + 1, m_path.begin() + i, m_path.begin() + i + len);
+            start = after + 1;
+            lo = after + 1;
+            hi = i + len - 1;
+        } else {
+            std::rotate(m_path.begin() + i, m_path.begin() + i + len, m_path.begin() + after + 1);
+            start = after - len + 1;
+            lo = i;
+            hi = after;
+        }
+        if (reversed) {
+            std::reverse(m_path.begin() + start, m_path.begin() + start + len);
+        }
+        for (int p = lo; p <= hi; p++) {
+            m_position[m_path[p]] = p;
+        }
+        push_position(start);
+        push_position(start + len - 1);
+    }
+
+    // reverses the part of the path between the track and one of its neighbours so that
+    // the two become adjacent
+    bool improve_two_opt(int a) {
+        const int n = m_path.size();
+        const int i = m_position[a];
+        const bool at_end = (i == 0 && !m_fixed_start) || i == n - 1;
+        const float longest = std::max(edge(i - 1), edge(i));
+        for (int c : m_neighbours[a]) {
+            if (!at_end && m_dist(a, c) >= longest) {
+                break;
+            }
+            const int j = m_position[c];
+            const int lo = std::min(i, j);
+            const int hi = std::max(i, j);
+            if (hi - lo < 2) {
+                continue;
+            }
+            float best = -EPSILON;
+            int best_l = -1;
+            const float after_lo = reverse_delta(lo + 1, hi);
+            if (after_lo < best) {
+                best = after_lo;
+                best_l = lo + 1;
+            }
+            if (!(m_fixed_start && lo == 0)) {
+                const float before_hi = reverse_delta(lo, hi - 1);
+                if (before_hi < best) {
+                    best = before_hi;
+                    best_l = lo;
+                }
+            }
+            if (best_l >= 0) {
+                reverse(best_l, best_l == lo ? hi - 1 : hi);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // moves a segment of up to three tracks that starts at the track next to one of its
+    // neighbours, in the orientation that keeps the two adjacent
+    bool improve_or_opt(int a) {
+        const int n = m_path.size();
+        const int i = m_position[a];
+        if (m_fixed_start && i == 0) {
+            return false;
+        }
+        for (int len = 1; len <= 3 && i + len <= n; len++) {
+            const int last = m_path[i + len - 1];
+            const float removed = edge(i - 1) + edge(i + len - 1) - link(i - 1, i + len);
+            if (removed <= EPSILON) {
+                continue;
+            }
+            for (int c : m_neighbours[a]) {
+                const float d = m_dist(a, c);
+                if (d >= removed) {
+                    break;
+                }
+                const int j = m_position[c];
+                if (j >= i && j < i + len) {
+                    continue;
+                }
+                // c, a .. last, next of c
+                if (j + 1 != i) {
+                    const float added = d + (j + 1 < n ? m_dist(last, m_path[j + 1]) : 0.f) - edge(j);
+                    if (added - removed < -EPSILON) {
+                        move_segment(i, len, j, false);
+                        return true;
+                    }
+                }
+                // previous of c, last .. a, c
+                if (j - 1 != i + len - 1 && !(m_fixed_start && j == 0)) {
+                    const float added = (j > 0 ? m_dist(m_path[j - 1], last) : 0.f) + d - edge(j - 1);
+                    if (added - removed < -EPSILON) {
+                        move_segment(i, len, j - 1, true);
+                        return true;
+                    }
+                }
+            }
+        }
+        return false;
+    }
+
+    const distance_matrix &m_dist;
+    const std::vector<std::vector<int>> &m_neighbours;
+    std::vector<int> m_path;
+    std::vector<int> m_position;
+    std::vector<char> m_queued;
+    std::deque<int> m_queue;
+    bool m_fixed_start;
+};
+
+// Runs one iterated local search per allowed thread and returns the best path. Every chain
+// optimizes a nearest neighbour path, the first one from the first track and the others
+// from random ones, then keeps kicking its best path while the time budget lasts.
+static std::vector<int> local_search_path(const distance_matrix &dist, int first, const reorder_options &options) {
+    constexpr int NEIGHBOURS = 10;
+    const int n = dist.size();
+    const deadline_t deadline = make_deadline(options);
+    const uint64_t seed = make_seed(options);
+    const std::vector<std::vector<int>> neighbours = neighbour_lists(dist, NEIGHBOURS);
+
+    return best_of_chains(chain_count(options), [&](size_t index) {
+        std::mt19937 rng = chain_rng(seed, index);
+        int start = std::max(first, 0);
+        if (index > 0 && first < 0) {
+            start = std::uniform_int_distribution<int>(0, n - 1)(rng);
+        }
+        path_optimizer optimizer(dist, neighbours, nearest_neighbour_path(dist, neighbours, start), first >= 0);
+        if (index > 0 && first >= 0) {
+            // the path of a fixed start is the same for every chain, kick it apart
+            optimizer.double_bridge(rng);
+        }
+        optimizer.push_all();
+        optimizer.optimize(deadline);
+
+        // with a time budget keep kicking the best path and optimizing around the kick
+        std::vector<int> best = optimizer.path();
+        float best_length = path_length(dist, best);
+        while (deadline.has_value() && !expired(deadline)) {
+            optimizer.double_bridge(rng);
+            optimizer.optimize(deadline);
+            const float length = path_length(dist, optimizer.path());
+            if (length < best_length) {
+                best = optimizer.path();
+                best_length = length;
+            } else {
+                optimizer.set_path(best);
+            }
+        }
+        return std::make_pair(std::move(best), best_length);
+    });
+}
+
+std::vector<int> solve_path(const distance_matrix &dist, std::optional<int> first, const reorder_options &options) {
+    const int n = dist.size();
+    if (n == 0) {
+        return {};
+    }
+    const int first_track = first.has_value() && *first >= 0 && *first < n ? *first : -1;
+
+    switch (select_reorder_solver(n, options.solver)) {
+    case reorder_solver::exact:
+        return held_karp(dist, first_track);
+    case reorder_solver::local_search:
+        return local_search_path(dist, first_track, options);
+    default:
+        return anneal_path(dist, first_track, options);
+    }
+}
+
+} // namespace deejai
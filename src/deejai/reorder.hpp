@@ -0,0 +1,49 @@
+#pragma once
+
+#include "deejai/distance.hpp"
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace deejai {
+
+enum class reorder_solver {
+    // picks one of the others from the playlist size
+    automatic,
+    // Held-Karp dynamic programming, exponential but optimal
+    exact,
+    // multi-start simulated annealing
+    annealing,
+    // greedy construction improved by 2-opt and or-opt moves over nearest neighbour lists
+    local_search,
+};
+
+std::optional<reorder_solver> reorder_solver_from_string(const std::string &name);
+std::string reorder_solver_name(reorder_solver solver);
+
+struct reorder_options {
+    // number of independent annealing or local search chains, -1 uses every core
+    int jobs = -1;
+    // keep improving the playlist until the budget is spent, 0 runs each solver once
+    double time_budget_ms = 0.0;
+    // fixed seed for reproducible results with the same number of jobs and no time budget
+    std::optional<uint64_t> seed;
+    reorder_solver solver = reorder_solver::automatic;
+};
+
+// the largest playlist solved exactly and the smallest one given to the local search
+constexpr int EXACT_REORDER_MAX_TRACKS = 12;
+constexpr int LOCAL_SEARCH_REORDER_MIN_TRACKS = 24;
+
+reorder_solver select_reorder_solver(int n, reorder_solver requested = reorder_solver::automatic);
+
+// Paths are open and refer to the tracks of a distance matrix.
+float path_length(const distance_matrix &dist, const std::vector<int> &path);
+
+// Orders all the tracks of the distance matrix into the shortest path the selected solver
+// finds. When first is set the path starts from it.
+std::vector<int> solve_path(const distance_matrix &dist, std::optional<int> first, const reorder_options &options);
+
+} // namespace deejai
@@ -1,16 +1,25 @@
 #include "deejai/scanner.hpp"
+#include "deejai/frontend.hpp"
+#include "deejai/memory_budget.hpp"
+#include "deejai/trace.hpp"
 #include "deejai/utils.hpp"
-#include "librosa.h"
 
 #include <Eigen/Dense>
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstring>
 #include <filesystem>
+#include <fstream>
+#include <iostream>
 #include <mutex>
 #include <onnxruntime_cxx_api.h>
 #include <optional>
-#include <queue>
 #include <string>
+#include <string_view>
+#include <thread>
 #include <unordered_map>
-#include <unsupported/Eigen/CXX11/Tensor>
+#include <unordered_set>
 #include <vector>
 
 #ifdef _WIN32
@@ -65,6 +74,7 @@ std::vector<Ort::Value> scanner::predict(const audio_file_tensor &input_tensor)
         output_names.push_back(output_name_ptrs.back().get());
     }
 
+    trace::scoped_timer timer("inference");
     std::vector<Ort::Value> output_tensors =
         m_session.Run(Ort::RunOptions{nullptr}, input_names.data(), &input_tensor.tensor, 1,
                       output_names.data(), output_names.size());
@@ -75,31 +85,72 @@ bool scanner::is_batch_file(const std::string &path) {
     return path.starts_with("batch_") && path.ends_with(".bin");
 }
 
-std::optional<audio_file_tensor> scanner::tensor_from_audio(const std::string &audio_path) const {
-    const int sampling_rate = 22050;
-    const int n_fft = 2048;
-    const int hop_length = 512;
-    const auto shape = input_shape();
-    const int n_mels = shape[2];
-    const int slice_size = shape[3];
+static int batch_number(const std::string &batch_filename) {
+    try {
+        return std::stoi(batch_filename.substr(6, batch_filename.size() - 10));
+    } catch (const std::exception &) {
+        return 0;
+    }
+}
 
-    auto vec = utils::load_audio(audio_path, sampling_rate);
-    if (!vec.has_value()) {
-        return std::nullopt;
+// The journal records the batch files that were completely written and whether the
+// final bundle was committed, so that an interrupted scan resumes where it stopped.
+static scan_journal read_scan_journal(const std::filesystem::path &path) {
+    scan_journal journal;
+    std::ifstream ifs(path);
+    std::string line;
+    while (std::getline(ifs, line)) {
+        if (line.starts_with("batch ")) {
+            journal.batches.push_back(line.substr(6));
+        } else if (line == "bundle") {
+            journal.bundle_committed = true;
+        }
     }
+    return journal;
+}
 
-    auto vector = vec.value();
-    if (vector.size() < slice_size) {
+static bool write_scan_journal(const std::filesystem::path &path, const scan_journal &journal) {
+    std::string data;
+    for (const auto &batch : journal.batches) {
+        data += "batch " + batch + "\n";
+    }
+    if (journal.bundle_committed) {
+        data += "bundle\n";
+    }
+    return utils::atomic_write_file(path, data);
+}
+
+// Creates the tensor over the values, which must outlive it.
+static Ort::Value input_tensor(std::span<const float> values, int64_t batch, int n_mels, int slice_size) {
+    const std::array<int64_t, 4> input_shape = {batch, 1, n_mels, slice_size};
+    Ort::MemoryInfo memory_info = Ort::MemoryInfo::CreateCpu(OrtDeviceAllocator, OrtMemTypeDefault);
+    return Ort::Value::CreateTensor<float>(memory_info, const_cast<float *>(values.data()), values.size(),
+                                           input_shape.data(), input_shape.size());
+}
+
+std::optional<audio_file_tensor> tensor_from_samples(std::span<const float> samples, int n_mels, int slice_size,
+                                                     arena &scratch) {
+    const int sampling_rate = 22050;
+    const int n_fft = 2048;
+    const int hop_length = 512;
+    if (samples.size() < static_cast<size_t>(slice_size)) {
         return std::nullopt;
     }
 
-    matrixf S = librosa::internal::melspectrogram(vector, sampling_rate, n_fft, hop_length, "hann", true,
-                                                  "constant", 2, n_mels, 0, sampling_rate / 2);
-    int batch = S.cols() / slice_size;
-    Eigen::Tensor<float, 4> x(batch, 1, n_mels, slice_size);
+    const Eigen::Map<matrixf> S = [&] {
+        trace::scoped_timer timer("melspectrogram");
+        return mel_spectrogram(samples, sampling_rate, n_fft, hop_length, n_mels, scratch);
+    }();
+    // the decibel scaling and normalisation of every slice
+    trace::scoped_timer timer("log_slices");
+    const int batch = S.cols() / slice_size;
+    const size_t slice_values = static_cast<size_t>(n_mels) * slice_size;
+    float *values = scratch.allocate<float>(batch * slice_values);
+    Eigen::Map<matrixf> submatrix(scratch.allocate<float>(slice_values), n_mels, slice_size);
+    Eigen::Map<matrixf> log_S(scratch.allocate<float>(slice_values), n_mels, slice_size);
     for (int slice = 0; slice < batch; slice++) {
-        matrixf submatrix = S.block(0, slice * slice_size, S.rows(), slice_size);
-        matrixf log_S = librosa::internal::power2db(submatrix);
+        submatrix = S.block(0, slice * slice_size, S.rows(), slice_size);
+        power_to_db(submatrix.data(), slice_values, log_S.data());
 
         float max_val = log_S.maxCoeff();
         float min_val = log_S.minCoeff();
@@ -109,29 +160,109 @@ std::optional<audio_file_tensor> scanner::tensor_from_audio(const std::string &a
             log_S = (log_S.array() - min_val) / denom;
         }
 
+        // in the order of the column-major batch x 1 x n_mels x slice_size tensor the model
+        // has always been given
         for (int xi = 0; xi < n_mels; xi++) {
             for (int yi = 0; yi < slice_size; yi++) {
-                x(slice, 0, xi, yi) = log_S(xi, yi);
+                values[slice + batch * (xi + n_mels * yi)] = log_S(xi, yi);
             }
         }
     }
 
-    // Flatten the Eigen tensor to a 1D std::vector
-    std::vector<float> input_values(x.size());
-    std::copy(x.data(), x.data() + x.size(), input_values.begin());
-    // Define the shape (same order as in Eigen: [N, C, H, W])
-    std::vector<int64_t> input_shape = {
-        static_cast<int64_t>(x.dimension(0)), static_cast<int64_t>(x.dimension(1)),
-        static_cast<int64_t>(x.dimension(2)), static_cast<int64_t>(x.dimension(3))};
+    audio_file_tensor tensor;
+    tensor.values = std::span<const float>(values, batch * slice_values);
+    tensor.tensor = input_tensor(tensor.values, batch, n_mels, slice_size);
+    return tensor;
+}
 
-    Ort::MemoryInfo memory_info = Ort::MemoryInfo::CreateCpu(OrtDeviceAllocator, OrtMemTypeDefault);
-    Ort::Value input_tensor = Ort::Value::CreateTensor<float>(memory_info, input_values.data(), input_values.size(),
-                                                              input_shape.data(), input_shape.size());
+std::optional<audio_file_tensor> tensor_from_samples(vectorf &samples, int n_mels, int slice_size) {
+    arena scratch;
+    auto tensor = tensor_from_samples(std::span<const float>(samples.data(), samples.size()), n_mels, slice_size,
+                                      scratch);
+    if (!tensor.has_value()) {
+        return std::nullopt;
+    }
+    // copied out of the arena, which is freed on return
+    tensor->buffer.assign(tensor->values.begin(), tensor->values.end());
+    tensor->values = tensor->buffer;
+    const int64_t batch = static_cast<int64_t>(tensor->buffer.size()) / (n_mels * slice_size);
+    tensor->tensor = input_tensor(tensor->values, batch, n_mels, slice_size);
+    return tensor;
+}
 
-    audio_file_tensor tensor;
-    tensor.buffer = std::move(input_values);
-    tensor.tensor = std::move(input_tensor);
-    tensor.audio_path = audio_path;
+std::vector<vectorf> tfidf_vectors(const std::vector<const matrixf *> &tracks, double epsilon) {
+    std::vector<vectorf> audio_vecs;
+    std::vector<std::vector<int>> audio_indices(tracks.size());
+    for (size_t k = 0; k < tracks.size(); k++) {
+        const matrixf &matrix = *tracks[k];
+        for (int i = 0; i < matrix.rows(); i++) {
+            vectorf row = matrix.row(i);
+            audio_indices[k].push_back(audio_vecs.size());
+            audio_vecs.emplace_back(row / row.norm());
+        }
+    }
+
+    // cosine distances
+    int num_audio_vecs = audio_vecs.size();
+    matrixf cos_distances = matrixf::Zero(num_audio_vecs, num_audio_vecs);
+    for (int i = 0; i != num_audio_vecs; i++) {
+        for (int j = i + 1; j != num_audio_vecs; j++) {
+            float dot = audio_vecs[i].dot(audio_vecs[j]);
+            cos_distances(i, j) = 1.0f - dot;
+        }
+    }
+    cos_distances = cos_distances.selfadjointView<Eigen::Upper>();
+
+    // IDF weights
+    std::vector<float> idfs;
+    for (int i = 0; i != num_audio_vecs; i++) {
+        int idf_count = 0;
+        for (const auto &indices : audio_indices) {
+            for (int j : indices) {
+                if (cos_distances(i, j) < epsilon) {
+                    idf_count++;
+                    break;
+                }
+            }
+        }
+        float ratio = static_cast<float>(idf_count) / static_cast<float>(tracks.size());
+        idfs.push_back(-std::log(ratio));
+    }
+
+    // TF weights
+    std::vector<vectorf> vecs;
+    for (size_t k = 0; k < tracks.size(); k++) {
+        vectorf vec = vectorf::Zero(tracks[k]->cols());
+        const auto &indices = audio_indices[k];
+        for (int i : indices) {
+            int tf = 0;
+            for (int j : indices) {
+                if (cos_distances(i, j) < epsilon) {
+                    tf++;
+                }
+            }
+            vec += audio_vecs.at(i) * (tf * idfs[i]);
+        }
+        vecs.push_back(vec);
+    }
+    return vecs;
+}
+
+std::optional<audio_file_tensor> scanner::tensor_from_audio(const std::string &audio_path, arena &scratch) const {
+    const auto shape = input_shape();
+    std::optional<std::span<const float>> samples;
+    {
+        trace::scoped_timer timer("load_audio");
+        samples = utils::load_audio(audio_path, 22050, scratch);
+    }
+    if (!samples.has_value()) {
+        return std::nullopt;
+    }
+
+    auto tensor = tensor_from_samples(*samples, shape[2], shape[3], scratch);
+    if (tensor.has_value()) {
+        tensor->audio_path = audio_path;
+    }
     return tensor;
 }
 
@@ -151,11 +282,94 @@ double scanner::epsilon() const {
     return m_epsilon_distance;
 }
 
+void scanner::set_bundle_format(storage_format format) {
+    m_bundle_format = format;
+}
+
+storage_format scanner::bundle_format() const {
+    return m_bundle_format;
+}
+
+void scanner::set_graph_neighbours(int neighbours) {
+    m_graph_neighbours = std::max(neighbours, 0);
+}
+
+int scanner::graph_neighbours() const {
+    return m_graph_neighbours;
+}
+
+void scanner::set_max_memory(size_t bytes) {
+    m_max_memory = bytes;
+}
+
+size_t scanner::max_memory() const {
+    return m_max_memory;
+}
+
+void scanner::set_progress_callback(std::function<void(int, int)> callback) {
+    m_progress = std::move(callback);
+}
+
+// Memory of the scan of a second of audio: the 16 bit and float samples, the mel
+// spectrogram and the model input in the arena of the worker with room for its blocks to
+// grow, and the activations of the model on the slices, which dominate.
+static constexpr size_t SCAN_BYTES_PER_SECOND = 2 << 20;
+// the inference and the vectors of a file, whatever its length
+static constexpr size_t SCAN_BYTES_PER_FILE = 32 << 20;
+
+static std::optional<uint32_t> wav_byte_rate(const std::filesystem::path &path) {
+    char header[32];
+    std::ifstream ifs(path, std::ios::binary);
+    if (!ifs.read(header, sizeof(header)) || std::memcmp(header, "RIFF", 4) != 0 ||
+        std::memcmp(header + 8, "WAVEfmt ", 8) != 0) {
+        return std::nullopt;
+    }
+    uint32_t byte_rate = 0;
+    std::memcpy(&byte_rate, header + 28, sizeof(byte_rate));
+    return byte_rate > 0 ? std::optional<uint32_t>(byte_rate) : std::nullopt;
+}
+
+// The duration of an audio file from its size, at the byte rate of a WAV header or a low
+// bitrate of its codec, so that a duration is rather over than under estimated.
+static double estimated_seconds(const std::filesystem::path &path) {
+    std::error_code ec;
+    const uintmax_t size = std::filesystem::file_size(path, ec);
+    if (ec) {
+        return utils::MAX_AUDIO_SECONDS;
+    }
+    std::u8string u8 = path.extension().u8string();
+    std::string extension(u8.begin(), u8.end());
+    std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+    // 96 kbit/s for the lossy codecs
+    double bytes_per_second = 12000;
+    if (extension == ".wav") {
+        // without a readable header, mono 16 bit at 22050 Hz
+        bytes_per_second = wav_byte_rate(path).value_or(44100);
+    } else if (extension == ".flac") {
+        bytes_per_second = 48000;
+    }
+    // longer files are skipped once that much is decoded
+    return std::min<double>(size / bytes_per_second, utils::MAX_AUDIO_SECONDS);
+}
+
+static size_t estimated_scan_memory(const std::string &path) {
+    const double seconds = estimated_seconds(std::filesystem::path(std::u8string(path.begin(), path.end())));
+    return SCAN_BYTES_PER_FILE + static_cast<size_t>(seconds * SCAN_BYTES_PER_SECOND);
+}
+
 bool scanner::scan(const std::vector<std::string> &paths, int jobs) {
     const std::filesystem::path bundled_dir = std::filesystem::path(m_save_directory) / BUNDLED_VECS_DIRNAME;
     const std::filesystem::path bundled_vecs_path = bundled_dir / BUNDLED_VECS_FILENAME;
 
-    auto files = utils::find_audio_files_recursively(paths);
+    std::vector<std::string> unreadable_dirs;
+    std::vector<std::string> symlinked_dirs;
+    auto files = utils::find_audio_files_recursively(paths, unreadable_dirs, symlinked_dirs);
+    for (const auto &dir : unreadable_dirs) {
+        std::cerr << "Could not read the directory " << dir << ", its files are kept in the library" << std::endl;
+    }
+    // the tracks under the directories the walk did not enter are checked on disk
+    std::vector<std::string> unwalked_dirs = std::move(unreadable_dirs);
+    unwalked_dirs.insert(unwalked_dirs.end(), symlinked_dirs.begin(), symlinked_dirs.end());
     std::mt19937 random_engine(std::random_device{}());
     std::shuffle(files.begin(), files.end(), random_engine);
 
@@ -176,21 +390,8 @@ bool scanner::scan(const std::vector<std::string> &paths, int jobs) {
     const int total_files = files.size();
     std::mutex scan_mutex;
     std::atomic<int> current{0};
-    auto scan_worker_fun = [&](const std::string &file) {
-        int value = current.fetch_add(1, std::memory_order_relaxed) + 1;
-        std::u8string u8(file.begin(), file.end());
-        std::u8string scanned_filename = utils::scanned_filename(u8);
-        std::filesystem::path vec_file = std::filesystem::path(m_save_directory) / std::filesystem::path(scanned_filename);
-        if (!(std::filesystem::exists(vec_file) && std::filesystem::is_regular_file(vec_file))) {
-            scan_file(file);
-            {
-                std::lock_guard<std::mutex> lock(scan_mutex);
-                if (value % 10 == 0) {
-                    std::cout << "Scan progress: " << value << " / " << total_files << std::endl;
-                }
-            }
-        }
-    };
+    // files done, in the order they finish
+    int scanned = 0;
 
     size_t max_concurrent = std::thread::hardware_concurrency();
     if (max_concurrent <= 0) {
@@ -201,58 +402,129 @@ bool scanner::scan(const std::vector<std::string> &paths, int jobs) {
         max_concurrent = std::min(max_concurrent, static_cast<size_t>(jobs));
     }
 
-    std::queue<std::thread> threads;
-    for (const auto &file : files) {
-        if (threads.size() >= max_concurrent) {
-            threads.front().join();
-            threads.pop();
+    memory_budget budget(m_max_memory);
+    // under a budget a worker only keeps the arena memory of its share between files
+    const size_t arena_share = m_max_memory / max_concurrent;
+    // Every worker keeps its thread and its arena for all the files it takes, so the
+    // buffers of a file reuse the memory of the previous one.
+    auto scan_worker_fun = [&]() {
+        arena scratch;
+        for (int value = current.fetch_add(1) + 1; value <= total_files; value = current.fetch_add(1) + 1) {
+            const std::string &file = files[value - 1];
+            std::u8string u8(file.begin(), file.end());
+            std::u8string scanned_filename = utils::scanned_filename(u8);
+            std::filesystem::path vec_file =
+                std::filesystem::path(m_save_directory) / std::filesystem::path(scanned_filename);
+            if (!(std::filesystem::exists(vec_file) && std::filesystem::is_regular_file(vec_file))) {
+                std::optional<memory_budget::reservation> reserved;
+                if (m_max_memory > 0) {
+                    trace::scoped_timer timer("admission");
+                    reserved.emplace(budget, estimated_scan_memory(file));
+                }
+                scan_file(file, scratch);
+                scratch.reset();
+                if (m_max_memory > 0 && scratch.capacity() > arena_share) {
+                    scratch.release();
+                }
+                reserved.reset();
+                if (!m_progress) {
+                    std::lock_guard<std::mutex> lock(scan_mutex);
+                    if (value % 10 == 0) {
+                        std::cout << "Scan progress: " << value << " / " << total_files << std::endl;
+                    }
+                }
+            }
+            if (m_progress) {
+                std::lock_guard<std::mutex> lock(scan_mutex);
+                m_progress(++scanned, total_files);
+            }
         }
+    };
 
-        threads.emplace(scan_worker_fun, file);
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < std::min(max_concurrent, files.size()); t++) {
+        threads.emplace_back(scan_worker_fun);
     }
-
-    // Join remaining threads
-    while (!threads.empty()) {
-        threads.front().join();
-        threads.pop();
+    for (auto &thread : threads) {
+        thread.join();
+    }
+    if (m_max_memory > 0) {
+        std::cout << "Memory budget: at most " << (budget.peak() >> 20) << " of " << (m_max_memory >> 20)
+                  << " MB estimated in use, " << budget.waits() << " files waited for memory" << std::endl;
     }
 
     // load individual file vectors
     std::unordered_map<std::string, matrixf> loaded_individual_vecs;
     for (const auto &entry : std::filesystem::directory_iterator(m_save_directory)) {
-        if (entry.is_regular_file() && entry.path().extension() == ".bin") {
-            auto matrix_map = utils::load_matrix_map(entry.path());
-            for (const auto &[audio_path, matrix] : matrix_map) {
+        if (entry.is_regular_file() && entry.path().extension() == ".tmp") {
+            // leftover of an interrupted write
+            std::filesystem::remove(entry.path());
+        } else if (entry.is_regular_file() && entry.path().extension() == ".bin") {
+            trace::scoped_timer timer("load_vectors");
+            auto matrix_map = utils::try_load_matrix_map(entry.path());
+            if (!matrix_map.has_value()) {
+                std::cerr << "Removing corrupted vector file " << entry.path() << ", it will be rescanned." << std::endl;
+                std::filesystem::remove(entry.path());
+                continue;
+            }
+            for (const auto &[audio_path, matrix] : *matrix_map) {
                 loaded_individual_vecs.emplace(audio_path, matrix);
             }
         }
     }
 
-    // load bundled vectors
+    // resume from the checkpoint journal of an interrupted scan
+    const std::filesystem::path journal_path = bundled_dir / SCAN_JOURNAL_FILENAME;
+    scan_journal journal = read_scan_journal(journal_path);
+    if (journal.bundle_committed) {
+        // the bundle already contains every batch, only the cleanup was interrupted
+        journal = scan_journal();
+    }
+
+    // load bundled vectors, their tracks and checksum let the neighbour graph be updated
     std::unordered_map<std::string, matrixf> loaded_bundled_vecs;
+    std::vector<std::string> previous_tracks;
+    std::optional<uint64_t> previous_checksum;
     if (std::filesystem::is_regular_file(bundled_vecs_path)) {
-        loaded_bundled_vecs = utils::load_matrix_map(bundled_vecs_path);
+        auto loaded_bundle = load_bundle(bundled_vecs_path);
+        if (loaded_bundle.has_value()) {
+            loaded_bundled_vecs = bundle_to_matrix_map(*loaded_bundle);
+            previous_tracks = std::move(loaded_bundle->tracks);
+            previous_checksum = utils::stored_checksum(bundled_vecs_path);
+        }
     }
-    // append vectors from batches
+    // append vectors from the batches that completed before the interruption
     int start_batch = 1;
-    if (std::filesystem::is_directory(bundled_dir)) {
-        for (const auto &entry : std::filesystem::directory_iterator(bundled_dir)) {
-            const std::u8string u8filename = entry.path().u8string();
-            const std::string filename = std::string(u8filename.begin(), u8filename.end());
-            if (entry.is_regular_file() && is_batch_file(filename)) {
-                start_batch += 1;
-                auto vecs_batch = utils::load_matrix_map(filename);
-                loaded_bundled_vecs.merge(vecs_batch);
-            }
+    std::unordered_set<std::string> finished_batches;
+    for (const auto &batch_filename : journal.batches) {
+        auto vecs_batch = utils::try_load_matrix_map(bundled_dir / batch_filename);
+        if (vecs_batch.has_value()) {
+            loaded_bundled_vecs.merge(*vecs_batch);
+            finished_batches.insert(batch_filename);
+            start_batch = std::max(start_batch, batch_number(batch_filename) + 1);
+        }
+    }
+    std::erase_if(journal.batches, [&](const std::string &name) { return !finished_batches.contains(name); });
+    for (const auto &entry : std::filesystem::directory_iterator(bundled_dir)) {
+        const std::u8string u8filename = entry.path().filename().u8string();
+        const std::string filename = std::string(u8filename.begin(), u8filename.end());
+        if (entry.is_regular_file() && (entry.path().extension() == ".tmp" ||
+                                        (is_batch_file(filename) && !finished_batches.contains(filename)))) {
+            std::filesystem::remove(entry.path());
         }
     }
     // delete the vectors of removed files
-    clean_deleted_items(loaded_bundled_vecs);
+    {
+        trace::scoped_timer timer("clean_deleted");
+        clean_deleted_items(loaded_bundled_vecs, loaded_individual_vecs, paths, unwalked_dirs, files, max_concurrent);
+    }
 
-    std::vector<std::string> remainings_vecs;
-    for (const auto &[audio_path, matrix] : loaded_individual_vecs) {
-        if (!loaded_bundled_vecs.contains(audio_path)) {
-            remainings_vecs.push_back(audio_path);
+    // the batches refer to the loaded entries directly instead of hashing the paths again
+    typedef std::pair<const std::string, matrixf> audio_entry;
+    std::vector<const audio_entry *> remainings_vecs;
+    for (const auto &entry : loaded_individual_vecs) {
+        if (!loaded_bundled_vecs.contains(entry.first)) {
+            remainings_vecs.push_back(&entry);
         }
     }
     int num_audio = remainings_vecs.size();
@@ -260,80 +532,55 @@ bool scanner::scan(const std::vector<std::string> &paths, int jobs) {
     std::vector<int> batch_indices = utils::random_permutation(num_audio);
     int num_batches = num_audio / m_batch_size + 1;
     for (int batch = 0; batch < num_batches; batch++) {
-        std::vector<std::string> audio_keys;
+        std::vector<const audio_entry *> audio_keys;
         for (int i = 0; i < m_batch_size; i++) {
             int idx = batch * m_batch_size + i;
             if (static_cast<size_t>(idx) >= batch_indices.size()) {
                 break;
             }
 
-            const std::string key = remainings_vecs[batch_indices[idx]];
-            audio_keys.push_back(key);
-        }
-        std::vector<vectorf> audio_vecs;
-        std::unordered_map<std::string, std::vector<int>> audio_indices;
-        for (const auto &key : audio_keys) {
-            audio_indices[key] = std::vector<int>();
-            const matrixf matrix = loaded_individual_vecs[key];
-            for (int i = 0; i < matrix.rows(); i++) {
-                vectorf row = matrix.row(i);
-                audio_indices[key].push_back(audio_vecs.size());
-                audio_vecs.emplace_back(row / row.norm());
-            }
+            audio_keys.push_back(remainings_vecs[batch_indices[idx]]);
         }
-
-        // cosine distances
-        int num_audio_vecs = audio_vecs.size();
-        matrixf cos_distances = matrixf::Zero(num_audio_vecs, num_audio_vecs);
-        for (int i = 0; i != num_audio_vecs; i++) {
-            for (int j = i + 1; j != num_audio_vecs; j++) {
-                float dot = audio_vecs[i].dot(audio_vecs[j]);
-                cos_distances(i, j) = 1.0f - dot;
-            }
+        std::vector<const matrixf *> matrices;
+        for (const audio_entry *entry : audio_keys) {
+            matrices.push_back(&entry->second);
         }
-        cos_distances = cos_distances.selfadjointView<Eigen::Upper>();
-
-        // IDF weights
-        std::vector<float> idfs;
-        for (int i = 0; i != num_audio_vecs; i++) {
-            int idf_count = 0;
-            for (const auto &key : audio_keys) {
-                const auto &indices = audio_indices.at(key);
-                for (int j : indices) {
-                    if (cos_distances(i, j) < m_epsilon_distance) {
-                        idf_count++;
-                        break;
-                    }
-                }
-            }
-            float ratio = static_cast<float>(idf_count) / static_cast<float>(audio_keys.size());
-            idfs.push_back(-std::log(ratio));
+        std::vector<vectorf> vecs;
+        {
+            trace::scoped_timer timer("tfidf_batch");
+            vecs = tfidf_vectors(matrices, m_epsilon_distance);
         }
-
-        // TF weights
         std::unordered_map<std::string, matrixf> batch_vec;
-        for (const auto &key : audio_keys) {
-            vectorf vec = vectorf::Zero(loaded_individual_vecs[key].cols());
-            const auto &indices = audio_indices.at(key);
-            for (int i : indices) {
-                int tf = 0;
-                for (int j : indices) {
-                    if (cos_distances(i, j) < m_epsilon_distance) {
-                        tf++;
-                    }
-                }
-                vec += audio_vecs.at(i) * (tf * idfs[i]);
-            }
-            batch_vec[key] = vec;
-            loaded_bundled_vecs[key] = vec;
+        for (size_t k = 0; k < audio_keys.size(); k++) {
+            const std::string &key = audio_keys[k]->first;
+            batch_vec[key] = vecs[k];
+            loaded_bundled_vecs[key] = std::move(vecs[k]);
         }
 
         const std::string batch_filename = std::string("batch_") + std::to_string(start_batch + batch) + ".bin";
         const std::filesystem::path batch_path = bundled_dir / batch_filename;
-        utils::save_matrix_map(batch_vec, batch_path);
+        bool batch_saved = false;
+        {
+            trace::scoped_timer timer("save_batch");
+            batch_saved = utils::save_matrix_map(batch_vec, batch_path);
+        }
+        if (batch_saved) {
+            journal.batches.push_back(batch_filename);
+            write_scan_journal(journal_path, journal);
+        }
     }
 
-    const bool save_status = utils::save_matrix_map(loaded_bundled_vecs, bundled_vecs_path);
+    bool save_status = false;
+    {
+        trace::scoped_timer timer("save_bundle");
+        save_status = save_bundled_vecs(loaded_bundled_vecs, bundled_vecs_path);
+    }
+    if (!save_status) {
+        // keep the batches and the journal, the next scan resumes from them
+        return false;
+    }
+    journal.bundle_committed = true;
+    write_scan_journal(journal_path, journal);
     for (const auto &entry : std::filesystem::directory_iterator(bundled_dir)) {
         if (entry.is_regular_file()) {
             const std::u8string u8filename = entry.path().filename().u8string();
@@ -343,11 +590,76 @@ bool scanner::scan(const std::vector<std::string> &paths, int jobs) {
             }
         }
     }
-    return save_status;
+    std::filesystem::remove(journal_path);
+    return save_knn_graph(bundled_dir, previous_tracks, previous_checksum, max_concurrent);
+}
+
+bool scanner::save_knn_graph(const std::filesystem::path &bundled_dir, const std::vector<std::string> &previous_tracks,
+                             std::optional<uint64_t> previous_checksum, size_t jobs) const {
+    const std::filesystem::path graph_path = bundled_dir / KNN_GRAPH_FILENAME;
+    if (m_graph_neighbours == 0) {
+        std::error_code ec;
+        std::filesystem::remove(graph_path, ec);
+        return true;
+    }
+
+    // built from the bundle as saved, so its rows are the ones the generator loads
+    const std::filesystem::path bundled_vecs_path = bundled_dir / BUNDLED_VECS_FILENAME;
+    const auto checksum = utils::stored_checksum(bundled_vecs_path);
+    const auto loaded = load_bundle(bundled_vecs_path);
+    if (!checksum.has_value() || !loaded.has_value()) {
+        return false;
+    }
+
+    std::optional<knn_graph> previous;
+    if (std::filesystem::is_regular_file(graph_path)) {
+        previous = knn_graph::load(graph_path);
+    }
+    const size_t kept = knn_graph::kept_neighbours(loaded->tracks.size(), m_graph_neighbours);
+    if (previous.has_value() && previous->bundle_checksum() == *checksum && static_cast<size_t>(previous->k()) == kept) {
+        std::cout << "Neighbour graph of " << previous->size() << " songs is up to date" << std::endl;
+        return true;
+    }
+
+    trace::scoped_timer timer("build_graph");
+    const auto start = std::chrono::steady_clock::now();
+    knn_graph graph;
+    if (previous.has_value() && previous_checksum.has_value() && previous->bundle_checksum() == *previous_checksum) {
+        // the tracks of both bundles are sorted, the new id of a kept track is its rank
+        std::vector<track_id> previous_ids(previous_tracks.size(), UINT32_MAX);
+        for (size_t i = 0; i < previous_tracks.size(); i++) {
+            const auto it = std::lower_bound(loaded->tracks.begin(), loaded->tracks.end(), previous_tracks[i]);
+            if (it != loaded->tracks.end() && *it == previous_tracks[i]) {
+                previous_ids[i] = static_cast<track_id>(it - loaded->tracks.begin());
+            }
+        }
+        graph = knn_graph::update(*previous, previous_ids, loaded->vectors, m_graph_neighbours, *checksum, jobs);
+    } else {
+        graph = knn_graph::build(loaded->vectors, m_graph_neighbours, *checksum, jobs);
+    }
+    // unmapped before the file is replaced
+    previous.reset();
+    const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    std::cout << "Neighbour graph of " << graph.size() << " songs built in " << elapsed.count() << " s" << std::endl;
+    return graph.save(graph_path);
+}
+
+bool scanner::save_bundled_vecs(const std::unordered_map<std::string, matrixf> &bundled_vecs,
+                                const std::filesystem::path &path) const {
+    if (m_bundle_format == storage_format::f32) {
+        return utils::save_matrix_map(bundled_vecs, path);
+    }
+
+    const bundle reference = make_bundle(bundled_vecs, storage_format::f32);
+    bundle quantized_bundle = make_bundle(bundled_vecs, m_bundle_format);
+    const float recall = quantization_recall(reference.vectors, quantized_bundle.vectors, 10, 32);
+    std::cout << "Bundle stored as " << storage_format_name(m_bundle_format) << ", recall@10 against float32: " << recall << std::endl;
+    return save_bundle(quantized_bundle.tracks, quantized_bundle.vectors, path);
 }
 
-void scanner::scan_file(const std::string &path) {
-    const auto tensor = tensor_from_audio(path);
+void scanner::scan_file(const std::string &path, arena &scratch) {
+    trace::scoped_timer timer("scan_file");
+    const auto tensor = tensor_from_audio(path, scratch);
     if (!tensor.has_value()) {
         return;
     }
@@ -360,23 +672,122 @@ void scanner::scan_file(const std::string &path) {
 
         matrixf matrix = utils::ort_to_matrix(prediction[0]);
         std::unordered_map<std::string, matrixf> map = {{tensor->audio_path, matrix}};
+        trace::scoped_timer save_timer("save_vectors");
         utils::save_matrix_map(map, save_path);
     }
 }
 
-void scanner::clean_deleted_items(std::unordered_map<std::string, matrixf> &audio_vecs) const {
-    for (auto it = audio_vecs.begin(); it != audio_vecs.end();) {
-        const std::string &key = it->first;
-        std::u8string u8 = std::u8string(key.begin(), key.end());
-        if (!std::filesystem::is_regular_file(u8)) {
-            const auto path = std::filesystem::path(m_save_directory) / utils::scanned_filename(u8);
-            if (std::filesystem::exists(path)) {
-                std::filesystem::remove(path);
+// Returns the absolute scan roots. Directory roots end with a separator so that they
+// can be used as plain prefixes, file roots are matched exactly.
+static std::vector<std::pair<std::string, bool>> absolute_roots(const std::vector<std::string> &roots) {
+    std::vector<std::pair<std::string, bool>> result;
+    for (const auto &root : roots) {
+        const std::filesystem::path path(std::u8string(root.begin(), root.end()));
+        const bool is_dir = std::filesystem::is_directory(path);
+        if (!is_dir && !std::filesystem::is_regular_file(path)) {
+            continue;
+        }
+        const std::u8string u8 = std::filesystem::absolute(path).u8string();
+        std::string str(u8.begin(), u8.end());
+        if (is_dir && !str.ends_with('/') && !str.ends_with(static_cast<char>(std::filesystem::path::preferred_separator))) {
+            str += static_cast<char>(std::filesystem::path::preferred_separator);
+        }
+        result.emplace_back(std::move(str), is_dir);
+    }
+    return result;
+}
+
+void scanner::clean_deleted_items(std::unordered_map<std::string, matrixf> &bundled_vecs,
+                                  std::unordered_map<std::string, matrixf> &individual_vecs,
+                                  const std::vector<std::string> &roots,
+                                  const std::vector<std::string> &unwalked_dirs,
+                                  const std::vector<std::string> &files,
+                                  size_t jobs) const {
+    const auto scan_roots = absolute_roots(roots);
+    auto is_enumerated_root = [&](const std::string &key) {
+        for (const auto &[root, is_dir] : scan_roots) {
+            if (is_dir ? key.starts_with(root) : key == root) {
+                return true;
+            }
+        }
+        return false;
+    };
+    std::vector<std::string> unwalked_prefixes;
+    for (const auto &dir : unwalked_dirs) {
+        unwalked_prefixes.push_back(dir);
+        if (!dir.ends_with('/') && !dir.ends_with(static_cast<char>(std::filesystem::path::preferred_separator))) {
+            unwalked_prefixes.back() += static_cast<char>(std::filesystem::path::preferred_separator);
+        }
+    }
+    auto is_unwalked = [&](const std::string &key) {
+        return std::any_of(unwalked_prefixes.begin(), unwalked_prefixes.end(),
+                           [&](const std::string &prefix) { return key.starts_with(prefix); });
+    };
+
+    std::unordered_set<std::string_view> existing(files.begin(), files.end());
+    std::vector<const std::string *> candidates;
+    // 1 for the candidates known to be deleted, the others are checked on disk
+    std::vector<char> deleted;
+    auto classify = [&](const std::string &key) {
+        if (existing.contains(key)) {
+            return;
+        }
+        // files under a scanned root that were not enumerated are gone, unless the walk
+        // could not read their directory or did not follow the symlink to it, everything
+        // else has to be checked on disk
+        candidates.push_back(&key);
+        deleted.push_back(is_enumerated_root(key) && !is_unwalked(key));
+    };
+    for (const auto &[key, _] : bundled_vecs) {
+        classify(key);
+    }
+    for (const auto &[key, _] : individual_vecs) {
+        if (!bundled_vecs.contains(key)) {
+            classify(key);
+        }
+    }
+
+    if (candidates.empty()) {
+        return;
+    }
+
+    // stat the unknown paths and remove the files of the deleted ones in parallel
+    const std::filesystem::path save_directory(m_save_directory);
+    const size_t num_threads = std::max<size_t>(1, std::min(jobs, candidates.size()));
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < num_threads; t++) {
+        threads.emplace_back([&, t]() {
+            for (size_t i = t; i < candidates.size(); i += num_threads) {
+                const std::u8string u8(candidates[i]->begin(), candidates[i]->end());
+                std::error_code ec;
+                if (!deleted[i]) {
+                    // a path that cannot be checked, e.g. for its permissions, is kept
+                    const std::filesystem::file_status status = std::filesystem::status(u8, ec);
+                    deleted[i] = status.type() == std::filesystem::file_type::not_found ||
+                                 (!ec && !std::filesystem::is_regular_file(status));
+                }
+                if (deleted[i]) {
+                    std::filesystem::remove(save_directory / utils::scanned_filename(u8), ec);
+                }
             }
-            it = audio_vecs.erase(it);
-        } else {
-            it++;
+        });
+    }
+    for (auto &thread : threads) {
+        thread.join();
+    }
+
+    size_t removed = 0;
+    for (size_t i = 0; i < candidates.size(); i++) {
+        if (deleted[i]) {
+            // a copy, the key of the map is freed by the first erase
+            const std::string key = *candidates[i];
+            bundled_vecs.erase(key);
+            individual_vecs.erase(key);
+            removed++;
         }
     }
+    if (removed > 0) {
+        std::cout << "Removed " << removed << " deleted files from the library." << std::endl;
+    }
 }
 } // namespace deejai
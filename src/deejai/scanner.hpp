@@ -1,21 +1,45 @@
 #pragma once
 
+#include "deejai/arena.hpp"
 #include "deejai/common.hpp"
+#include "deejai/embeddings.hpp"
+#include "deejai/knn_graph.hpp"
 
+#include <filesystem>
+#include <functional>
 #include <onnxruntime_cxx_api.h>
 #include <optional>
+#include <span>
 #include <string>
 #include <unordered_map>
 #include <vector>
 
 namespace deejai {
 
+struct scan_journal {
+    std::vector<std::string> batches;
+    bool bundle_committed = false;
+};
+
 struct audio_file_tensor {
+    // the model input, in buffer or in the arena the tensor was made in
+    std::span<const float> values;
     std::vector<float> buffer;
     Ort::Value tensor;
     std::string audio_path;
 };
 
+// Model input from 22050 Hz samples: the normalised log mel spectrogram of n_mels bands,
+// cut into slices of slice_size frames. nullopt when the audio is too short.
+std::optional<audio_file_tensor> tensor_from_samples(vectorf &samples, int n_mels, int slice_size);
+// The same with every buffer in the arena, the tensor is valid until it is reset.
+std::optional<audio_file_tensor> tensor_from_samples(std::span<const float> samples, int n_mels, int slice_size,
+                                                     arena &scratch);
+
+// Bundles a batch of tracks into one vector each: the sum of the normalised slice vectors
+// of the track weighted by TF-IDF, where vectors closer than epsilon are the same term.
+std::vector<vectorf> tfidf_vectors(const std::vector<const matrixf *> &tracks, double epsilon);
+
 class scanner {
   public:
     scanner(const std::string &model_path, const std::string &save_directory);
@@ -29,19 +53,43 @@ class scanner {
     std::vector<Ort::Value> predict(const audio_file_tensor &input_tensor);
 
     std::vector<int64_t> input_shape() const;
-    std::optional<audio_file_tensor> tensor_from_audio(const std::string &audio_path) const;
+    // the tensor is in the arena, valid until it is reset
+    std::optional<audio_file_tensor> tensor_from_audio(const std::string &audio_path, arena &scratch) const;
 
     void set_batch_size(int batch_size);
     int batch_size() const;
     void set_epsilon(double epsilon);
     double epsilon() const;
+    void set_bundle_format(storage_format format);
+    storage_format bundle_format() const;
+    // neighbours per song in the graph saved next to the bundle, 0 saves no graph
+    void set_graph_neighbours(int neighbours);
+    int graph_neighbours() const;
+    // Bytes the files scanned at once may use by their estimated memory, 0 is no limit.
+    // Workers wait for memory while it is exhausted.
+    void set_max_memory(size_t bytes);
+    size_t max_memory() const;
+    // Called after every file of the scan with the files done and the total, one call at a
+    // time, instead of printing the progress.
+    void set_progress_callback(std::function<void(int, int)> callback);
 
   private:
     static Ort::SessionOptions session_options();
 
-    void scan_file(const std::string &path);
+    void scan_file(const std::string &path, arena &scratch);
     static bool is_batch_file(const std::string &path);
-    void clean_deleted_items(std::unordered_map<std::string, matrixf> &audio_vecs) const;
+    bool save_bundled_vecs(const std::unordered_map<std::string, matrixf> &bundled_vecs,
+                           const std::filesystem::path &path) const;
+    // Keeps the graph when it was built from the saved bundle, updates it when it was built
+    // from the previous one and builds it otherwise.
+    bool save_knn_graph(const std::filesystem::path &bundled_dir, const std::vector<std::string> &previous_tracks,
+                        std::optional<uint64_t> previous_checksum, size_t jobs) const;
+    void clean_deleted_items(std::unordered_map<std::string, matrixf> &bundled_vecs,
+                             std::unordered_map<std::string, matrixf> &individual_vecs,
+                             const std::vector<std::string> &roots,
+                             const std::vector<std::string> &unwalked_dirs,
+                             const std::vector<std::string> &files,
+                             size_t jobs) const;
 
     Ort::Env m_env;
     Ort::Session m_session;
@@ -50,6 +98,10 @@ class scanner {
 
     int m_batch_size = 100;
     double m_epsilon_distance = 0.001;
+    storage_format m_bundle_format = storage_format::f32;
+    int m_graph_neighbours = DEFAULT_GRAPH_NEIGHBOURS;
+    size_t m_max_memory = 0;
+    std::function<void(int, int)> m_progress;
 };
 
 } // namespace deejai
@@ -0,0 +1,66 @@
+#include "deejai/stats.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+
+namespace deejai {
+
+size_t histogram::bucket(uint64_t value) {
+    if (value < SUB_BUCKETS) {
+        return value;
+    }
+    // the power of two, then the quarter of it the value falls in
+    const int exponent = std::bit_width(value) - 1;
+    const size_t sub = (value >> (exponent - 2)) & (SUB_BUCKETS - 1);
+    return SUB_BUCKETS * (exponent - 1) + sub;
+}
+
+uint64_t histogram::bucket_limit(size_t bucket) {
+    if (bucket < SUB_BUCKETS) {
+        return bucket;
+    }
+    const int exponent = static_cast<int>(bucket / SUB_BUCKETS) + 1;
+    const uint64_t lower = (SUB_BUCKETS + bucket % SUB_BUCKETS) << (exponent - 2);
+    return lower + (uint64_t(1) << (exponent - 2)) - 1;
+}
+
+void histogram::record(uint64_t value) {
+    m_buckets[bucket(value)].fetch_add(1, std::memory_order_relaxed);
+    m_sum.fetch_add(value, std::memory_order_relaxed);
+    uint64_t max = m_max.load(std::memory_order_relaxed);
+    while (value > max && !m_max.compare_exchange_weak(max, value, std::memory_order_relaxed)) {
+    }
+}
+
+histogram_summary histogram::summary() const {
+    histogram_summary result;
+    std::array<uint64_t, NUM_BUCKETS> counts;
+    for (size_t b = 0; b < NUM_BUCKETS; b++) {
+        counts[b] = m_buckets[b].load(std::memory_order_relaxed);
+        result.count += counts[b];
+    }
+    result.sum = m_sum.load(std::memory_order_relaxed);
+    result.max = m_max.load(std::memory_order_relaxed);
+
+    // read while other threads record, so the total of the buckets is the count used
+    auto percentile = [&](double p) -> uint64_t {
+        const uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(std::ceil(p * result.count)));
+        uint64_t seen = 0;
+        for (size_t b = 0; b < NUM_BUCKETS; b++) {
+            seen += counts[b];
+            if (seen >= rank) {
+                return std::min(bucket_limit(b), result.max);
+            }
+        }
+        return result.max;
+    };
+    if (result.count > 0) {
+        result.p50 = percentile(0.50);
+        result.p95 = percentile(0.95);
+        result.p99 = percentile(0.99);
+    }
+    return result;
+}
+
+} // namespace deejai
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace deejai {
+
+struct histogram_summary {
+    uint64_t count = 0;
+    uint64_t sum = 0;
+    uint64_t max = 0;
+    uint64_t p50 = 0;
+    uint64_t p95 = 0;
+    uint64_t p99 = 0;
+};
+
+// Counts of values in logarithmic buckets, four per power of two, so a percentile is at
+// most 25% above the true value. Recording is lock free, any number of threads can
+// record while others read.
+class histogram {
+  public:
+    histogram() = default;
+    histogram(const histogram &) = delete;
+    histogram &operator=(const histogram &) = delete;
+
+    void record(uint64_t value);
+    histogram_summary summary() const;
+
+  private:
+    static constexpr size_t SUB_BUCKETS = 4;
+    static constexpr size_t NUM_BUCKETS = 64 * SUB_BUCKETS;
+
+    static size_t bucket(uint64_t value);
+    // largest value of the bucket
+    static uint64_t bucket_limit(size_t bucket);
+
+    std::array<std::atomic<uint64_t>, NUM_BUCKETS> m_buckets = {};
+    std::atomic<uint64_t> m_sum = 0;
+    std::atomic<uint64_t> m_max = 0;
+};
+
+} // namespace deejai
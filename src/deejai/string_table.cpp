@@ -0,0 +1,142 @@
+#include "deejai/string_table.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace deejai {
+
+static void write_varint(std::vector<char> &out, size_t value) {
+    while (value >= 0x80) {
+        out.push_back(static_cast<char>((value & 0x7f) | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<char>(value));
+}
+
+static size_t read_varint(const char *&ptr) {
+    size_t value = 0;
+    int shift = 0;
+    while (true) {
+        const unsigned char byte = static_cast<unsigned char>(*ptr++);
+        value |= static_cast<size_t>(byte & 0x7f) << shift;
+        if ((byte & 0x80) == 0) {
+            return value;
+        }
+        shift += 7;
+    }
+}
+
+string_table::string_table(const std::vector<std::string> &sorted_strings) :
+    m_size(sorted_strings.size()) {
+    for (size_t i = 1; i < sorted_strings.size(); i++) {
+        if (!(sorted_strings[i - 1] < sorted_strings[i])) {
+            throw std::invalid_argument("string_table requires sorted unique strings.");
+        }
+    }
+
+    m_block_offsets.reserve((m_size + BLOCK_SIZE - 1) / BLOCK_SIZE);
+    for (size_t i = 0; i < m_size; i++) {
+        const std::string &str = sorted_strings[i];
+        if (i % BLOCK_SIZE == 0) {
+            m_block_offsets.push_back(m_data.size());
+            write_varint(m_data, str.size());
+            m_data.insert(m_data.end(), str.begin(), str.end());
+            continue;
+        }
+
+        const std::string &prev = sorted_strings[i - 1];
+        const size_t max_prefix = std::min(prev.size(), str.size());
+        size_t prefix = 0;
+        while (prefix < max_prefix && prev[prefix] == str[prefix]) {
+            prefix++;
+        }
+        write_varint(m_data, prefix);
+        write_varint(m_data, str.size() - prefix);
+        m_data.insert(m_data.end(), str.begin() + prefix, str.end());
+    }
+    m_data.shrink_to_fit();
+}
+
+size_t string_table::size() const {
+    return m_size;
+}
+
+bool string_table::empty() const {
+    return m_size == 0;
+}
+
+size_t string_table::memory_bytes() const {
+    return m_data.capacity() + m_block_offsets.capacity() * sizeof(uint64_t);
+}
+
+std::string_view string_table::block_head(size_t block) const {
+    const char *ptr = m_data.data() + m_block_offsets[block];
+    const size_t len = read_varint(ptr);
+    return std::string_view(ptr, len);
+}
+
+std::optional<track_id> string_table::find(std::string_view str) const {
+    if (m_size == 0) {
+        return std::nullopt;
+    }
+
+    // last block whose head is not greater than the string
+    size_t lo = 0;
+    size_t hi = m_block_offsets.size();
+    while (hi - lo > 1) {
+        const size_t mid = (lo + hi) / 2;
+        if (block_head(mid) <= str) {
+            lo = mid;
+        } else {
+            hi = mid;
+        }
+    }
+
+    const char *ptr = m_data.data() + m_block_offsets[lo];
+    size_t len = read_varint(ptr);
+    std::string current(ptr, len);
+    ptr += len;
+    const size_t first = lo * BLOCK_SIZE;
+    const size_t last = std::min(first + BLOCK_SIZE, m_size);
+    for (size_t id = first;; id++) {
+        if (current == str) {
+            return static_cast<track_id>(id);
+        }
+        if (current > str || id + 1 == last) {
+            return std::nullopt;
+        }
+        const size_t prefix = read_varint(ptr);
+        len = read_varint(ptr);
+        current.resize(prefix);
+        current.append(ptr, len);
+        ptr += len;
+    }
+}
+
+bool string_table::contains(std::string_view str) const {
+    return find(str).has_value();
+}
+
+std::string string_table::at(track_id id) const {
+    if (id >= m_size) {
+        throw std::out_of_range("string_table id out of range.");
+    }
+
+    const char *ptr = m_data.data() + m_block_offsets[id / BLOCK_SIZE];
+    size_t len = read_varint(ptr);
+    std::string current(ptr, len);
+    ptr += len;
+    for (size_t i = 0; i < id % BLOCK_SIZE; i++) {
+        const size_t prefix = read_varint(ptr);
+        len = read_varint(ptr);
+        current.resize(prefix);
+        current.append(ptr, len);
+        ptr += len;
+    }
+    return current;
+}
+
+} // namespace deejai
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace deejai {
+
+typedef uint32_t track_id;
+
+// Immutable table of the sorted track paths. Paths are front coded in blocks: the first
+// path of every block is stored whole and the rest only store the suffix that differs
+// from their predecessor, which removes the long shared directory prefixes. The id of
+// a path is its position in the sorted order.
+class string_table {
+  public:
+    string_table() = default;
+    explicit string_table(const std::vector<std::string> &sorted_strings);
+
+    size_t size() const;
+    bool empty() const;
+    size_t memory_bytes() const;
+
+    std::optional<track_id> find(std::string_view str) const;
+    bool contains(std::string_view str) const;
+    std::string at(track_id id) const;
+
+  private:
+    static constexpr size_t BLOCK_SIZE = 16;
+
+    std::string_view block_head(size_t block) const;
+
+    std::vector<char> m_data;
+    std::vector<uint64_t> m_block_offsets;
+    size_t m_size = 0;
+};
+
+} // namespace deejai
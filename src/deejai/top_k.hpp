@@ -0,0 +1,55 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <utility>
+#include <vector>
+
+namespace deejai {
+
+// Bounded min-heap that keeps the k highest scoring ids. The score of the worst kept
+// entry is exposed as a threshold, so callers can reject most candidates with a
+// single comparison before touching the heap.
+template <typename Id>
+class top_k {
+  public:
+    explicit top_k(size_t k) :
+        m_k(k) {
+        m_heap.reserve(k);
+    }
+
+    float threshold() const {
+        return m_heap.size() < m_k ? -INFINITY : m_heap.front().second;
+    }
+
+    void push(Id id, float score) {
+        if (m_k == 0) {
+            return;
+        }
+        if (m_heap.size() < m_k) {
+            m_heap.emplace_back(id, score);
+            std::push_heap(m_heap.begin(), m_heap.end(), greater);
+        } else if (score > m_heap.front().second) {
+            std::pop_heap(m_heap.begin(), m_heap.end(), greater);
+            m_heap.back() = {id, score};
+            std::push_heap(m_heap.begin(), m_heap.end(), greater);
+        }
+    }
+
+    // best first
+    std::vector<std::pair<Id, float>> sorted() const {
+        std::vector<std::pair<Id, float>> result = m_heap;
+        std::sort_heap(result.begin(), result.end(), greater);
+        return result;
+    }
+
+  private:
+    static bool greater(const std::pair<Id, float> &a, const std::pair<Id, float> &b) {
+        return a.second > b.second;
+    }
+
+    size_t m_k;
+    std::vector<std::pair<Id, float>> m_heap;
+};
+
+} // namespace deejai
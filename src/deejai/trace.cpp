@@ -0,0 +1,155 @@
+#include "deejai/trace.hpp"
+#include "deejai/utils.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iomanip>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+
+namespace deejai::trace {
+
+// The events of one thread. The lock is only contended while the events are collected.
+struct buffer {
+    std::mutex mutex;
+    std::vector<event> events;
+};
+
+struct registry {
+    std::mutex mutex;
+    std::vector<std::shared_ptr<buffer>> buffers;
+};
+
+static std::atomic<bool> recording = false;
+
+static registry &buffers() {
+    static registry instance;
+    return instance;
+}
+
+static int64_t now() {
+    static const auto epoch = std::chrono::steady_clock::now();
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - epoch).count();
+}
+
+// the buffer is shared with the registry, so its events outlive the thread
+static buffer &thread_buffer(uint32_t &thread) {
+    thread_local std::shared_ptr<buffer> local;
+    thread_local uint32_t local_thread = 0;
+    if (!local) {
+        local = std::make_shared<buffer>();
+        registry &reg = buffers();
+        std::lock_guard<std::mutex> lock(reg.mutex);
+        reg.buffers.push_back(local);
+        local_thread = static_cast<uint32_t>(reg.buffers.size());
+    }
+    thread = local_thread;
+    return *local;
+}
+
+static double percentile(const std::vector<int64_t> &sorted, double p) {
+    const size_t index = static_cast<size_t>(p * (sorted.size() - 1) + 0.5);
+    return sorted[std::min(index, sorted.size() - 1)] / 1e6;
+}
+
+void set_enabled(bool enabled) {
+    if (enabled) {
+        now();
+    }
+    recording.store(enabled, std::memory_order_relaxed);
+}
+
+bool enabled() {
+    return recording.load(std::memory_order_relaxed);
+}
+
+scoped_timer::scoped_timer(const char *name) : m_name(name), m_start(enabled() ? now() : -1) {}
+
+scoped_timer::~scoped_timer() {
+    if (m_start < 0) {
+        return;
+    }
+    const int64_t end = now();
+    uint32_t thread = 0;
+    buffer &local = thread_buffer(thread);
+    std::lock_guard<std::mutex> lock(local.mutex);
+    local.events.push_back({m_name, thread, m_start, end - m_start});
+}
+
+std::vector<event> events() {
+    std::vector<event> result;
+    registry &reg = buffers();
+    std::lock_guard<std::mutex> lock(reg.mutex);
+    for (const auto &buf : reg.buffers) {
+        std::lock_guard<std::mutex> buffer_lock(buf->mutex);
+        result.insert(result.end(), buf->events.begin(), buf->events.end());
+    }
+    std::sort(result.begin(), result.end(), [](const event &a, const event &b) { return a.start < b.start; });
+    return result;
+}
+
+void clear() {
+    registry &reg = buffers();
+    std::lock_guard<std::mutex> lock(reg.mutex);
+    for (const auto &buf : reg.buffers) {
+        std::lock_guard<std::mutex> buffer_lock(buf->mutex);
+        buf->events.clear();
+    }
+}
+
+bool write_chrome_trace(const std::filesystem::path &path) {
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(3);
+    out << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [";
+    bool first = true;
+    for (const event &e : events()) {
+        out << (first ? "\n" : ",\n") << "{\"name\": \"" << e.name << "\", \"cat\": \"scan\", \"ph\": \"X\", \"pid\": 1"
+            << ", \"tid\": " << e.thread << ", \"ts\": " << e.start / 1e3 << ", \"dur\": " << e.duration / 1e3 << "}";
+        first = false;
+    }
+    out << "\n]}\n";
+    return utils::atomic_write_file(path, out.str());
+}
+
+void print_stats(std::ostream &out) {
+    const std::vector<event> all = events();
+    if (all.empty()) {
+        out << "No scan stages were recorded." << std::endl;
+        return;
+    }
+
+    int64_t begin = all.front().start;
+    int64_t end = 0;
+    std::map<std::string, std::vector<int64_t>> stages;
+    for (const event &e : all) {
+        begin = std::min(begin, e.start);
+        end = std::max(end, e.start + e.duration);
+        stages[e.name].push_back(e.duration);
+    }
+    const double wall = (end - begin) / 1e9;
+
+    const std::ios_base::fmtflags flags = out.flags();
+    out << std::fixed << std::setprecision(2);
+    out << std::left << std::setw(16) << "stage" << std::right << std::setw(9) << "count" << std::setw(10) << "per s"
+        << std::setw(11) << "total s" << std::setw(11) << "p50 ms" << std::setw(11) << "p95 ms" << std::setw(11)
+        << "p99 ms" << std::setw(11) << "max ms" << "\n";
+    for (auto &[name, durations] : stages) {
+        std::sort(durations.begin(), durations.end());
+        int64_t total = 0;
+        for (int64_t duration : durations) {
+            total += duration;
+        }
+        out << std::left << std::setw(16) << name << std::right << std::setw(9) << durations.size() << std::setw(10)
+            << (wall > 0 ? durations.size() / wall : 0.0) << std::setw(11) << total / 1e9 << std::setw(11)
+            << percentile(durations, 0.50) << std::setw(11) << percentile(durations, 0.95) << std::setw(11)
+            << percentile(durations, 0.99) << std::setw(11) << durations.back() / 1e6 << "\n";
+    }
+    out << "Wall time " << wall << " s" << std::endl;
+    out.flags(flags);
+}
+
+} // namespace deejai::trace
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <ostream>
+#include <vector>
+
+// Timing of the stages of a scan. Every thread records into its own buffer and the
+// recording is off until enabled, so the timers can stay in the hot paths.
+namespace deejai::trace {
+
+struct event {
+    const char *name;
+    uint32_t thread;
+    // nanoseconds since the first event of the process
+    int64_t start;
+    int64_t duration;
+};
+
+void set_enabled(bool enabled);
+bool enabled();
+
+// Records the time from its construction to its destruction as one event. name must
+// outlive the recording, as a string literal does.
+class scoped_timer {
+  public:
+    explicit scoped_timer(const char *name);
+    ~scoped_timer();
+    scoped_timer(const scoped_timer &) = delete;
+    scoped_timer &operator=(const scoped_timer &) = delete;
+
+  private:
+    const char *m_name;
+    int64_t m_start;
+};
+
+// The events recorded so far by every thread, including the threads that exited.
+std::vector<event> events();
+void clear();
+
+// Chrome trace event format, opens in chrome://tracing or Perfetto.
+bool write_chrome_trace(const std::filesystem::path &path);
+// Throughput and the p50/p95/p99 latency of every stage.
+void print_stats(std::ostream &out);
+
+} // namespace deejai::trace
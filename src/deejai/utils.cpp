@@ -1,9 +1,13 @@
 #include "deejai/utils.hpp"
 #include "deejai/common.hpp"
+#include "deejai/kernels.hpp"
 
 #include <Eigen/Dense>
+#include <algorithm>
+#include <atomic>
 #include <cstdint>
 #include <cstdio>
+#include <cstring>
 #include <filesystem>
 #include <fstream>
 #include <iostream>
@@ -13,9 +17,15 @@
 #include <random>
 #include <regex>
 #include <string>
+#include <utility>
 #include <vector>
 #ifdef _WIN32
+#include <io.h>
 #include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
 #endif // _WIN32
 
 namespace deejai::utils {
@@ -44,8 +54,7 @@ static std::string path_to_str(const std::filesystem::path &path) {
 }
 
 // The function loads the audio to mono channel
-std::optional<vectorf> load_audio(const std::string &filename, int sampling_rate) {
-    std::vector<int16_t> samples;
+std::optional<std::span<const float>> load_audio(const std::string &filename, int sampling_rate, arena &scratch) {
     std::string input_filename = escape_string_for_ffmpeg(filename);
 
 #ifdef _WIN32
@@ -75,16 +84,24 @@ std::optional<vectorf> load_audio(const std::string &filename, int sampling_rate
     if (!pipe)
         throw std::runtime_error("Failed to open pipe to FFmpeg");
 
-    int16_t buffer[4096];
-    const int max_sample_size = 12 * 60 * sampling_rate;
+    // read straight into the arena, the buffer doubles until the whole file fits
+    const size_t max_sample_size = MAX_AUDIO_SECONDS * static_cast<size_t>(sampling_rate);
+    size_t capacity = 1 << 16;
+    int16_t *samples = scratch.allocate<int16_t>(capacity);
+    size_t size = 0;
     bool should_skip = false;
-    while (fread(buffer, sizeof(int16_t), 4096, pipe) > 0) {
-        samples.insert(samples.end(), buffer, buffer + 4096);
-        // skip audio files longer than 12 min to avoid running out of memory
-        if (samples.size() > max_sample_size) {
+    size_t count = 0;
+    while ((count = fread(samples + size, sizeof(int16_t), capacity - size, pipe)) > 0) {
+        size += count;
+        if (size > max_sample_size) {
             should_skip = true;
             break;
         }
+        if (size == capacity) {
+            const size_t new_capacity = std::min(2 * capacity, max_sample_size + 1);
+            samples = scratch.grow(samples, capacity, new_capacity);
+            capacity = new_capacity;
+        }
     }
 
 #ifdef _WIN32
@@ -97,24 +114,38 @@ std::optional<vectorf> load_audio(const std::string &filename, int sampling_rate
         return std::nullopt;
     }
 
-    if (samples.empty()) {
+    if (size == 0) {
         std::cerr << "Couldn't load the audio file: " << filename << std::endl;
         std::cerr << "Make sure that FFmpeg is installed and that the provided path points to an audio file." << std::endl;
         return std::nullopt;
     }
 
-    deejai::vectorf vec(samples.size());
-    for (size_t i = 0; i < samples.size(); ++i) {
-        vec[i] = samples[i] / 32768.0f;
-    }
+    float *vec = scratch.allocate<float>(size);
+    kernels::int16_to_float(samples, size, 1.0f / 32768.0f, vec);
+    return std::span<const float>(vec, size);
+}
 
-    return vec;
+std::optional<vectorf> load_audio(const std::string &filename, int sampling_rate) {
+    arena scratch;
+    const auto samples = load_audio(filename, sampling_rate, scratch);
+    if (!samples.has_value()) {
+        return std::nullopt;
+    }
+    return vectorf(Eigen::Map<const vectorf>(samples->data(), samples->size()));
 }
 
 std::vector<std::string> find_audio_files_recursively(const std::vector<std::string> &paths) {
+    std::vector<std::string> unreadable_dirs;
+    std::vector<std::string> symlinked_dirs;
+    return find_audio_files_recursively(paths, unreadable_dirs, symlinked_dirs);
+}
+
+std::vector<std::string> find_audio_files_recursively(const std::vector<std::string> &paths,
+                                                      std::vector<std::string> &unreadable_dirs,
+                                                      std::vector<std::string> &symlinked_dirs) {
     auto hasAudioExtension = [](std::string filename) {
         std::transform(filename.begin(), filename.end(), filename.begin(), ::tolower);
-        return filename.ends_with(".mp3") || filename.ends_with(".flac") || filename.ends_with(".m4a") || filename.ends_with(".opus") || filename.ends_with(".aac");
+        return filename.ends_with(".mp3") || filename.ends_with(".flac") || filename.ends_with(".m4a") || filename.ends_with(".opus") || filename.ends_with(".aac") || filename.ends_with(".wav");
     };
 
     std::vector<std::string> results;
@@ -129,14 +160,29 @@ std::vector<std::string> find_audio_files_recursively(const std::vector<std::str
         }
 
         if (std::filesystem::is_directory(path)) {
-            for (auto it = std::filesystem::recursive_directory_iterator(path, std::filesystem::directory_options::skip_permission_denied);
-                 it != std::filesystem::recursive_directory_iterator(); it++) {
-                if (!std::filesystem::is_regular_file(*it)) {
-                    continue;
+            // Walked by hand instead of with a recursive_directory_iterator, which either
+            // skips the directories it cannot open silently or ends the whole walk on them.
+            std::vector<std::filesystem::path> pending{path};
+            while (!pending.empty()) {
+                const std::filesystem::path dir = std::move(pending.back());
+                pending.pop_back();
+                std::error_code ec;
+                std::filesystem::directory_iterator it(dir, ec);
+                for (; !ec && it != std::filesystem::directory_iterator(); it.increment(ec)) {
+                    std::error_code entry_ec;
+                    // like the recursive iterator, symlinks to directories are not followed
+                    if (it->is_directory(entry_ec)) {
+                        if (it->is_symlink(entry_ec)) {
+                            symlinked_dirs.emplace_back(path_to_str(std::filesystem::absolute(it->path())));
+                        } else {
+                            pending.push_back(it->path());
+                        }
+                    } else if (it->is_regular_file(entry_ec) && hasAudioExtension(path_to_str(it->path()))) {
+                        results.emplace_back(path_to_str(std::filesystem::absolute(it->path())));
+                    }
                 }
-                const std::string str = path_to_str(it->path());
-                if (hasAudioExtension(str)) {
-                    results.emplace_back(path_to_str(std::filesystem::absolute(it->path())));
+                if (ec) {
+                    unreadable_dirs.emplace_back(path_to_str(std::filesystem::absolute(dir)));
                 }
             }
         }
@@ -162,6 +208,8 @@ static bool is_valid_leading_byte(unsigned char c) {
     return (c & 0xC0) != 0x80;
 }
 
+static constexpr size_t MAX_FILENAME_BYTES = 255;
+
 static std::u8string truncate_utf8(const std::u8string &input, size_t max_bytes) {
     if (input.size() <= max_bytes)
         return input;
@@ -203,7 +251,7 @@ std::u8string scanned_filename(const std::u8string &path) {
 
     // account for the max filename length (255 bytes is a safe length for most OS)
     // this can be error prone, might need to add a hash in the filename to avoid conflicts
-    scanned_name = truncate_utf8(scanned_name, 255);
+    scanned_name = truncate_utf8(scanned_name, MAX_FILENAME_BYTES);
 
     return scanned_name;
 }
@@ -214,7 +262,7 @@ std::vector<int> random_permutation(int n) {
         indices[i] = i;
     }
 
-    std::mt19937 random_engine(std::random_device{}());
+    std::mt19937 random_engine = make_rng(std::nullopt);
     std::shuffle(indices.begin(), indices.end(), random_engine);
     return indices;
 }
@@ -237,7 +285,7 @@ matrixf ort_to_matrix(Ort::Value &value) {
     return eigen_matrix;
 }
 
-void save_matrix_to_stream(std::ofstream &ofs, const matrixf &matrix) {
+void save_matrix_to_stream(std::ostream &ofs, const matrixf &matrix) {
     int rows = matrix.rows();
     int cols = matrix.cols();
 
@@ -246,62 +294,465 @@ void save_matrix_to_stream(std::ofstream &ofs, const matrixf &matrix) {
     ofs.write(reinterpret_cast<const char *>(matrix.data()), sizeof(float) * rows * cols);
 }
 
-matrixf load_matrix_from_stream(std::ifstream &ifs) {
-    int rows;
-    int cols;
+matrixf load_matrix_from_stream(std::istream &ifs) {
+    int rows = 0;
+    int cols = 0;
     ifs.read(reinterpret_cast<char *>(&rows), sizeof(int));
     ifs.read(reinterpret_cast<char *>(&cols), sizeof(int));
+    if (!ifs || rows < 0 || cols < 0) {
+        throw std::runtime_error("Invalid matrix header in stream.");
+    }
 
     matrixf mat(rows, cols);
     ifs.read(reinterpret_cast<char *>(mat.data()), sizeof(float) * rows * cols);
     return mat;
 }
 
-bool save_matrix_map(const std::unordered_map<std::string, matrixf> &matrix_map, const std::filesystem::path &path) {
-    std::ofstream ofs(path, std::ios::binary);
+// Files written by save_matrix_map end with a trailer holding the checksum of the
+// payload followed by this magic. Files without it are from older versions.
+static constexpr char CHECKSUM_MAGIC[8] = {'D', 'J', 'A', 'I', 'C', 'H', 'K', '1'};
+static constexpr size_t CHECKSUM_TRAILER_SIZE = sizeof(uint64_t) + sizeof(CHECKSUM_MAGIC);
+static constexpr uint64_t FNV1A_OFFSET = 14695981039346656037ull;
+// payload read per call while a file is loaded and hashed
+static constexpr size_t READ_CHUNK_SIZE = 1 << 20;
+
+// FNV-1a of the data appended to what hash covers so far, FNV1A_OFFSET for nothing
+static uint64_t fnv1a_update(uint64_t hash, const char *data, size_t size) {
+    for (size_t i = 0; i < size; i++) {
+        hash ^= static_cast<unsigned char>(data[i]);
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+// the checksum of the trailer of a stream opened at its end, nullopt without one
+static std::optional<uint64_t> read_trailer(std::ifstream &ifs) {
+    if (static_cast<size_t>(ifs.tellg()) < CHECKSUM_TRAILER_SIZE) {
+        return std::nullopt;
+    }
+    char trailer[CHECKSUM_TRAILER_SIZE];
+    ifs.seekg(-static_cast<std::streamoff>(CHECKSUM_TRAILER_SIZE), std::ios::end);
+    if (!ifs.read(trailer, CHECKSUM_TRAILER_SIZE) ||
+        std::memcmp(trailer + sizeof(uint64_t), CHECKSUM_MAGIC, sizeof(CHECKSUM_MAGIC)) != 0) {
+        return std::nullopt;
+    }
+    uint64_t checksum = 0;
+    std::memcpy(&checksum, trailer, sizeof(checksum));
+    return checksum;
+}
+
+#ifndef _WIN32
+static void sync_directory(const std::filesystem::path &dir) {
+    int fd = open(dir.empty() ? "." : dir.c_str(), O_RDONLY);
+    if (fd >= 0) {
+        fsync(fd);
+        close(fd);
+    }
+}
+#endif // _WIN32
+
+// The path with ".tmp" appended to its file name. A name too long for that is shortened
+// from the front like scanned_filename and numbered, so that the writers of two long
+// names with the same end do not share a temporary file.
+static std::filesystem::path temporary_path(const std::filesystem::path &path) {
+    static std::atomic<uint64_t> next_number{0};
+    const std::u8string suffix = u8".tmp";
+    const std::u8string filename = path.filename().u8string();
+    if (filename.size() + suffix.size() <= MAX_FILENAME_BYTES) {
+        return path.parent_path() / (filename + suffix);
+    }
+    const std::string number = "." + std::to_string(next_number++);
+    const std::u8string numbered_suffix = std::u8string(number.begin(), number.end()) + suffix;
+    return path.parent_path() / (truncate_utf8(filename, MAX_FILENAME_BYTES - numbered_suffix.size()) + numbered_suffix);
+}
+
+// Writes to a temporary file next to the destination, flushes it to disk and renames it
+// over the destination on commit(), so readers either see the old or the complete new
+// file. The temporary file is removed when the writer is destroyed before that.
+class atomic_file_writer {
+  public:
+    explicit atomic_file_writer(const std::filesystem::path &path) : m_path(path), m_temp_path(temporary_path(path)) {
+#ifdef _WIN32
+        m_file = _wfopen(m_temp_path.c_str(), L"wb");
+#else
+        m_file = fopen(m_temp_path.c_str(), "wb");
+#endif // _WIN32
+        if (!m_file) {
+            std::cerr << "Failed to open file for writing " << m_temp_path << std::endl;
+        }
+    }
+
+    ~atomic_file_writer() {
+        if (m_file) {
+            std::fclose(m_file);
+            std::error_code ec;
+            std::filesystem::remove(m_temp_path, ec);
+        }
+    }
+
+    atomic_file_writer(const atomic_file_writer &) = delete;
+    atomic_file_writer &operator=(const atomic_file_writer &) = delete;
+
+    bool is_open() const {
+        return m_file != nullptr;
+    }
+
+    void write(const void *data, size_t size) {
+        m_ok = m_file && std::fwrite(data, 1, size, m_file) == size && m_ok;
+    }
+
+    bool commit() {
+        if (!m_file) {
+            return false;
+        }
+        bool ok = std::fflush(m_file) == 0 && m_ok;
+#ifdef _WIN32
+        ok = _commit(_fileno(m_file)) == 0 && ok;
+#else
+        ok = fsync(fileno(m_file)) == 0 && ok;
+#endif // _WIN32
+        ok = std::fclose(m_file) == 0 && ok;
+        m_file = nullptr;
+
+        std::error_code ec;
+        if (ok) {
+            std::filesystem::rename(m_temp_path, m_path, ec);
+        }
+        if (!ok || ec) {
+            std::cerr << "Failed to write file " << m_path << std::endl;
+            std::filesystem::remove(m_temp_path, ec);
+            return false;
+        }
+#ifndef _WIN32
+        sync_directory(m_path.parent_path());
+#endif // _WIN32
+        return true;
+    }
 
-    if (!ofs) {
-        std::cerr << "Failed to open file for writing " << path << std::endl;
+  private:
+    std::filesystem::path m_path;
+    std::filesystem::path m_temp_path;
+    FILE *m_file = nullptr;
+    bool m_ok = true;
+};
+
+// An atomic_file_writer that hashes the payload as it is written and appends the
+// checksum trailer on commit().
+class checksummed_writer {
+  public:
+    explicit checksummed_writer(const std::filesystem::path &path) : m_file(path) {}
+
+    bool is_open() const {
+        return m_file.is_open();
+    }
+
+    void write(const void *data, size_t size) {
+        m_checksum = fnv1a_update(m_checksum, static_cast<const char *>(data), size);
+        m_file.write(data, size);
+    }
+
+    bool commit() {
+        m_file.write(&m_checksum, sizeof(m_checksum));
+        m_file.write(CHECKSUM_MAGIC, sizeof(CHECKSUM_MAGIC));
+        return m_file.commit();
+    }
+
+  private:
+    atomic_file_writer m_file;
+    uint64_t m_checksum = FNV1A_OFFSET;
+};
+
+// Bounds checked reader over the payload of a file written by save_checksummed_file,
+// which hashes the payload as it is read. Files without the trailer are read whole and
+// not checked.
+class checksummed_reader {
+  public:
+    explicit checksummed_reader(const std::filesystem::path &path) :
+        m_stream(path, std::ios::binary | std::ios::ate) {
+        if (!m_stream) {
+            std::cerr << "Failed to open file for reading " << path << std::endl;
+            return;
+        }
+        const size_t size = static_cast<size_t>(m_stream.tellg());
+        m_expected = read_trailer(m_stream);
+        m_remaining = m_expected.has_value() ? size - CHECKSUM_TRAILER_SIZE : size;
+        m_stream.clear();
+        m_stream.seekg(0);
+    }
+
+    bool is_open() const {
+        return static_cast<bool>(m_stream);
+    }
+
+    bool read(void *dst, size_t bytes) {
+        if (bytes > m_remaining || !m_stream.read(static_cast<char *>(dst), bytes)) {
+            return false;
+        }
+        m_checksum = fnv1a_update(m_checksum, static_cast<const char *>(dst), bytes);
+        m_remaining -= bytes;
+        return true;
+    }
+
+    size_t remaining() const {
+        return m_remaining;
+    }
+
+    // Reads what is left of the payload and compares the checksum with the trailer.
+    bool verify() {
+        char chunk[4096];
+        while (m_remaining > 0) {
+            if (!read(chunk, std::min(sizeof(chunk), m_remaining))) {
+                return false;
+            }
+        }
+        return !m_expected.has_value() || *m_expected == m_checksum;
+    }
+
+  private:
+    std::ifstream m_stream;
+    size_t m_remaining = 0;
+    uint64_t m_checksum = FNV1A_OFFSET;
+    std::optional<uint64_t> m_expected;
+};
+
+bool atomic_write_file(const std::filesystem::path &path, const std::string &data) {
+    return atomic_write_file(path, data.data(), data.size());
+}
+
+bool atomic_write_file(const std::filesystem::path &path, const void *data, size_t size) {
+    atomic_file_writer file(path);
+    if (!file.is_open()) {
         return false;
     }
-    uint32_t map_size = static_cast<uint32_t>(matrix_map.size());
-    ofs.write(reinterpret_cast<const char *>(&map_size), sizeof(map_size));
+    file.write(data, size);
+    return file.commit();
+}
 
-    for (const auto &[audio_path, matrix] : matrix_map) {
+// The payload is hashed while it is written to the temporary file, it is never copied
+// into one buffer.
+bool save_matrix_map(const std::unordered_map<std::string, matrixf> &matrix_map, const std::filesystem::path &path) {
+    checksummed_writer file(path);
+    if (!file.is_open()) {
+        return false;
+    }
+    uint32_t map_size = static_cast<uint32_t>(matrix_map.size());
+    file.write(&map_size, sizeof(map_size));
+
+    // in path order rather than the order of the hash map, so the checksum of a bundle
+    // only changes with its content
+    typedef std::pair<const std::string, matrixf> entry;
+    std::vector<const entry *> entries;
+    entries.reserve(matrix_map.size());
+    for (const auto &item : matrix_map) {
+        entries.push_back(&item);
+    }
+    std::sort(entries.begin(), entries.end(), [](const entry *a, const entry *b) { return a->first < b->first; });
+    for (const entry *item : entries) {
+        const auto &[audio_path, matrix] = *item;
         uint32_t path_len = static_cast<uint32_t>(audio_path.size());
-        ofs.write(reinterpret_cast<const char *>(&path_len), sizeof(path_len));
-        ofs.write(audio_path.data(), path_len);
+        file.write(&path_len, sizeof(path_len));
+        file.write(audio_path.data(), path_len);
+
+        const int rows = matrix.rows();
+        const int cols = matrix.cols();
+        file.write(&rows, sizeof(int));
+        file.write(&cols, sizeof(int));
+        file.write(matrix.data(), sizeof(float) * rows * cols);
+    }
 
-        save_matrix_to_stream(ofs, matrix);
+    return file.commit();
+}
+
+bool save_checksummed_file(const std::filesystem::path &path, const std::string &data) {
+    checksummed_writer file(path);
+    if (!file.is_open()) {
+        return false;
     }
-    return true;
+    file.write(data.data(), data.size());
+    return file.commit();
 }
 
-std::unordered_map<std::string, matrixf> load_matrix_map(const std::filesystem::path &path) {
-    std::ifstream ifs(path, std::ios::binary);
+// Returns the payload of the file without the checksum trailer.
+std::optional<std::string> load_checksummed_file(const std::filesystem::path &path) {
+    checksummed_reader reader(path);
+    if (!reader.is_open()) {
+        return std::nullopt;
+    }
+    // read into the returned string chunk by chunk, each chunk is hashed while it is in cache
+    std::string data(reader.remaining(), '\0');
+    for (size_t offset = 0; offset < data.size(); offset += READ_CHUNK_SIZE) {
+        if (!reader.read(data.data() + offset, std::min(READ_CHUNK_SIZE, data.size() - offset))) {
+            std::cerr << "Failed to read file " << path << std::endl;
+            return std::nullopt;
+        }
+    }
+    if (!reader.verify()) {
+        std::cerr << "Checksum mismatch in " << path << std::endl;
+        return std::nullopt;
+    }
+    return data;
+}
+
+std::optional<uint64_t> stored_checksum(const std::filesystem::path &path) {
+    std::ifstream ifs(path, std::ios::binary | std::ios::ate);
     if (!ifs) {
+        return std::nullopt;
+    }
+    return read_trailer(ifs);
+}
+
+mapped_file::~mapped_file() {
+    release();
+}
+
+mapped_file::mapped_file(mapped_file &&other) noexcept {
+    *this = std::move(other);
+}
+
+mapped_file &mapped_file::operator=(mapped_file &&other) noexcept {
+    if (this != &other) {
+        release();
+        m_data = std::exchange(other.m_data, nullptr);
+        m_size = std::exchange(other.m_size, 0);
+#ifdef _WIN32
+        m_mapping = std::exchange(other.m_mapping, nullptr);
+#endif // _WIN32
+    }
+    return *this;
+}
+
+void mapped_file::release() {
+#ifdef _WIN32
+    if (m_data) {
+        UnmapViewOfFile(m_data);
+    }
+    if (m_mapping) {
+        CloseHandle(m_mapping);
+    }
+    m_mapping = nullptr;
+#else
+    if (m_data) {
+        munmap(const_cast<char *>(m_data), m_size);
+    }
+#endif // _WIN32
+    m_data = nullptr;
+    m_size = 0;
+}
+
+std::optional<mapped_file> mapped_file::open(const std::filesystem::path &path) {
+    std::error_code ec;
+    const uintmax_t size = std::filesystem::file_size(path, ec);
+    if (ec) {
         std::cerr << "Failed to open file for reading " << path << std::endl;
-        return {};
+        return std::nullopt;
+    }
+    mapped_file file;
+    if (size == 0) {
+        return file;
     }
+
+#ifdef _WIN32
+    HANDLE handle = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                                FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (handle == INVALID_HANDLE_VALUE) {
+        std::cerr << "Failed to open file for reading " << path << std::endl;
+        return std::nullopt;
+    }
+    // the mapping keeps the file open
+    file.m_mapping = CreateFileMappingW(handle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    CloseHandle(handle);
+    if (file.m_mapping) {
+        file.m_data = static_cast<const char *>(MapViewOfFile(file.m_mapping, FILE_MAP_READ, 0, 0, 0));
+    }
+#else
+    const int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        std::cerr << "Failed to open file for reading " << path << std::endl;
+        return std::nullopt;
+    }
+    // the mapping stays valid after the descriptor is closed
+    void *data = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (data != MAP_FAILED) {
+        file.m_data = static_cast<const char *>(data);
+    }
+#endif // _WIN32
+    if (!file.m_data) {
+        std::cerr << "Failed to map file " << path << std::endl;
+        return std::nullopt;
+    }
+    file.m_size = size;
+    return file;
+}
+
+// Reads a matrix map with the byte_reader of an in-memory file, or the checksummed_reader
+// of a file on disk.
+template <typename Reader>
+static std::optional<std::unordered_map<std::string, matrixf>> read_matrix_map(Reader &reader) {
     std::unordered_map<std::string, matrixf> matrix_map;
 
     // Read number of map entries
     uint32_t map_size = 0;
-    ifs.read(reinterpret_cast<char *>(&map_size), sizeof(map_size));
+    if (!reader.read(&map_size, sizeof(map_size))) {
+        return std::nullopt;
+    }
 
     for (uint32_t i = 0; i < map_size; i++) {
         uint32_t key_len = 0;
-        ifs.read(reinterpret_cast<char *>(&key_len), sizeof(key_len));
+        int rows = 0;
+        int cols = 0;
+        if (!reader.read(&key_len, sizeof(key_len)) || key_len > reader.remaining()) {
+            return std::nullopt;
+        }
         std::string key(key_len, '\0');
-        ifs.read(key.data(), key_len);
+        reader.read(key.data(), key_len);
 
-        matrixf matrix = load_matrix_from_stream(ifs);
+        if (!reader.read(&rows, sizeof(int)) || !reader.read(&cols, sizeof(int)) || rows < 0 || cols < 0 ||
+            static_cast<uint64_t>(rows) * static_cast<uint64_t>(cols) * sizeof(float) > reader.remaining()) {
+            return std::nullopt;
+        }
+        matrixf matrix(rows, cols);
+        if (!reader.read(matrix.data(), sizeof(float) * rows * cols)) {
+            return std::nullopt;
+        }
         matrix_map.emplace(std::move(key), std::move(matrix));
     }
 
     return matrix_map;
 }
 
+std::optional<std::unordered_map<std::string, matrixf>> parse_matrix_map(const std::string &data) {
+    byte_reader reader(data.data(), data.size());
+    return read_matrix_map(reader);
+}
+
+// The file is parsed as it is read and hashed, the checksum is compared at the end.
+std::optional<std::unordered_map<std::string, matrixf>> try_load_matrix_map(const std::filesystem::path &path) {
+    checksummed_reader reader(path);
+    if (!reader.is_open()) {
+        return std::nullopt;
+    }
+
+    auto matrix_map = read_matrix_map(reader);
+    if (!matrix_map.has_value()) {
+        std::cerr << "Truncated file " << path << std::endl;
+        return std::nullopt;
+    }
+    if (!reader.verify()) {
+        std::cerr << "Checksum mismatch in " << path << std::endl;
+        return std::nullopt;
+    }
+    return matrix_map;
+}
+
+std::unordered_map<std::string, matrixf> load_matrix_map(const std::filesystem::path &path) {
+    auto matrix_map = try_load_matrix_map(path);
+    if (!matrix_map.has_value()) {
+        return {};
+    }
+    return std::move(*matrix_map);
+}
+
 std::unordered_map<std::string, vectorf> matrix_to_vector(const std::unordered_map<std::string, matrixf> &matrix_map) {
     std::unordered_map<std::string, vectorf> vector_map;
     for (const auto &[key, mat] : matrix_map) {
@@ -311,12 +762,20 @@ std::unordered_map<std::string, vectorf> matrix_to_vector(const std::unordered_m
     return vector_map;
 }
 
-void add_noise(vectorf &vec, float noise) {
-    std::mt19937 random_engine(std::random_device{}());
+std::mt19937 make_rng(std::optional<uint64_t> seed) {
+    if (!seed.has_value()) {
+        thread_local std::mt19937_64 seeds(std::random_device{}());
+        seed = seeds();
+    }
+    std::seed_seq seq{static_cast<uint32_t>(*seed), static_cast<uint32_t>(*seed >> 32)};
+    return std::mt19937(seq);
+}
+
+void add_noise(vectorf &vec, float noise, std::mt19937 &rng) {
     if (noise > 0.0f) {
         std::normal_distribution<float> distribution(0.0f, noise * vec.norm());
         for (int i = 0; i < vec.size(); i++) {
-            vec[i] += distribution(random_engine);
+            vec[i] += distribution(rng);
         }
     }
 }
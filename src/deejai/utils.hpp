@@ -1,27 +1,113 @@
 #pragma once
 
+#include "deejai/arena.hpp"
 #include "deejai/common.hpp"
 
+#include <cstdint>
+#include <cstring>
 #include <filesystem>
 #include <onnxruntime_cxx_api.h>
 #include <optional>
+#include <random>
+#include <span>
+#include <string>
+#include <unordered_map>
 #include <vector>
 
 namespace deejai::utils {
 
+// Bounds checked reader over an in-memory file, so that truncated files are
+// reported instead of producing garbage sizes.
+class byte_reader {
+  public:
+    byte_reader(const char *data, size_t size) :
+        m_data(data), m_size(size) {}
+
+    bool read(void *dst, size_t bytes) {
+        if (bytes > m_size - m_pos) {
+            return false;
+        }
+        std::memcpy(dst, m_data + m_pos, bytes);
+        m_pos += bytes;
+        return true;
+    }
+
+    size_t remaining() const {
+        return m_size - m_pos;
+    }
+
+  private:
+    const char *m_data;
+    size_t m_size;
+    size_t m_pos = 0;
+};
+
+// Read-only view of a whole file. The file is memory mapped, so its pages are only
+// loaded when touched and are shared with the page cache and other processes.
+class mapped_file {
+  public:
+    mapped_file() = default;
+    ~mapped_file();
+    mapped_file(const mapped_file &) = delete;
+    mapped_file &operator=(const mapped_file &) = delete;
+    mapped_file(mapped_file &&other) noexcept;
+    mapped_file &operator=(mapped_file &&other) noexcept;
+
+    static std::optional<mapped_file> open(const std::filesystem::path &path);
+
+    const char *data() const {
+        return m_data;
+    }
+
+    size_t size() const {
+        return m_size;
+    }
+
+  private:
+    void release();
+
+    const char *m_data = nullptr;
+    size_t m_size = 0;
+#ifdef _WIN32
+    void *m_mapping = nullptr;
+#endif // _WIN32
+};
+
 inline std::string FFMPEG_PATH = "ffmpeg";
+// longer audio files are skipped, to avoid running out of memory
+constexpr int MAX_AUDIO_SECONDS = 12 * 60;
 
 std::optional<vectorf> load_audio(const std::string &filename, int sampling_rate);
+// The same in memory of the arena, valid until it is reset.
+std::optional<std::span<const float>> load_audio(const std::string &filename, int sampling_rate, arena &scratch);
 std::vector<std::string> find_audio_files_recursively(const std::vector<std::string> &paths);
+// The same, adding the absolute paths of the directories that could not be read, or only
+// in part, to unreadable_dirs and those of the symlinks to directories, which are not
+// followed, to symlinked_dirs.
+std::vector<std::string> find_audio_files_recursively(const std::vector<std::string> &paths,
+                                                      std::vector<std::string> &unreadable_dirs,
+                                                      std::vector<std::string> &symlinked_dirs);
 std::u8string scanned_filename(const std::u8string &path);
 std::vector<int> random_permutation(int n);
 matrixf ort_to_matrix(Ort::Value &value);
-void save_matrix_to_stream(std::ofstream &ofs, const matrixf &matrix);
-matrixf load_matrix_from_stream(std::ifstream &ifs);
+void save_matrix_to_stream(std::ostream &ofs, const matrixf &matrix);
+matrixf load_matrix_from_stream(std::istream &ifs);
+bool atomic_write_file(const std::filesystem::path &path, const std::string &data);
+bool atomic_write_file(const std::filesystem::path &path, const void *data, size_t size);
+bool save_checksummed_file(const std::filesystem::path &path, const std::string &data);
+std::optional<std::string> load_checksummed_file(const std::filesystem::path &path);
+// checksum in the trailer of a file written by save_checksummed_file, without reading the payload
+std::optional<uint64_t> stored_checksum(const std::filesystem::path &path);
+// The entries are written sorted by path, so the same map always gives the same file.
 bool save_matrix_map(const std::unordered_map<std::string, matrixf> &tensor_map, const std::filesystem::path &path);
+std::optional<std::unordered_map<std::string, matrixf>> parse_matrix_map(const std::string &data);
+std::optional<std::unordered_map<std::string, matrixf>> try_load_matrix_map(const std::filesystem::path &path);
 std::unordered_map<std::string, matrixf> load_matrix_map(const std::filesystem::path &path);
 std::unordered_map<std::string, vectorf> matrix_to_vector(const std::unordered_map<std::string, matrixf> &matrix_map);
-void add_noise(vectorf &vec, float noise);
+// Generator seeded with seed, or from a per-thread source when it is not set, so callers
+// on different threads never share random state.
+std::mt19937 make_rng(std::optional<uint64_t> seed);
+void add_noise(vectorf &vec, float noise, std::mt19937 &rng);
 bool save_as_m3u(const std::string &filename, const std::vector<std::string> &paths);
 
 } // namespace deejai::utils
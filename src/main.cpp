@@ -1,10 +1,15 @@
 #include "cxxopts.hpp"
 #include "deejai/generator.hpp"
+#include "deejai/playlist_session.hpp"
 #include "deejai/scanner.hpp"
+#include "deejai/trace.hpp"
 #include "deejai/utils.hpp"
 
+#include <algorithm>
+#include <filesystem>
 #include <fstream>
 #include <iostream>
+#include <optional>
 #include <string>
 #include <vector>
 
@@ -25,6 +30,19 @@ static std::vector<std::string> get_vector_option(const cxxopts::ParseResult &re
     return vec;
 }
 
+// The statistics go to stderr, stdout may be the playlist.
+static void report_generator_stats(const cxxopts::ParseResult &result, const deejai::generator &gen) {
+    if (result.count("stats")) {
+        deejai::print_stats(std::cerr, gen.stats());
+    }
+    if (result.count("metrics-file")) {
+        const std::string path = result["metrics-file"].as<std::string>();
+        if (!deejai::utils::atomic_write_file(path, deejai::prometheus_text(gen.stats()))) {
+            std::cerr << "Failed to save the statistics to " << path << std::endl;
+        }
+    }
+}
+
 std::vector<std::string> parse_args(const std::string &filename) {
     std::ifstream file(filename);
     std::string input = std::string((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
@@ -82,14 +100,22 @@ int main(int argc, char *argv[]) {
                                             "At least one of --scan, --generate or --reorder must be used.\n");
         options.add_options()("h,help", "Show help");
         options.add_options()("scan", "Scan mode. Requires one or more scan paths.\n", cxxopts::value<std::string>());
-        options.add_options()("generate", "Generate mode. Requires the method ('append', 'connect' or 'cluster').\n\n"
+        options.add_options()("generate", "Generate mode. Requires the method ('append', 'connect', 'cluster' or 'beam').\n\n"
                                           "-'append': Appends songs at the end of the input, taking into account the last n-songs specified by the 'lookback'.\n\n"
                                           "-'connect': Connects the input songs (if only one song is provided, 'append' will be used instead.)\n\n"
-                                          "-'cluster': Appends songs at the end of the input, taking into account the original input songs only.\n",
+                                          "-'cluster': Appends songs at the end of the input, taking into account the original input songs only.\n\n"
+                                          "-'beam': Like 'append', but keeps several candidate playlists and returns the one with the smoothest transitions.\n",
                               cxxopts::value<std::string>());
         options.add_options()("reorder", "Reorder mode. Creates a playlist by reordering the input songs to improve the listening experience.");
         options.add_options("Common")("d,vec-dir", "Directory of cached vectors.",
                                       cxxopts::value<std::string>());
+        options.add_options("Common")("j,jobs", "The maximum number of threads that should be used.",
+                                      cxxopts::value<int>()->default_value("-1"));
+        options.add_options("Common")("stats", "Print timing statistics: the throughput and latency of every stage of a scan, "
+                                               "or the load time, memory and query latency of generation and reorder.");
+        options.add_options("Common")("metrics-file", "Save the generation and reorder statistics in the Prometheus text format, "
+                                                      "e.g. for the textfile collector of the node exporter.",
+                                      cxxopts::value<std::string>());
         options.add_options("Scan")("m,model", "Path to the model file.",
                                     cxxopts::value<std::string>());
         options.add_options("Scan")("ffmpeg", "Path to the ffmpeg library.",
@@ -98,8 +124,18 @@ int main(int argc, char *argv[]) {
                                     cxxopts::value<int>()->default_value("100"));
         options.add_options("Scan")("e,epsilon", "Epsilon value.",
                                     cxxopts::value<double>()->default_value("0.001"));
-        options.add_options("Scan")("j,jobs", "The maximum number of threads that should be used.",
-                                    cxxopts::value<int>()->default_value("-1"));
+        options.add_options("Scan")("bundle-format", "Storage format of the bundled vectors ('f32', 'f16' or 'int8'). "
+                                                     "The smaller formats reduce the memory used during generation.",
+                                    cxxopts::value<std::string>()->default_value("f32"));
+        options.add_options("Scan")("graph-neighbours", "Number of nearest neighbours per song in the graph saved with the bundle. "
+                                                        "0 saves no graph.",
+                                    cxxopts::value<int>()->default_value(std::to_string(deejai::DEFAULT_GRAPH_NEIGHBOURS)));
+        options.add_options("Scan")("max-memory", "Memory in MB the files scanned at once may use, estimated from their size. "
+                                                  "Workers wait while it is exhausted, 0 is no limit.",
+                                    cxxopts::value<int>()->default_value("0"));
+        options.add_options("Scan")("trace", "Save the time spent in every stage of the scan as a Chrome trace "
+                                             "(chrome://tracing or ui.perfetto.dev).",
+                                    cxxopts::value<std::string>());
         options.add_options("Generate & Reorder")("i,input", "Input song path. This flag can be used multiple times.",
                                                   cxxopts::value<std::string>());
         options.add_options("Generate & Reorder")("o,m3u-out", "The m3u filepath to save the playlist. "
@@ -112,9 +148,20 @@ int main(int argc, char *argv[]) {
                                         cxxopts::value<float>()->default_value("0.0"));
         options.add_options("Generate")("l,lookback", "The lookback to pick the next song.",
                                         cxxopts::value<int>()->default_value("3"));
+        options.add_options("Generate")("beam-width", "Number of partial playlists the 'beam' method keeps at every step.",
+                                        cxxopts::value<int>()->default_value("8"));
         options.add_options("Generate")("reorder-output", "Use reorder on the generation output.");
+        options.add_options("Generate")("exhaustive", "Score every song of the library instead of the neighbours found in the scanned graph.");
+        options.add_options("Generate")("session", "Session file of the 'append' method. Each run continues the session with "
+                                                   "--nsongs new songs and saves it, for endless radio playlists.",
+                                        cxxopts::value<std::string>());
         options.add_options("Reorder")("first", "The desired first song of the reordered playlist.",
                                        cxxopts::value<std::string>());
+        options.add_options("Generate & Reorder")("reorder-time-budget", "Time in milliseconds the reorder may spend improving the playlist on all threads. "
+                                                                         "With 0 every thread runs a single pass.",
+                                                  cxxopts::value<double>()->default_value("0"));
+        options.add_options("Generate & Reorder")("seed", "Seed for reproducible generation, sessions and reorder (with the same --jobs and no time budget).",
+                                                  cxxopts::value<uint64_t>());
 
         auto result = options.parse(new_argc, new_argv);
 
@@ -153,17 +200,24 @@ int main(int argc, char *argv[]) {
             if (!result.count("scan") || !result.count("model") || !result.count("vec-dir")) {
                 return error_exit_main("--scan requires --model, --vec-dir, and one or more scan inputs");
             }
+            if (!deejai::storage_format_from_string(result["bundle-format"].as<std::string>()).has_value()) {
+                return error_exit_main("--bundle-format must be one of: f32, f16, int8");
+            }
         }
 
         if (isGenerate) {
             std::string method = result.count("generate") ? result["generate"].as<std::string>() : "";
 
-            if (!method.empty() && method != "connect" && method != "append" && method != "cluster") {
-                return error_exit_main("--generate method must be one of: append, connect, cluster");
+            if (!method.empty() && method != "connect" && method != "append" && method != "cluster" && method != "beam") {
+                return error_exit_main("--generate method must be one of: append, connect, cluster, beam");
             }
-            if (!result.count("input") || !result.count("vec-dir")) {
+            const bool resume_session = result.count("session") && std::filesystem::exists(result["session"].as<std::string>());
+            if ((!result.count("input") && !resume_session) || !result.count("vec-dir")) {
                 return error_exit_main("--generate requires --input and --vec-dir");
             }
+            if (result.count("session") && method != "append") {
+                return error_exit_main("--session can only be used with the append method");
+            }
         }
 
         if (isReorder) {
@@ -192,11 +246,31 @@ int main(int argc, char *argv[]) {
             deejai::scanner deejai_scanner(model, vec_dir);
             deejai_scanner.set_batch_size(batch_size);
             deejai_scanner.set_epsilon(epsilon);
+            deejai_scanner.set_bundle_format(*deejai::storage_format_from_string(result["bundle-format"].as<std::string>()));
+            deejai_scanner.set_graph_neighbours(result["graph-neighbours"].as<int>());
+            deejai_scanner.set_max_memory(static_cast<size_t>(std::max(result["max-memory"].as<int>(), 0)) << 20);
+            deejai::trace::set_enabled(result.count("trace") || result.count("stats"));
             if (deejai_scanner.scan(scan_inputs, jobs)) {
                 std::cout << "Scan completed successfully." << std::endl;
             }
+            if (result.count("stats")) {
+                deejai::trace::print_stats(std::cout);
+            }
+            if (result.count("trace") && !deejai::trace::write_chrome_trace(result["trace"].as<std::string>())) {
+                std::cerr << "Failed to save the scan trace." << std::endl;
+            }
         }
 
+        std::optional<uint64_t> seed;
+        if (result.count("seed")) {
+            seed = result["seed"].as<uint64_t>();
+        }
+
+        deejai::reorder_options reorder_options;
+        reorder_options.jobs = result["jobs"].as<int>();
+        reorder_options.time_budget_ms = result["reorder-time-budget"].as<double>();
+        reorder_options.seed = seed;
+
         if (isGenerate) {
             std::string method = result.count("generate") ? result["generate"].as<std::string>() : "";
             std::string vec_dir = result["vec-dir"].as<std::string>();
@@ -209,9 +283,31 @@ int main(int argc, char *argv[]) {
             std::string m3u_file = result["m3u-out"].as<std::string>();
 
             deejai::generator gen(vec_dir);
-            auto ret = gen.generate_playlist(method, input_songs, nsongs, lookback, noise);
+            gen.set_use_graph(!result.count("exhaustive"));
+            std::vector<std::string> ret;
+            if (result.count("session")) {
+                const std::string session_file = result["session"].as<std::string>();
+                auto session = deejai::playlist_session::load(gen, session_file);
+                if (!session.has_value()) {
+                    if (std::filesystem::exists(session_file)) {
+                        return 1;
+                    }
+                    // a new session starts the playlist with the valid input songs
+                    ret = gen.generate_playlist("append", input_songs, 0);
+                    if (!ret.empty()) {
+                        session = deejai::playlist_session(gen, ret, lookback, noise, seed);
+                    }
+                }
+                if (session.has_value()) {
+                    const std::vector<std::string> next = session->next(nsongs - static_cast<int>(ret.size()));
+                    ret.insert(ret.end(), next.begin(), next.end());
+                    session->save(session_file);
+                }
+            } else {
+                ret = gen.generate_playlist(method, input_songs, nsongs, lookback, noise, result["beam-width"].as<int>(), seed);
+            }
             if (reorder_output) {
-                ret = gen.reorder(ret);
+                ret = gen.reorder(ret, "", reorder_options);
             }
             if (m3u_file.empty()) {
                 for (const auto &file : ret) {
@@ -220,6 +316,7 @@ int main(int argc, char *argv[]) {
             } else {
                 deejai::utils::save_as_m3u(m3u_file, ret);
             }
+            report_generator_stats(result, gen);
         }
 
         if (isReorder) {
@@ -229,7 +326,7 @@ int main(int argc, char *argv[]) {
             std::string first_song = result.count("first") ? result["first"].as<std::string>() : "";
 
             deejai::generator gen(vec_dir);
-            auto ret = gen.reorder(input_songs, first_song);
+            auto ret = gen.reorder(input_songs, first_song, reorder_options);
             if (m3u_file.empty()) {
                 for (const auto &file : ret) {
                     std::cout << file << std::endl;
@@ -237,6 +334,7 @@ int main(int argc, char *argv[]) {
             } else {
                 deejai::utils::save_as_m3u(m3u_file, ret);
             }
+            report_generator_stats(result, gen);
         }
 
     } catch (const cxxopts::exceptions::exception &exception) {
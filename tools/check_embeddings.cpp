@@ -0,0 +1,304 @@
+#include "cxxopts.hpp"
+#include "deejai/common.hpp"
+#include "deejai/frontend.hpp"
+#include "deejai/kernels.hpp"
+#include "deejai/scanner.hpp"
+#include "deejai/utils.hpp"
+
+#include <librosa.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <random>
+#include <string>
+#include <vector>
+
+// Checks that the optimised scan path still computes the embeddings of the reference one,
+// the librosa frontend the model was trained with. Both run on the same synthetic tracks
+// and every stage is compared: the mel spectrogram, the normalised slices of the model
+// input, the bundled vectors and the nearest neighbours of every track. The exit status
+// is 1 when a difference is above its tolerance, so the check can gate a faster path.
+
+namespace {
+
+using deejai::matrixf;
+using deejai::vectorf;
+
+constexpr int SAMPLING_RATE = 22050;
+constexpr int N_FFT = 2048;
+constexpr int HOP_LENGTH = 512;
+// input of the deej-ai model
+constexpr int N_MELS = 96;
+constexpr int SLICE_SIZE = 216;
+constexpr float TWO_PI = 6.28318531f;
+
+struct check_options {
+    int tracks = 40;
+    int seconds = 30;
+    int clusters = 8;
+    uint32_t seed = 1;
+    double epsilon = 0.001;
+    int topn = 10;
+    double mel_tolerance = 1e-4;
+    double slice_tolerance = 1e-3;
+    double vector_tolerance = 1e-4;
+    double min_overlap = 0.9;
+};
+
+// The slices of both paths and the vector of every slice.
+struct track_result {
+    std::vector<float> slices;
+    matrixf vectors;
+};
+
+// A chord on a root set by the cluster, with a tempo and noise of its own. The lengths
+// vary so the last frame and slice are cut at different places.
+vectorf synthetic_track(const check_options &options, int track) {
+    std::seed_seq seq = {options.seed, static_cast<uint32_t>(track)};
+    std::mt19937 rng(seq);
+    std::normal_distribution<float> normal(0.f, 0.05f);
+    std::uniform_real_distribution<float> uniform;
+    const int cluster = track % options.clusters;
+    const float root = 110.f * std::pow(2.f, static_cast<float>(cluster % 36) / 12.f) * (0.98f + 0.04f * uniform(rng));
+    const float tempo = 1.f + 3.f * uniform(rng);
+    const int size = static_cast<int>(options.seconds * SAMPLING_RATE * (0.75f + 0.5f * uniform(rng)));
+
+    vectorf samples(size);
+    for (int i = 0; i < size; i++) {
+        const float t = static_cast<float>(i) / SAMPLING_RATE;
+        const float envelope = 0.6f + 0.4f * std::sin(TWO_PI * tempo * t);
+        samples[i] = envelope * (0.3f * std::sin(TWO_PI * root * t) + 0.2f * std::sin(TWO_PI * root * 1.26f * t) +
+                                 0.2f * std::sin(TWO_PI * root * 1.5f * t)) +
+                     normal(rng);
+    }
+    return samples;
+}
+
+matrixf reference_mel(vectorf samples) {
+    return librosa::internal::melspectrogram(samples, SAMPLING_RATE, N_FFT, HOP_LENGTH, "hann", true, "constant", 2,
+                                             N_MELS, 0, SAMPLING_RATE / 2);
+}
+
+// Position of a value in the model input, which tensor_from_samples lays out as a
+// column-major tensor of slice x 1 x mel x frame.
+size_t input_index(size_t batch, size_t slice, size_t mel, size_t frame) {
+    return slice + batch * (mel + N_MELS * frame);
+}
+
+// The model input as the scan computed it with librosa.
+std::vector<float> reference_slices(const matrixf &mel) {
+    const int batch = mel.cols() / SLICE_SIZE;
+    std::vector<float> values(static_cast<size_t>(batch) * N_MELS * SLICE_SIZE);
+    for (int slice = 0; slice < batch; slice++) {
+        matrixf submatrix = mel.block(0, slice * SLICE_SIZE, N_MELS, SLICE_SIZE);
+        matrixf log_S = librosa::internal::power2db(submatrix);
+        const float max_val = log_S.maxCoeff();
+        const float min_val = log_S.minCoeff();
+        const float denom = max_val - min_val;
+        if (denom != 0) {
+            log_S = (log_S.array() - min_val) / denom;
+        }
+        for (int m = 0; m < N_MELS; m++) {
+            for (int i = 0; i < SLICE_SIZE; i++) {
+                values[input_index(batch, slice, m, i)] = log_S(m, i);
+            }
+        }
+    }
+    return values;
+}
+
+// One vector per slice: the output of the model, or without one the mean of every band
+// over the slice, which still follows the mel bands the model sees.
+matrixf slice_vectors(deejai::scanner *model, std::vector<float> slices) {
+    const int64_t batch = static_cast<int64_t>(slices.size() / (N_MELS * SLICE_SIZE));
+    if (model == nullptr) {
+        matrixf vectors(batch, N_MELS);
+        for (int64_t slice = 0; slice < batch; slice++) {
+            for (int m = 0; m < N_MELS; m++) {
+                float sum = 0.f;
+                for (int i = 0; i < SLICE_SIZE; i++) {
+                    sum += slices[input_index(batch, slice, m, i)];
+                }
+                vectors(slice, m) = sum / SLICE_SIZE;
+            }
+        }
+        return vectors;
+    }
+
+    const std::vector<int64_t> shape = {batch, 1, N_MELS, SLICE_SIZE};
+    Ort::MemoryInfo memory_info = Ort::MemoryInfo::CreateCpu(OrtDeviceAllocator, OrtMemTypeDefault);
+    deejai::audio_file_tensor tensor;
+    tensor.buffer = std::move(slices);
+    tensor.tensor = Ort::Value::CreateTensor<float>(memory_info, tensor.buffer.data(), tensor.buffer.size(),
+                                                    shape.data(), shape.size());
+    std::vector<Ort::Value> prediction = model->predict(tensor);
+    return deejai::utils::ort_to_matrix(prediction[0]);
+}
+
+std::vector<vectorf> bundle(const std::vector<track_result> &tracks, double epsilon) {
+    std::vector<const matrixf *> matrices;
+    for (const auto &track : tracks) {
+        matrices.push_back(&track.vectors);
+    }
+    return deejai::tfidf_vectors(matrices, epsilon);
+}
+
+// The topn tracks closest to every track by cosine similarity.
+std::vector<std::vector<int>> neighbours(const std::vector<vectorf> &vecs, int topn) {
+    const int n = static_cast<int>(vecs.size());
+    std::vector<std::vector<int>> result(n);
+    for (int i = 0; i < n; i++) {
+        std::vector<std::pair<float, int>> scores;
+        for (int j = 0; j < n; j++) {
+            if (j != i) {
+                scores.emplace_back(-vecs[i].dot(vecs[j]) / (vecs[i].norm() * vecs[j].norm()), j);
+            }
+        }
+        const int k = std::min(topn, static_cast<int>(scores.size()));
+        std::partial_sort(scores.begin(), scores.begin() + k, scores.end());
+        for (int r = 0; r < k; r++) {
+            result[i].push_back(scores[r].second);
+        }
+    }
+    return result;
+}
+
+bool report(const char *name, double value, double tolerance, bool at_least) {
+    const bool passed = at_least ? value >= tolerance : value <= tolerance;
+    std::printf("%-22s %12.4g  %s %-10.4g %s\n", name, value, at_least ? ">=" : "<=", tolerance,
+                passed ? "ok" : "FAILED");
+    return passed;
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+    try {
+        cxxopts::Options cli("deej-ai-check", "Checks the optimised scan path against the librosa reference.\n"
+                                              "  deej-ai-check [--model <path>] [--tracks <n>] [--seconds <n>]\n");
+        cli.add_options()("h,help", "Print help.");
+        cli.add_options()("m,model", "ONNX model to compare the embeddings of, without one the slice vectors are the "
+                                     "band means of the slices.",
+                          cxxopts::value<std::string>());
+        cli.add_options()("tracks", "Number of synthetic tracks.", cxxopts::value<int>()->default_value("40"));
+        cli.add_options()("seconds", "Average length of the tracks.", cxxopts::value<int>()->default_value("30"));
+        cli.add_options()("clusters", "Number of chords the tracks are drawn from.",
+                          cxxopts::value<int>()->default_value("8"));
+        cli.add_options()("seed", "Seed of the tracks.", cxxopts::value<uint32_t>()->default_value("1"));
+        cli.add_options()("e,epsilon", "Epsilon value of the TF-IDF bundling.",
+                          cxxopts::value<double>()->default_value("0.001"));
+        cli.add_options()("n,topn", "Number of neighbours compared per track.",
+                          cxxopts::value<int>()->default_value("10"));
+        cli.add_options()("mel-tolerance", "Largest difference of the mel spectrograms, relative to their maximum.",
+                          cxxopts::value<double>()->default_value("1e-4"));
+        cli.add_options()("slice-tolerance", "Largest difference of the normalised slices, which are in [0, 1].",
+                          cxxopts::value<double>()->default_value("1e-3"));
+        cli.add_options()("vector-tolerance", "Largest cosine distance between the bundled vectors of a track.",
+                          cxxopts::value<double>()->default_value("1e-4"));
+        cli.add_options()("min-overlap", "Smallest mean share of the neighbours both paths agree on.",
+                          cxxopts::value<double>()->default_value("0.9"));
+
+        auto result = cli.parse(argc, argv);
+        if (result.count("help")) {
+            std::cout << cli.help() << std::endl;
+            return 0;
+        }
+
+        check_options options;
+        options.tracks = std::max(result["tracks"].as<int>(), 2);
+        options.seconds = std::max(result["seconds"].as<int>(), 1);
+        options.clusters = std::max(result["clusters"].as<int>(), 1);
+        options.seed = result["seed"].as<uint32_t>();
+        options.epsilon = result["epsilon"].as<double>();
+        options.topn = std::max(result["topn"].as<int>(), 1);
+        options.mel_tolerance = result["mel-tolerance"].as<double>();
+        options.slice_tolerance = result["slice-tolerance"].as<double>();
+        options.vector_tolerance = result["vector-tolerance"].as<double>();
+        options.min_overlap = result["min-overlap"].as<double>();
+
+        std::unique_ptr<deejai::scanner> model;
+        if (result.count("model")) {
+            model = std::make_unique<deejai::scanner>(result["model"].as<std::string>(), "");
+            const std::vector<int64_t> shape = model->input_shape();
+            if (shape.size() != 4 || shape[2] != N_MELS || shape[3] != SLICE_SIZE) {
+                std::cerr << "The model does not take slices of " << N_MELS << " x " << SLICE_SIZE << std::endl;
+                return 1;
+            }
+        }
+
+        std::cout << "Comparing " << options.tracks << " tracks with the " << deejai::kernels::active().name
+                  << " kernels" << (model ? "" : ", without a model") << std::endl;
+        double mel_error = 0;
+        double slice_error = 0;
+        std::vector<track_result> reference(options.tracks);
+        std::vector<track_result> optimised(options.tracks);
+        for (int track = 0; track < options.tracks; track++) {
+            vectorf samples = synthetic_track(options, track);
+
+            const matrixf expected = reference_mel(samples);
+            const matrixf mel = deejai::mel_spectrogram(samples, SAMPLING_RATE, N_FFT, HOP_LENGTH, N_MELS);
+            if (mel.rows() != expected.rows() || mel.cols() != expected.cols()) {
+                std::cerr << "Track " << track << ": the mel spectrogram is " << mel.rows() << " x " << mel.cols()
+                          << " instead of " << expected.rows() << " x " << expected.cols() << std::endl;
+                return 1;
+            }
+            mel_error = std::max<double>(mel_error, (mel - expected).cwiseAbs().maxCoeff() / expected.maxCoeff());
+
+            reference[track].slices = reference_slices(expected);
+            std::optional<deejai::audio_file_tensor> tensor = deejai::tensor_from_samples(samples, N_MELS, SLICE_SIZE);
+            if (!tensor.has_value() || tensor->buffer.size() != reference[track].slices.size()) {
+                std::cerr << "Track " << track << ": the model input has a different number of slices" << std::endl;
+                return 1;
+            }
+            optimised[track].slices = std::move(tensor->buffer);
+            for (size_t i = 0; i < optimised[track].slices.size(); i++) {
+                slice_error = std::max<double>(
+                    slice_error, std::abs(optimised[track].slices[i] - reference[track].slices[i]));
+            }
+
+            reference[track].vectors = slice_vectors(model.get(), reference[track].slices);
+            optimised[track].vectors = slice_vectors(model.get(), optimised[track].slices);
+        }
+
+        const std::vector<vectorf> expected_vecs = bundle(reference, options.epsilon);
+        const std::vector<vectorf> vecs = bundle(optimised, options.epsilon);
+        double vector_error = 0;
+        for (int track = 0; track < options.tracks; track++) {
+            const double cosine = expected_vecs[track].dot(vecs[track]) / (expected_vecs[track].norm() * vecs[track].norm());
+            vector_error = std::max(vector_error, 1.0 - cosine);
+        }
+
+        const auto expected_neighbours = neighbours(expected_vecs, options.topn);
+        const auto found_neighbours = neighbours(vecs, options.topn);
+        double overlap = 0;
+        double min_overlap = 1;
+        for (int track = 0; track < options.tracks; track++) {
+            const auto &expected = expected_neighbours[track];
+            int common = 0;
+            for (int neighbour : found_neighbours[track]) {
+                common += std::find(expected.begin(), expected.end(), neighbour) != expected.end();
+            }
+            const double share = static_cast<double>(common) / expected.size();
+            overlap += share / options.tracks;
+            min_overlap = std::min(min_overlap, share);
+        }
+
+        bool passed = report("mel spectrogram", mel_error, options.mel_tolerance, false);
+        passed &= report("normalised slices", slice_error, options.slice_tolerance, false);
+        passed &= report("bundled vectors", vector_error, options.vector_tolerance, false);
+        passed &= report("neighbour overlap", overlap, options.min_overlap, true);
+        std::printf("%-22s %12.4g\n", "worst track overlap", min_overlap);
+        if (!passed) {
+            std::cerr << "The optimised path differs from the reference." << std::endl;
+            return 1;
+        }
+    } catch (const std::exception &e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
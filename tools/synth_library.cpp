@@ -0,0 +1,315 @@
+#include "cxxopts.hpp"
+#include "deejai/common.hpp"
+#include "deejai/embeddings.hpp"
+#include "deejai/knn_graph.hpp"
+#include "deejai/scanner.hpp"
+#include "deejai/utils.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// Writes a synthetic library in the layout of a scan, so the bundling, generation and
+// scan code can be tested at any size without a music collection.
+
+namespace {
+
+struct synth_options {
+    int tracks = 10000;
+    int slices = 10;
+    int dim = 100;
+    int clusters = 0;
+    float spread = 0.5f;
+    uint32_t seed = 1;
+    int batch_size = 100;
+    double epsilon = 0.001;
+    bool track_files = false;
+    std::string audio_dir;
+    int audio_seconds = 10;
+};
+
+constexpr int SAMPLING_RATE = 22050;
+constexpr float TWO_PI = 6.28318531f;
+
+// Every track draws its own generator from the seed, so the library does not depend on
+// the number of jobs.
+std::mt19937 track_rng(const synth_options &options, int track, uint32_t stream) {
+    std::seed_seq seq = {options.seed, static_cast<uint32_t>(track), stream};
+    return std::mt19937(seq);
+}
+
+int track_cluster(const synth_options &options, int track) {
+    std::mt19937 rng = track_rng(options, track, 0);
+    return std::uniform_int_distribution<int>(0, options.clusters - 1)(rng);
+}
+
+// The slice vectors of a track: a centre drawn around the centre of its cluster, and the
+// slices around the track centre.
+deejai::matrixf track_slices(const synth_options &options, const deejai::matrixf &centres, int track) {
+    std::mt19937 rng = track_rng(options, track, 1);
+    std::normal_distribution<float> normal;
+    deejai::vectorf centre = centres.row(track_cluster(options, track));
+    for (int d = 0; d < options.dim; d++) {
+        centre[d] += options.spread * normal(rng);
+    }
+    deejai::matrixf slices(options.slices, options.dim);
+    for (int s = 0; s < options.slices; s++) {
+        for (int d = 0; d < options.dim; d++) {
+            slices(s, d) = centre[d] + 0.5f * options.spread * normal(rng);
+        }
+    }
+    return slices;
+}
+
+std::string track_path(const synth_options &options, int track) {
+    char name[32];
+    std::snprintf(name, sizeof(name), "t%07d.wav", track);
+    if (options.audio_dir.empty()) {
+        return std::string("/synthetic/") + name;
+    }
+    const std::u8string path = std::filesystem::absolute(std::filesystem::path(options.audio_dir) / name).u8string();
+    return std::string(path.begin(), path.end());
+}
+
+// Mono 16 bit PCM: a chord on a root set by the cluster, so tracks of a cluster sound alike.
+bool write_wav(const synth_options &options, int track) {
+    std::mt19937 rng = track_rng(options, track, 2);
+    std::normal_distribution<float> normal(0.f, 0.05f);
+    std::uniform_real_distribution<float> detune(0.98f, 1.02f);
+    const float root = 110.f * std::pow(2.f, static_cast<float>(track_cluster(options, track) % 36) / 12.f) * detune(rng);
+    const float tempo = 1.f + 3.f * std::uniform_real_distribution<float>()(rng);
+
+    const uint32_t num_samples = static_cast<uint32_t>(options.audio_seconds) * SAMPLING_RATE;
+    std::vector<int16_t> samples(num_samples);
+    for (uint32_t i = 0; i < num_samples; i++) {
+        const float t = static_cast<float>(i) / SAMPLING_RATE;
+        const float envelope = 0.6f + 0.4f * std::sin(TWO_PI * tempo * t);
+        float value = envelope * (0.3f * std::sin(TWO_PI * root * t) + 0.2f * std::sin(TWO_PI * root * 1.26f * t) +
+                                  0.2f * std::sin(TWO_PI * root * 1.5f * t)) +
+                      normal(rng);
+        samples[i] = static_cast<int16_t>(std::clamp(value, -1.f, 1.f) * 32767.f);
+    }
+
+    char name[32];
+    std::snprintf(name, sizeof(name), "t%07d.wav", track);
+    std::ofstream out(std::filesystem::path(options.audio_dir) / name, std::ios::binary);
+    auto put = [&](auto value) { out.write(reinterpret_cast<const char *>(&value), sizeof(value)); };
+    const uint32_t data_bytes = num_samples * sizeof(int16_t);
+    out.write("RIFF", 4);
+    put(uint32_t(36 + data_bytes));
+    out.write("WAVEfmt ", 8);
+    put(uint32_t(16));
+    put(uint16_t(1)); // PCM
+    put(uint16_t(1)); // mono
+    put(uint32_t(SAMPLING_RATE));
+    put(uint32_t(SAMPLING_RATE * sizeof(int16_t)));
+    put(uint16_t(sizeof(int16_t)));
+    put(uint16_t(16));
+    out.write("data", 4);
+    put(data_bytes);
+    out.write(reinterpret_cast<const char *>(samples.data()), data_bytes);
+    return static_cast<bool>(out);
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+    try {
+        cxxopts::Options cli("deej-ai-synth", "Writes a synthetic library in the layout of a scan.\n"
+                                              "  deej-ai-synth --vec-dir <path> [--tracks <n>] [--track-files] [--audio-dir <path>]\n");
+        cli.add_options()("h,help", "Print help.");
+        cli.add_options()("d,vec-dir", "Vector directory to write.", cxxopts::value<std::string>());
+        cli.add_options()("tracks", "Number of tracks.", cxxopts::value<int>()->default_value("10000"));
+        cli.add_options()("slices", "Vectors per track, one per slice of audio.", cxxopts::value<int>()->default_value("10"));
+        cli.add_options()("dim", "Dimension of the vectors.", cxxopts::value<int>()->default_value("100"));
+        cli.add_options()("clusters", "Number of clusters the tracks are drawn around, like genres. "
+                                      "Defaults to one per 50 tracks.",
+                          cxxopts::value<int>()->default_value("0"));
+        cli.add_options()("spread", "Spread of the tracks around their cluster per dimension, the cluster centres "
+                                    "are about 1 apart per dimension.",
+                          cxxopts::value<float>()->default_value("0.5"));
+        cli.add_options()("seed", "Seed of the library.", cxxopts::value<uint32_t>()->default_value("1"));
+        cli.add_options()("b,batch-size", "Tracks per TF-IDF batch when bundling, as in the scan.",
+                          cxxopts::value<int>()->default_value("100"));
+        cli.add_options()("e,epsilon", "Epsilon value of the TF-IDF bundling.",
+                          cxxopts::value<double>()->default_value("0.001"));
+        cli.add_options()("bundle-format", "Storage format of the bundle ('f32', 'f16', 'int8' or 'none' for no bundle).",
+                          cxxopts::value<std::string>()->default_value("f32"));
+        cli.add_options()("graph-neighbours", "Number of nearest neighbours per track in the graph saved with the bundle.",
+                          cxxopts::value<int>()->default_value("0"));
+        cli.add_options()("track-files", "Also write the vectors of every track in its own file, as the scan does "
+                                         "before bundling.");
+        cli.add_options()("audio-dir", "Also write a WAV file per track in this directory, the tracks are named "
+                                       "after them. Scan it to run the whole scan path.",
+                          cxxopts::value<std::string>());
+        cli.add_options()("audio-seconds", "Length of the WAV files.", cxxopts::value<int>()->default_value("10"));
+        cli.add_options()("j,jobs", "The maximum number of threads that should be used.",
+                          cxxopts::value<int>()->default_value("-1"));
+
+        auto result = cli.parse(argc, argv);
+        if (result.count("help") || !result.count("vec-dir")) {
+            std::cout << cli.help() << std::endl;
+            return result.count("help") ? 0 : 1;
+        }
+
+        synth_options options;
+        options.tracks = std::max(result["tracks"].as<int>(), 1);
+        options.slices = std::max(result["slices"].as<int>(), 1);
+        options.dim = std::max(result["dim"].as<int>(), 1);
+        options.clusters = result["clusters"].as<int>() > 0 ? result["clusters"].as<int>() : std::max(1, options.tracks / 50);
+        options.spread = result["spread"].as<float>();
+        options.seed = result["seed"].as<uint32_t>();
+        options.batch_size = std::max(result["batch-size"].as<int>(), 1);
+        options.epsilon = result["epsilon"].as<double>();
+        options.track_files = result.count("track-files");
+        options.audio_dir = result.count("audio-dir") ? result["audio-dir"].as<std::string>() : "";
+        options.audio_seconds = std::max(result["audio-seconds"].as<int>(), 1);
+
+        const std::string format_name = result["bundle-format"].as<std::string>();
+        const auto format = deejai::storage_format_from_string(format_name);
+        if (!format.has_value() && format_name != "none") {
+            std::cerr << "--bundle-format must be one of: f32, f16, int8, none" << std::endl;
+            return 1;
+        }
+        const int graph_neighbours = result["graph-neighbours"].as<int>();
+
+        size_t jobs = std::max<size_t>(1, std::thread::hardware_concurrency());
+        if (result["jobs"].as<int>() > 0) {
+            jobs = std::min(jobs, static_cast<size_t>(result["jobs"].as<int>()));
+        }
+
+        const std::filesystem::path vecs_dir = result["vec-dir"].as<std::string>();
+        const std::filesystem::path bundled_dir = vecs_dir / deejai::BUNDLED_VECS_DIRNAME;
+        std::filesystem::create_directories(bundled_dir);
+        if (!options.audio_dir.empty()) {
+            std::filesystem::create_directories(options.audio_dir);
+        }
+
+        // centres 1 apart on average, the spread sets how much the clusters overlap
+        deejai::matrixf centres(options.clusters, options.dim);
+        {
+            std::mt19937 rng(options.seed);
+            std::normal_distribution<float> normal(0.f, 1.f / std::sqrt(2.f));
+            for (int i = 0; i < centres.size(); i++) {
+                centres.data()[i] = normal(rng);
+            }
+        }
+
+        // each worker takes a batch of tracks, bundled together as the scan would
+        const auto start = std::chrono::steady_clock::now();
+        const int num_batches = (options.tracks + options.batch_size - 1) / options.batch_size;
+        std::vector<std::string> tracks(options.tracks);
+        deejai::matrixf bundled(format.has_value() ? options.tracks : 0, options.dim);
+        std::atomic<int> next_batch = 0;
+        std::atomic<int> done = 0;
+        std::atomic<bool> failed = false;
+        std::mutex progress_mutex;
+        auto worker = [&]() {
+            for (int batch = next_batch++; batch < num_batches; batch = next_batch++) {
+                const int begin = batch * options.batch_size;
+                const int end = std::min(begin + options.batch_size, options.tracks);
+                std::vector<deejai::matrixf> slices;
+                for (int track = begin; track < end; track++) {
+                    tracks[track] = track_path(options, track);
+                    slices.push_back(track_slices(options, centres, track));
+                    if (options.track_files) {
+                        const std::u8string u8path(tracks[track].begin(), tracks[track].end());
+                        const std::filesystem::path path = vecs_dir / deejai::utils::scanned_filename(u8path);
+                        if (!deejai::utils::save_matrix_map({{tracks[track], slices.back()}}, path)) {
+                            failed = true;
+                        }
+                    }
+                    if (!options.audio_dir.empty()) {
+                        if (!write_wav(options, track)) {
+                            failed = true;
+                        }
+                    }
+                }
+                if (format.has_value()) {
+                    std::vector<const deejai::matrixf *> matrices;
+                    for (const auto &matrix : slices) {
+                        matrices.push_back(&matrix);
+                    }
+                    const std::vector<deejai::vectorf> vecs = deejai::tfidf_vectors(matrices, options.epsilon);
+                    for (int track = begin; track < end; track++) {
+                        bundled.row(track) = vecs[track - begin];
+                    }
+                }
+                const int finished = done.fetch_add(end - begin) + end - begin;
+                if (batch % 100 == 0) {
+                    std::lock_guard<std::mutex> lock(progress_mutex);
+                    std::cout << "Progress: " << finished << " / " << options.tracks << std::endl;
+                }
+            }
+        };
+        std::vector<std::thread> threads;
+        for (size_t t = 1; t < std::min(jobs, static_cast<size_t>(num_batches)); t++) {
+            threads.emplace_back(worker);
+        }
+        worker();
+        for (auto &thread : threads) {
+            thread.join();
+        }
+        if (failed) {
+            std::cerr << "Failed to write the track files." << std::endl;
+            return 1;
+        }
+
+        if (format.has_value()) {
+            const std::filesystem::path bundled_vecs_path = bundled_dir / deejai::BUNDLED_VECS_FILENAME;
+            bool saved = false;
+            if (*format == deejai::storage_format::f32) {
+                // the format the scan saves float32 bundles in
+                std::unordered_map<std::string, deejai::matrixf> map;
+                map.reserve(tracks.size());
+                for (int track = 0; track < options.tracks; track++) {
+                    map.emplace(tracks[track], bundled.row(track));
+                }
+                saved = deejai::utils::save_matrix_map(map, bundled_vecs_path);
+            } else {
+                // the names are zero padded, so the rows are already sorted by path as bundles are
+                saved = deejai::save_bundle(tracks, deejai::embeddings(bundled, *format), bundled_vecs_path);
+            }
+            if (!saved) {
+                std::cerr << "Failed to save the bundle." << std::endl;
+                return 1;
+            }
+
+            const std::filesystem::path graph_path = bundled_dir / deejai::KNN_GRAPH_FILENAME;
+            std::error_code ec;
+            std::filesystem::remove(graph_path, ec);
+            if (graph_neighbours > 0) {
+                const auto checksum = deejai::utils::stored_checksum(bundled_vecs_path);
+                const auto loaded = deejai::load_bundle(bundled_vecs_path);
+                if (!checksum.has_value() || !loaded.has_value()) {
+                    std::cerr << "Failed to reload the bundle." << std::endl;
+                    return 1;
+                }
+                const auto graph = deejai::knn_graph::build(loaded->vectors, graph_neighbours, *checksum, jobs);
+                if (!graph.save(graph_path)) {
+                    std::cerr << "Failed to save the neighbour graph." << std::endl;
+                    return 1;
+                }
+            }
+        }
+
+        const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        std::cout << "Wrote " << options.tracks << " tracks in " << options.clusters << " clusters to " << vecs_dir
+                  << " in " << elapsed.count() << " s" << std::endl;
+    } catch (const std::exception &e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}